@@ -1,21 +1,60 @@
 # coding=utf-8
 
+import io
 import os
 import cv2
+import time
 import redis
 import logging
+import threading
 import numpy as np
 
 from actor import app
 from datetime import datetime
 from flask import jsonify, g, abort, send_file, request
 
+try:
+    from RBML import FrameServer, BlobStore, FrameRing, PersonDetector, \
+        PersonIndex, GetFeature
+except ImportError:
+    FrameServer = None
+    BlobStore = None
+    FrameRing = None
+    PersonDetector = None
+    PersonIndex = None
+    GetFeature = None
+
 # default configuration
 APP_NAME = "Actor"
 LOG_DIR = "/tmp/actor/log/"
 REDIS_HOST = "127.0.0.1"
 REDIS_PORT = 6379
 REDIS_DB = 0
+# keyframes and person crops packed by camera and hour, see
+# bako/src/blobstore.h
+BLOB_DIR = "/tmp/gee/blobs/"
+# PCA of the person features, as bako's: the binary model made by
+# rbml_convert, which loads in milliseconds, or the XML
+PCA_FILE = "bako/src/RBML/feature.model"
+if not os.path.exists(PCA_FILE):
+    PCA_FILE = "bako/src/RBML/PCA.xml"
+# persons are detected on a proxy this wide, as bako's analytics do
+PROXY_WIDTH = 640
+# decoded frames cached for scrubbing, some GOPs of 1080p
+FRAME_CACHE_BYTES = 512 << 20
+# person shots searched, behind the newest one, in ms
+SEARCH_RETENTION_MS = 7 * 24 * 3600 * 1000
+# results of a search by default
+SEARCH_COUNT = 20
+
+# ids of the person shots in the order bako saves them, see
+# bako/src/memcache.h
+PERSON_SHOT_LIST = "psl"
+# persons of a keyframe bako saves at most, see bako/src/shotid.h
+MAX_SHOT_SEQUENCE = 99
+# vectors of the fused feature model, older ones are migrated by
+# migrate_vectors.py
+EMBEDDING_SPACE = "embedding"
 
 # load configuration
 app.config.from_object(__name__)
@@ -23,6 +62,29 @@ app.config.from_object(__name__)
 raw_time_fmt = "%Y%m%d%H%M%S"
 time_fmt = "%Y-%m-%d %H:%M:%S"
 
+# decoded GOP cache shared by requests, bounded by the bytes of its
+# frames, see bako/src/frameserver.h
+frame_server = FrameServer(app.config["FRAME_CACHE_BYTES"], 4) \
+    if FrameServer else None
+blob_store = BlobStore(app.config["BLOB_DIR"]) if BlobStore else None
+# persons detected and described as bako does, see
+# bako/src/persondetector.h
+person_detector = PersonDetector(app.config["PCA_FILE"],
+                                 app.config["PROXY_WIDTH"]) \
+    if PersonDetector else None
+# live frames and persons forwarded by bako, by camera id
+live_rings = {}
+# person shots of every camera, filled from redis as bako saves them and
+# searched with their camera and time filters, see
+# bako/src/personindex.h
+person_index = PersonIndex(100, app.config["SEARCH_RETENTION_MS"]) \
+    if PersonIndex else None
+# offset of the next id in PERSON_SHOT_LIST
+person_index_state = {"offset": 0}
+person_index_lock = threading.Lock()
+# features of the query crops, as bako's
+feature_extractor = GetFeature(app.config["PCA_FILE"]) if GetFeature else None
+
 
 def connect_redis():
     """Connect to the specific database."""
@@ -117,6 +179,13 @@ def fetch_frame(vid, frame_pos):
     #if int(frame_pos) > int(vs_frames):
     #    return None
 
+    # pieces with a frame index are decoded from the nearest keyframe,
+    # the returned frame is read-only
+    if frame_server is not None:
+        frame = frame_server.fetch(video_shot_full_path, int(frame_pos))
+        if frame is not None:
+            return frame
+
     cap = cv2.VideoCapture(video_shot_full_path)
     cap.set(cv2.cv.CV_CAP_PROP_POS_FRAMES, float(frame_pos))
 
@@ -128,6 +197,62 @@ def fetch_frame(vid, frame_pos):
     return None
 
 
+def save_jpeg(blob_id, image, static_dir):
+    """Save image as a blob, or as a file in static_dir without RBML.
+
+    Returns:
+        False if failed
+    """
+    if blob_store is None:
+        return cv2.imwrite("{}{}.{}".format(static_dir, blob_id, "jpeg"),
+                           image)
+    ok, data = cv2.imencode(".jpeg", image)
+    return ok and blob_store.put(blob_id, data.tostring())
+
+
+def fetch_keyframe(keyframe_id):
+    """Keyframe bako saved in the blob store, see
+    bako/src/keyframewriter.h.
+
+    Returns:
+        Mat frame or None if not found
+    """
+    data = blob_store.get(keyframe_id) if blob_store is not None else None
+    if data is None:
+        return None
+    return cv2.imdecode(np.frombuffer(data, np.uint8), 1)
+
+
+def send_blob(blob_id):
+    data = blob_store.get(blob_id) if blob_store is not None else None
+    if data is None:
+        abort(404)
+    return send_file(io.BytesIO(data), mimetype="image/jpeg")
+
+
+def fetch_live(cam_id, timeout_ms=0):
+    """Fetch the newest frame of a camera with the persons of its latest
+    keyframe, as bako forwards them, without decoding. By default the
+    newest frame as it is now, a request never waits for the next one.
+
+    Returns:
+        (frame, rects, frame_id) or None, frame is a read-only view which
+        is checked with valid(frame_id) once used
+    """
+    if FrameRing is None:
+        return None
+    if cam_id not in live_rings:
+        try:
+            live_rings[cam_id] = FrameRing(cam_id)
+        except ValueError:
+            return None
+    live = live_rings[cam_id].latest(timeout_ms)
+    if live is None:
+        return None
+    frame, rects, frame_id, video_id, frame_pos = live
+    return frame, rects, frame_id
+
+
 def cache_query_frame(frame):
     """Cache frame to redis.
 
@@ -144,35 +269,199 @@ def inside(r, q):
 
 
 def human_detect(frame):
+    """Detect persons in the given frame, on a PROXY_WIDTH wide proxy like
+    bako's analytics.
+
+    Returns:
+        rects as (x, y, w, h) in the frame
+    """
+    if person_detector is not None:
+        return person_detector.detect_rects(frame)
+
+    height, width = frame.shape[:2]
+    proxy = frame
+    if 0 < PROXY_WIDTH < width:
+        proxy = cv2.resize(frame, (PROXY_WIDTH, height * PROXY_WIDTH // width),
+                           interpolation=cv2.INTER_AREA)
+    sx = float(width) / proxy.shape[1]
+    sy = float(height) / proxy.shape[0]
+
     hog = cv2.HOGDescriptor()
     hog.setSVMDetector(cv2.HOGDescriptor_getDefaultPeopleDetector())
 
-    found_rects, w = hog.detectMultiScale(frame, 0, (8, 8), (32, 32), 1.05, 2)
+    found_rects, _ = hog.detectMultiScale(proxy, 0, (8, 8), (32, 32), 1.05, 2)
     found_rects_filtered = []
     for ri, r in enumerate(found_rects):
             for qi, q in enumerate(found_rects):
                 if ri != qi and inside(r, q):
                     break
             else:
-                found_rects_filtered.append(r)
+                x, y, w, h = r
+                found_rects_filtered.append(
+                    (int(round(x * sx)), int(round(y * sy)),
+                     int(round(w * sx)), int(round(h * sy))))
 
     return found_rects_filtered
 
 
-def extract_person_shots(frame):
-    """Extract person shots from the given frame.
+def stored_person_rects(frame_id):
+    """Persons bako saved for a keyframe, with sequences from 0 on.
+
+    Returns:
+        [(person shot id, (x, y, w, h)), ...], [] if it saved none
+    """
+    pipe = get_redis().pipeline()
+    for seq in range(MAX_SHOT_SEQUENCE + 1):
+        pipe.hget("ps:{}{:02d}".format(frame_id, seq), "rect")
+    rects = []
+    for seq, rect in enumerate(pipe.execute()):
+        if rect is None:
+            break
+        x1, y1, x2, y2 = [int(v) for v in rect.split()]
+        rects.append(("{}{:02d}".format(frame_id, seq),
+                      (x1, y1, x2 - x1, y2 - y1)))
+    return rects
+
+
+def track_path(shot_id):
+    """Path of the person who owns the shot, across the cameras.
+
+    Follows the chain of tracks bako saved, see bako/src/tracker.h.
+
+    Returns:
+        tracks in time order, each with its camera, time range and shot
+        ids, [] if the shot is in no finished track
+    """
+    r = get_redis()
+    track_id = r.hget("tk:shots", shot_id)
+    if track_id is None:
+        return []
+
+    # back to the head, links only go forward in time
+    seen = set([track_id])
+    prev = r.hget("tk:{}".format(track_id), "prev")
+    while prev is not None and prev not in seen:
+        seen.add(prev)
+        track_id = prev
+        prev = r.hget("tk:{}".format(track_id), "prev")
+
+    path = []
+    seen = set()
+    while track_id is not None and track_id not in seen:
+        seen.add(track_id)
+        track = r.hgetall("tk:{}".format(track_id))
+        if not track:
+            break
+        path.append({
+            "id": track_id,
+            "cam_id": track["cam_id"],
+            "start_time": track["start_time"],
+            "end_time": track["end_time"],
+            "shots": r.lrange(track["shots"], 0, -1)
+        })
+        track_id = track.get("next")
+    return path
+
+
+def parse_vector(values):
+    """A psm: list, dimension then elements, as a column.
+
+    Returns:
+        float32 array or None if malformed
+    """
+    if not values or int(values[0]) != len(values) - 1:
+        return None
+    return np.array(values[1:], dtype=np.float32).reshape(-1, 1)
+
+
+def load_person_index():
+    """Index the person shots bako saved since the last call."""
+    r = get_redis()
+    with person_index_lock:
+        offset = person_index_state["offset"]
+        shot_ids = r.lrange(PERSON_SHOT_LIST, offset, -1)
+        if not shot_ids:
+            return
+
+        pipe = r.pipeline()
+        for shot_id in shot_ids:
+            pipe.hmget("ps:{}".format(shot_id), "timestamp",
+                       "proper_vector_id", "vector_space")
+        metas = pipe.execute()
+        pipe = r.pipeline()
+        for _, vector_key, _ in metas:
+            pipe.lrange(vector_key or "", 0, -1)
+        vectors = pipe.execute()
+
+        for shot_id, meta, values in zip(shot_ids, metas, vectors):
+            timestamp, _, space = meta
+            vector = parse_vector(values)
+            # not migrated yet, see migrate_vectors.py
+            if timestamp is None or vector is None or \
+                    space != EMBEDDING_SPACE:
+                continue
+            person_index.insert(shot_id, int(timestamp), vector)
+        person_index_state["offset"] = offset + len(shot_ids)
+
+
+def query_vector(person_shot_id):
+    """Vector of a person shot saved by bako, else of the crop cached by
+    get_gee_person_shots_archive().
 
     Returns:
-        list of person_shots
+        float32 column or None if not found
     """
-    rectangles = human_detect(frame)
-    person_shots = []
-    for rect in rectangles:
-        frame_n = np.copy(frame)
-        (x, y, w, h) = rect
-        person_shot = frame_n[y:y+h, x:x+w]
-        person_shots.append(person_shot)
-    return person_shots
+    r = get_redis()
+    vector_key, space = r.hmget("ps:{}".format(person_shot_id),
+                                "proper_vector_id", "vector_space")
+    if vector_key is not None and space == EMBEDDING_SPACE:
+        vector = parse_vector(r.lrange(vector_key, 0, -1))
+        if vector is not None:
+            return vector
+
+    if blob_store is not None:
+        data = blob_store.get(person_shot_id)
+        crop = cv2.imdecode(np.frombuffer(data, np.uint8), 1) \
+            if data is not None else None
+    else:
+        crop = cv2.imread("actor/static/tmp/person-shots/{}.jpeg".format(
+            person_shot_id))
+    if crop is None or feature_extractor is None:
+        return None
+    return np.asarray(feature_extractor.get_feature(crop),
+                      dtype=np.float32).reshape(-1, 1)
+
+
+def epoch_ms(time_str):
+    return int(time.mktime(
+        datetime.strptime(time_str, time_fmt).timetuple())) * 1000
+
+
+def search_person_shots(person_shot_id, params):
+    """Person shots nearest to the given one, filtered by the cameras and
+    the time range of params (cam_ids, start_time and end_time, all
+    optional) and ranked by the index.
+
+    Returns:
+        [(person shot key, distance), ...] nearest first, None if the
+        query is not found
+    """
+    query = query_vector(person_shot_id)
+    if query is None:
+        return None
+    load_person_index()
+
+    cam_ids = params.get("cam_ids") or []
+    if not isinstance(cam_ids, list):
+        cam_ids = cam_ids.split(",")   # a form field
+    time_start = epoch_ms(params["start_time"]) \
+        if params.get("start_time") else -2 ** 63
+    time_end = epoch_ms(params["end_time"]) \
+        if params.get("end_time") else 2 ** 63 - 1
+    count = int(params.get("count") or SEARCH_COUNT)
+    found = person_index.search(query, count, cam_ids, time_start, time_end)
+    return [("ps:{}".format(shot_id), distance)
+            for shot_id, cam_id, timestamp, distance in found]
 
 
 # match
@@ -195,6 +484,25 @@ def get_gee_feeds():
     return jsonify(res)
 
 
+@app.route("/api/gee/live/<cam_id>.jpeg")
+def get_gee_live_frame(cam_id):
+    # the writer may come around while encoding, then take the next frame
+    for _ in range(3):
+        live = fetch_live(cam_id)
+        if live is None:
+            abort(404)
+        frame, rects, frame_id = live
+        if len(rects):
+            frame = np.copy(frame)
+            for (x, y, w, h) in rects:
+                cv2.rectangle(frame, (x, y), (x + w, y + h), (0, 255, 255))
+        ok, data = cv2.imencode(".jpeg", frame)
+        if ok and live_rings[cam_id].valid(frame_id):
+            return send_file(io.BytesIO(data.tostring()),
+                             mimetype="image/jpeg")
+    abort(503)
+
+
 @app.route("/api/gee/videoshots/date:<date>")
 def get_gee_video_shots(date):
     targets = fetch_records_list(date)
@@ -215,26 +523,31 @@ def get_gee_video_shot(video_id):
 @app.route("/api/gee/personshots/<vid>/<frame_pos>/")
 def get_gee_person_shots_archive(vid, frame_pos):
     res = {
-        "entrance": "/static/tmp/person-shots/",
+        "entrance": "/api/gee/blobs/" if blob_store is not None
+                    else "/static/tmp/person-shots/",
         "count": 0,
         "targets": []
     }
-    target_frame = fetch_frame(vid, frame_pos)
-    if target_frame is None:
-        abort(404)  # frame not found
-    # save the query frame to debug
     qf_id = "{}{:05d}".format(vid, int(frame_pos))
-    qf_full_path = "{}{}.{}".format("actor/static/tmp/query-frames/",
-                                    qf_id, "jpeg")
-    cv2.imwrite(qf_full_path, target_frame)
-    # return person shots rect
-    person_shots = extract_person_shots(target_frame)
-    for idx, ps in enumerate(person_shots):
-        pst_id = "{}{:05d}{:02d}".format(vid, int(frame_pos), idx)
+    # the persons bako found in the keyframe, cropped from the keyframe it
+    # saved, their ids are those of the saved shots; other frames are
+    # decoded and detected here, with ids alike
+    person_rects = stored_person_rects(qf_id)
+    target_frame = fetch_keyframe(qf_id) if person_rects else None
+    if target_frame is None:
+        target_frame = fetch_frame(vid, frame_pos)
+        if target_frame is None:
+            abort(404)  # frame not found
+        # save the query frame to debug
+        save_jpeg(qf_id, target_frame, "actor/static/tmp/query-frames/")
+    if not person_rects:
+        person_rects = [("{}{:02d}".format(qf_id, idx), rect)
+                        for idx, rect in enumerate(human_detect(target_frame))]
+    for pst_id, (x, y, w, h) in person_rects:
+        ps = target_frame[y:y+h, x:x+w]
         # cache mat for searching next
         filename = "{}.{}".format(pst_id, "jpeg")
-        full_path = "{}{}".format("actor/static/tmp/person-shots/", filename)
-        cv2.imwrite(full_path, ps)
+        save_jpeg(pst_id, ps, "actor/static/tmp/person-shots/")
         target = {
             "filename": filename,
             "id": pst_id,
@@ -263,8 +576,18 @@ def get_gee_person_shots(person_shot_id):
             "count": 0,
             "targets": []
         }
-        person_shot_keys = get_redis().keys("ps:*")
-        for idx, person_shot_key in enumerate(person_shot_keys):
+        # ranked by the index, unranked without RBML
+        if person_index is not None:
+            params = request.get_json(silent=True) or request.form
+            try:
+                found = search_person_shots(person_shot_id, params)
+            except (ValueError, TypeError):
+                abort(400)  # bad filter
+            if found is None:
+                abort(404)  # query not found
+        else:
+            found = [(key, None) for key in get_redis().keys("ps:*")]
+        for idx, (person_shot_key, distance) in enumerate(found):
             person_shot = get_redis().hgetall(person_shot_key)
             try:
                 video_shot_key = "vs:{}{}".format(person_shot["cam_id"],
@@ -277,7 +600,8 @@ def get_gee_person_shots(person_shot_id):
                     "end_time": end_time.strftime(time_fmt)
                 }
                 person_shot_f = {
-                    "id": person_shot_id,
+                    "id": person_shot_key.split(':')[1],
+                    "distance": distance,
                     "rect": person_shot["rect"],
                     "frame": person_shot["frame_id"],
                     "frame_pos": person_shot["frame_pos"],
@@ -299,6 +623,17 @@ def get_gee_person_shots(person_shot_id):
         return jsonify(res)
 
 
+@app.route("/api/gee/tracks/<person_shot_id>")
+def get_gee_track(person_shot_id):
+    res = {
+        "entrance": "/api/gee/personshots/",
+        "count": 0,
+        "targets": track_path(person_shot_id)
+    }
+    res["count"] = len(res["targets"])
+    return jsonify(res)
+
+
 id_pool = [
     {
         "id": "c0a87193201510101420000050100",
@@ -430,8 +765,13 @@ def get_gee_fake_keyframe(keyframe_id):
 
 @app.route("/api/gee/keyframes/<keyframe_id>")
 def get_gee_keyframes(keyframe_id):
-    filename = "{}{}.{}".format("static/keyframes/", keyframe_id, "jpeg")
-    return send_file(filename, mimetype="image/jpeg")
+    # bako packs keyframes into the blob store, there are no files of them
+    return send_blob(keyframe_id)
+
+
+@app.route("/api/gee/blobs/<blob_id>.jpeg")
+def get_gee_blob(blob_id):
+    return send_blob(blob_id)
 
 
 def error_log_file_handler():
@@ -8,8 +8,8 @@ INCLUDEPATH += \
         /usr/include/python2.7 \
 
 
-LIBS += `pkg-config --libs opencv python2` \
-        -L/usr/lib -lpthread \
+LIBS += `pkg-config --libs opencv python2 libavformat libavcodec libavutil libswscale` \
+        -L/usr/lib -lpthread -lrt \
         -L/usr/lib -lboost_system \
 
 SOURCES += \
@@ -27,6 +27,25 @@ SOURCES += \
     src/videostreamhandler.cpp \
     src/galgorithm.cpp \
     src/RBML/getfeature.cpp \
+    src/personindex.cpp \
+    src/tracker.cpp \
+    src/avstream.cpp \
+    src/frameindex.cpp \
+    src/frameseeker.cpp \
+    src/frameserver.cpp \
+    src/packetring.cpp \
+    src/cliprecorder.cpp \
+    src/recordpolicy.cpp \
+    src/segmentfinalizer.cpp \
+    src/sugar/timestamp.cpp \
+    src/shotid.cpp \
+    src/framepool.cpp \
+    src/keyframewriter.cpp \
+    src/blobstore.cpp \
+    src/framering.cpp \
+    src/previewserver.cpp \
+    src/persondetector.cpp \
+    src/RBML/featuremodel.cpp \
     main.cpp
 
 HEADERS += \
@@ -47,7 +66,27 @@ HEADERS += \
     src/memcache.h \
     src/videocacher.h \
     src/galgorithm.h \
-    src/RBML/getfeature.h
+    src/RBML/getfeature.h \
+    src/personindex.h \
+    src/tracker.h \
+    src/avstream.h \
+    src/frameindex.h \
+    src/frameseeker.h \
+    src/frameserver.h \
+    src/sugar/threadpool.h \
+    src/packetring.h \
+    src/cliprecorder.h \
+    src/recordpolicy.h \
+    src/segmentfinalizer.h \
+    src/sugar/timestamp.h \
+    src/shotid.h \
+    src/framepool.h \
+    src/keyframewriter.h \
+    src/blobstore.h \
+    src/framering.h \
+    src/previewserver.h \
+    src/persondetector.h \
+    src/RBML/featuremodel.h
 
 OTHER_FILES += \
     src/RBML/PCA.xml \
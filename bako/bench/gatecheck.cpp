@@ -0,0 +1,78 @@
+//
+// Check of the Tracker's distance gates against a feature model.
+//
+// Draws pairs of random persons from the variances of the PCA, embeds
+// their raw features through the model and measures them with
+// PersonIndex, as the Tracker does. Two random persons must fail the
+// cross-camera link gate, the run fails if more than 1% of the pairs
+// pass it. The within-camera gate is reported too, it is also gated by
+// IoU.
+//
+// Usage: gatecheck [feature model] [pairs]
+//
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+#include "RBML/featuremodel.h"
+#include "personindex.h"
+#include "tracker.h"
+
+using namespace cv;
+using std::string;
+
+// raw feature of a random person, mean + E^T (sqrt(eigenvalues) z)
+static Mat RandomFeature(const PCA &pca, RNG &rng)
+{
+    Mat z(pca.eigenvalues.rows, 1, CV_32FC1);
+    rng.fill(z, RNG::NORMAL, 0, 1);
+    Mat deviation;
+    sqrt(pca.eigenvalues, deviation);
+    Mat y = z.mul(deviation);
+
+    return pca.mean + pca.eigenvectors.t() * y;
+}
+
+int main(int argc, char *argv[])
+{
+    string path = argc > 1 ? argv[1] : "../src/RBML/PCA.xml";
+    int pairs = argc > 2 ? atoi(argv[2]) : 10000;
+
+    FeatureModel model;
+    if (!model.open(path)) {
+        fprintf(stderr, "can not open the feature model %s\n", path.c_str());
+        return 2;
+    }
+    TrackerConfig config(model.get_scale());
+    PersonIndex index(model.get_projection().rows);
+    RNG rng(20151010);
+
+    int linked = 0, tracked = 0;
+    double sum = 0;
+    for (int i = 0; i < pairs; ++i) {
+        Mat x = model.embed(RandomFeature(model.get_pca(), rng));
+        Mat y = model.embed(RandomFeature(model.get_pca(), rng));
+        float distance = index.distance(x, y);
+        sum += distance;
+        if (distance <= config.max_link_distance)
+            linked++;
+        if (distance <= config.max_track_distance)
+            tracked++;
+    }
+
+    fprintf(stdout, "scale %g, mean distance of %d random pairs %g\n",
+            model.get_scale(), pairs, sum / pairs);
+    fprintf(stdout, "link gate %g: %.2f%% pass\n", config.max_link_distance,
+            100.0 * linked / pairs);
+    fprintf(stdout, "track gate %g: %.2f%% pass\n", config.max_track_distance,
+            100.0 * tracked / pairs);
+
+    if (linked * 100 > pairs) {
+        fprintf(stdout, "FAIL: random persons are linked across cameras\n");
+        return 1;
+    }
+    fprintf(stdout, "ok\n");
+
+    return 0;
+}
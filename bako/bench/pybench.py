@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+#
+# Benchmark of the RBML python module from 1 to N python threads.
+#
+# Reports calls/sec of GetFeature.get_feature on a person crop, images/sec
+# of GetFeature.get_features on batches of crops and calls/sec of
+# PersonDetector.detect on a frame, as the actor's threads would make
+# them. Entry points the module lacks are reported as n/a, so builds are
+# compared by running it against each:
+#
+#   PYTHONPATH=<build of RBML.so> python pybench.py
+#
+# Usage: pybench.py [threads] [seconds] [pca file]
+#
+from __future__ import print_function
+
+import sys
+import threading
+import time
+
+import numpy as np
+
+import RBML
+
+BATCH = 16
+
+
+def rate(fn, threads, seconds):
+    """Calls/sec of fn from threads threads, fn returns the work it did."""
+    counts = [0] * threads
+    stop = [False]
+
+    def run(i):
+        while not stop[0]:
+            counts[i] += fn()
+
+    workers = [threading.Thread(target=run, args=(i,))
+               for i in range(threads)]
+    t0 = time.time()
+    for w in workers:
+        w.start()
+    time.sleep(seconds)
+    stop[0] = True
+    for w in workers:
+        w.join()
+
+    return sum(counts) / (time.time() - t0)
+
+
+def main():
+    threads = int(sys.argv[1]) if len(sys.argv) > 1 else 4
+    seconds = float(sys.argv[2]) if len(sys.argv) > 2 else 3
+    pca = sys.argv[3] if len(sys.argv) > 3 else "../src/RBML/PCA.xml"
+
+    rng = np.random.RandomState(0)
+    crop = rng.randint(0, 256, (128, 48, 3)).astype(np.uint8)
+    crops = [crop] * BATCH
+    frame = rng.randint(0, 256, (360, 640, 3)).astype(np.uint8)
+
+    get_feature = RBML.GetFeature(pca)
+    detector = RBML.PersonDetector(pca) \
+        if hasattr(RBML, "PersonDetector") else None
+
+    cases = [("get_feature", lambda: get_feature.get_feature(crop) is not
+              None)]
+    if hasattr(get_feature, "get_features"):
+        cases.append(("get_features/img",
+                      lambda: len(get_feature.get_features(crops))))
+    else:
+        cases.append(("get_features/img", None))
+    if detector is not None:
+        cases.append(("detect", lambda: detector.detect(frame) is not None))
+    else:
+        cases.append(("detect", None))
+
+    print("%s, %.1fs per run" % (RBML.__file__, seconds))
+    print("%8s" % "threads" +
+          "".join("%18s" % name for name, _ in cases))
+    for t in range(1, threads + 1):
+        row = "%8d" % t
+        for _, fn in cases:
+            row += "%18s" % ("n/a" if fn is None else
+                             "%.1f" % rate(fn, t, seconds))
+        print(row)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,124 @@
+//
+// Benchmark of Regularization() and RegularizedInverse().
+//
+// Compares the former full SVD implementation with the symmetric eigen
+// path and with the top-rank path, in time and in relative difference
+// of the regularized matrix, on covariances with a decaying spectrum.
+// Then the top-rank inverse by inv() and in the eigenbasis, with the
+// error bound of averaging the tail.
+//
+// Usage: regbench [rank]
+//
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include <opencv2/opencv.hpp>
+#include "rbml.h"
+
+using namespace cv;
+
+static double NowMs()
+{
+    return std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Regularization() before the eigen solver, kept for reference
+//
+static float Accumulation(Mat m, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum += m.at<float>(i, 0);
+    return sum;
+}
+
+static Mat RegularizationSVD(Mat sigama)
+{
+    SVD svd(sigama, SVD::FULL_UV);
+    Mat s = svd.w.clone();
+
+    int c = 1;
+    for (; c <= s.rows; ++c) {
+        if (Accumulation(s, c) / Accumulation(s, s.rows) > 0.9)
+            break;
+    }
+    float a = s.at<float>(0, 0) * s.at<float>(c - 1, 0) * (c - 1) /
+            (s.at<float>(0, 0) - s.at<float>(c - 1, 0));
+    float b = (c * s.at<float>(c - 1, 0) - s.at<float>(0, 0)) /
+            (s.at<float>(0, 0) - s.at<float>(c - 1, 0));
+    float K = a / (c + b) - pow(a / (b + c), 0.9);
+    for (int i = 1; i <= s.rows; ++i) {
+        if (i <= c)
+            s.at<float>(i - 1, 0) = pow(a / (i + b), 0.9) + K;
+        else
+            s.at<float>(i - 1, 0) = a / (i + b);
+    }
+
+    Mat w = Mat::zeros(s.rows, s.rows, CV_32FC1);
+    for (int i = 0; i < s.rows; ++i)
+        w.at<float>(i, i) = s.at<float>(i, 0);
+    return svd.u * w * svd.vt;
+}
+
+// covariance with eigenvalues decaying as i^-1.5
+//
+static Mat MakeCovariance(int dimension, RNG &rng)
+{
+    Mat x(dimension, dimension, CV_32FC1);
+    rng.fill(x, RNG::NORMAL, 0, 1);
+
+    Mat w, q, vt;
+    SVD::compute(x, w, q, vt);
+    Mat s = Mat::zeros(dimension, dimension, CV_32FC1);
+    for (int i = 0; i < dimension; ++i)
+        s.at<float>(i, i) = 1000.0f / pow(i + 1.0f, 1.5f);
+
+    return q * s * q.t();
+}
+
+int main(int argc, char *argv[])
+{
+    int rank = argc > 1 ? atoi(argv[1]) : 128;
+    const int dimensions[] = { 100, 300, 1152 };
+    RNG rng(20151010);
+
+    fprintf(stdout, "%6s %12s %12s %10s %12s %10s %12s %12s %10s\n",
+            "dim", "svd", "eigen", "diff", "top-rank", "diff", "inv()",
+            "eigenbasis", "bound");
+    for (int d = 0; d < 3; ++d) {
+        Mat sigma = MakeCovariance(dimensions[d], rng);
+
+        double t0 = NowMs();
+        Mat ref = RegularizationSVD(sigma);
+        double t_svd = NowMs() - t0;
+
+        t0 = NowMs();
+        Mat exact = Regularization(sigma);
+        double t_eigen = NowMs() - t0;
+
+        t0 = NowMs();
+        Mat partial = Regularization(sigma, rank);
+        double t_partial = NowMs() - t0;
+
+        t0 = NowMs();
+        Mat dense_inverse = Regularization(sigma, rank).inv();
+        double t_dense = NowMs() - t0;
+
+        double bound;
+        t0 = NowMs();
+        Mat inverse = RegularizedInverse(sigma, rank, &bound);
+        double t_inverse = NowMs() - t0;
+
+        double ref_norm = norm(ref);
+        fprintf(stdout, "%6d %9.1f ms %9.1f ms %10.2e %9.1f ms %10.2e "
+                "%9.1f ms %9.1f ms %10.2e\n",
+                dimensions[d], t_svd, t_eigen, norm(exact, ref) / ref_norm,
+                t_partial, norm(partial, ref) / ref_norm, t_dense,
+                t_inverse, bound);
+    }
+
+    return 0;
+}
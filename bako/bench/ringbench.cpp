@@ -0,0 +1,134 @@
+//
+// Benchmark of FrameRing with 1 to N consumers.
+//
+// One writer publishes frames into the ring, paced at fps or as fast as
+// it can with fps 0, while each consumer takes the newest frame in a
+// loop. Reports the writer's publish cost and rate, and per consumer
+// count the frames read and skipped, the seqlock retries and the
+// publish-to-read latency.
+//
+// Usage: ringbench [consumers] [frames] [width] [height] [fps]
+//
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "framering.h"
+
+using std::vector;
+
+static const char *kRingName = "/gee-ringbench";
+
+struct ConsumerStats {
+    ConsumerStats() : read(0), skipped(0), retries(0) {}
+
+    uint64_t read, skipped, retries;
+    vector<int64_t> latency_ns;
+};
+
+static void Consume(const std::atomic<bool> &done, ConsumerStats &stats)
+{
+    FrameRingReader reader;
+    while (!reader.open(kRingName))
+        std::this_thread::yield();
+
+    cv::Mat frame;
+    FrameRingInfo info;
+    while (1) {
+        if (reader.next(frame, info, 100)) {
+            stats.latency_ns.push_back(SteadyNs() - info.published);
+            continue;
+        }
+        if (done)
+            break;
+    }
+    stats.read = reader.get_read();
+    stats.skipped = reader.get_skipped();
+    stats.retries = reader.get_retries();
+}
+
+static double Percentile(vector<int64_t> &v, const double p)
+{
+    if (v.empty())
+        return 0;
+    size_t i = std::min(v.size() - 1, (size_t)(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+
+    return v[i] / 1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    int consumers = argc > 1 ? atoi(argv[1]) : 4;
+    int frames = argc > 2 ? atoi(argv[2]) : 2000;
+    int width = argc > 3 ? atoi(argv[3]) : 1280;
+    int height = argc > 4 ? atoi(argv[4]) : 720;
+    double fps = argc > 5 ? atof(argv[5]) : 0;
+
+    cv::Mat frame(height, width, CV_8UC3);
+    frame.setTo(cv::Scalar(16, 128, 240));
+
+    printf("%dx%d, %d frames, fps %s\n", width, height, frames,
+           fps > 0 ? argv[5] : "max");
+    printf("%9s %12s %12s %10s %10s %8s %10s %10s %10s\n", "consumers",
+           "publish(us)", "frames/s", "read", "skipped", "retries",
+           "p50(us)", "p99(us)", "max(us)");
+
+    for (int c = 1; c <= consumers; ++c) {
+        FrameRing ring(kRingName);
+        // makes the segment for the consumers to open
+        ring.publish(frame, 0, 0);
+
+        std::atomic<bool> done(false);
+        vector<ConsumerStats> stats(c);
+        vector<std::thread> threads;
+        for (int i = 0; i < c; ++i)
+            threads.push_back(std::thread(Consume, std::cref(done),
+                                          std::ref(stats[i])));
+        // let them open it
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        int64_t period = fps > 0 ? (int64_t)(1e9 / fps) : 0;
+        int64_t publish_ns = 0;
+        int64_t t0 = SteadyNs();
+        for (int f = 1; f <= frames; ++f) {
+            if (period > 0)
+                while (SteadyNs() < t0 + f * period)
+                    std::this_thread::yield();
+            int64_t p0 = SteadyNs();
+            ring.publish(frame, 0, f);
+            publish_ns += SteadyNs() - p0;
+        }
+        double elapsed_s = (SteadyNs() - t0) / 1e9;
+
+        done = true;
+        for (int i = 0; i < c; ++i)
+            threads[i].join();
+
+        uint64_t read = 0, skipped = 0, retries = 0;
+        vector<int64_t> latency_ns;
+        for (int i = 0; i < c; ++i) {
+            read += stats[i].read;
+            skipped += stats[i].skipped;
+            retries += stats[i].retries;
+            latency_ns.insert(latency_ns.end(), stats[i].latency_ns.begin(),
+                              stats[i].latency_ns.end());
+        }
+        double max_us = latency_ns.empty() ? 0 :
+                *std::max_element(latency_ns.begin(), latency_ns.end()) /
+                1000.0;
+        printf("%9d %12.1f %12.0f %10llu %10llu %8llu %10.1f %10.1f %10.1f\n",
+               c, publish_ns / 1000.0 / frames, frames / elapsed_s,
+               (unsigned long long)read / c, (unsigned long long)skipped / c,
+               (unsigned long long)retries, Percentile(latency_ns, 0.5),
+               Percentile(latency_ns, 0.99), max_us);
+    }
+
+    return 0;
+}
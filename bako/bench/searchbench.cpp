@@ -0,0 +1,110 @@
+//
+// Benchmark of PersonIndex on multi-query workloads.
+//
+// Compares K single-query searches against one batched search of the
+// K crops, for each aggregation, with and without a camera/time filter.
+//
+// Usage: searchbench [rows] [rounds]
+//
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "personindex.h"
+#include "gdatatype.h"
+
+using namespace cv;
+using std::string;
+using std::vector;
+
+static double NowMs()
+{
+    return std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char *argv[])
+{
+    const int kDimension = 100;
+    const int kCameras = 8;
+    const int64_t kDayMs = 24 * 3600000LL;
+
+    size_t rows = argc > 1 ? atol(argv[1]) : 200000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    PersonIndex index(kDimension);
+    RNG rng(20151010);
+
+    // metric of the real model when present
+    FileStorage fs_m("M.xml", FileStorage::READ);
+    if (fs_m.isOpened()) {
+        Mat metric;
+        fs_m["M"] >> metric;
+        index.set_metric(metric);
+    }
+
+    double t0 = NowMs();
+    Mat x(kDimension, 1, CV_32FC1);
+    vector<int> rect(4, 0);
+    for (size_t i = 0; i < rows; ++i) {
+        rng.fill(x, RNG::NORMAL, 0, 1);
+        CameraId cam_id(0xc0a87100 + (uint32_t)(i % kCameras));
+        int64_t timestamp = (int64_t)(i * (kDayMs / rows));
+        FrameId frame_id(VideoId(cam_id, 0), i);
+        PersonShot person_shot(PersonShotId(frame_id, i % 100),
+                               timestamp, rect, x.clone());
+        index.insert(person_shot);
+    }
+    fprintf(stdout, "insert %zu rows: %.1f ms\n", rows, NowMs() - t0);
+
+    SearchFilter all, filtered;
+    filtered.cam_ids.insert(CameraId(0xc0a87103));
+    filtered.cam_ids.insert(CameraId(0xc0a87104));
+    filtered.time_start = 14 * 3600000LL;
+    filtered.time_end = 15 * 3600000LL;
+
+    const SearchFilter *filters[] = { &all, &filtered };
+    const char *filter_names[] = { "all", "cam 3-4, 1h" };
+    const Aggregation aggregations[] = {
+        kAggregateMin, kAggregateMean, kAggregateReciprocal
+    };
+    const char *aggregation_names[] = { "min", "mean", "k-reciprocal" };
+    const int queries_per_person[] = { 1, 2, 4, 8 };
+    const size_t k = 20;
+
+    fprintf(stdout, "\n%-12s %-13s %3s %12s %12s %8s\n",
+            "filter", "aggregation", "K", "K x single", "batched", "speedup");
+    for (int f = 0; f < 2; ++f) {
+        for (int a = 0; a < 3; ++a) {
+            for (int q = 0; q < 4; ++q) {
+                int n_queries = queries_per_person[q];
+                Mat queries(kDimension, n_queries, CV_32FC1);
+                rng.fill(queries, RNG::NORMAL, 0, 1);
+
+                double single = 0, batched = 0;
+                for (int r = 0; r < rounds; ++r) {
+                    t0 = NowMs();
+                    for (int j = 0; j < n_queries; ++j)
+                        index.search(queries.col(j).clone(), k, *filters[f]);
+                    single += NowMs() - t0;
+
+                    t0 = NowMs();
+                    index.search(queries, k, *filters[f], aggregations[a]);
+                    batched += NowMs() - t0;
+                }
+                single /= rounds;
+                batched /= rounds;
+
+                fprintf(stdout, "%-12s %-13s %3d %9.3f ms %9.3f ms %7.2fx\n",
+                        filter_names[f], aggregation_names[a], n_queries,
+                        single, batched, single / batched);
+            }
+        }
+    }
+
+    return 0;
+}
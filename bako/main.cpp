@@ -1,12 +1,14 @@
 // *nix
 #include <unistd.h>
 
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
 #include "src/sugar/sugar.h"
+#include "src/previewserver.h"
 #include "src/videostreamhandler.h"
 #include "src/gdatatype.h"
 #include "src/sugar/gdebug.h"
@@ -24,7 +26,7 @@ int main(int argc, char *argv[])
 
     // Test();
 
-    if (argc != 2) {
+    if (argc < 2 || argc > 5) {
         // comment
         char buf[1024];
         sprintf(buf, "Simple entrance to experience and test.");
@@ -32,16 +34,47 @@ int main(int argc, char *argv[])
         sprintf(buf, "%s Keyframes and videos will be saved into /tmp/gee.\n", buf);
         fprintf(stdout, "%s\n", buf);
         // usage
-        fprintf(stdout, "\nUsage: %s {input_video_file}\n\n", argv[0]);
+        fprintf(stdout, "\nUsage: %s {input_video_file} [gate_mode]"
+                        " [analytics] [preview_port]\n", argv[0]);
+        fprintf(stdout, "\ngate_mode: continuous (default), motion, person"
+                        " or timelapse\n");
+        fprintf(stdout, "analytics: fps to analyse at, 0 for every frame"
+                        " (default), or key for keyframes only\n");
+        fprintf(stdout, "preview_port: serve MJPEG previews of the cameras"
+                        " at /preview/{camera_id}\n\n");
         exit(0);
     }
 
+    GateMode gate_mode = kGateContinuous;
+    if (argc >= 3 && !ParseGateMode(argv[2], gate_mode)) {
+        LogError("Unknown gate mode.");
+        exit(1);
+    }
+
+    // frames not analysed are not decoded, unless others refer to them
+    AnalyticsConfig analytics;
+    if (argc >= 4) {
+        if (string(argv[3]) == "key") {
+            analytics.decode_skip = kDecodeKeyframes;
+        } else {
+            analytics.fps = atof(argv[3]);
+            if (analytics.fps > 0)
+                analytics.decode_skip = kDecodeReference;
+        }
+    }
+
+    // live preview of the frames VideoForwarder publishes
+    PreviewServer preview_server(argc == 5 ? atoi(argv[4]) : 0);
+    if (argc == 5 && !preview_server.start())
+        exit(1);
+
     char buf[1024];
     // system call
     getcwd(buf, 1024);
     sprintf(buf, "%s%s%s", buf, "/", argv[1]);
     IPCamera fake_ip_camera("192.168.113.147", "SEC 113");
-    VideoStreamHandler(buf, fake_ip_camera);
+    VideoStreamHandler(buf, fake_ip_camera, kRecordStreamCopy, gate_mode,
+                       analytics);
 
     exit(0);
 }
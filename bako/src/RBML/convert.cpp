@@ -0,0 +1,69 @@
+//
+// rbml_convert: write the binary feature model of PCA.xml and M.xml.
+//
+// GetFeature and the person index load feature.model in milliseconds
+// where parsing the XML took seconds, see featuremodel.h. M.xml is
+// optional, the model has no metric without it.
+//
+// Usage: rbml_convert {PCA.xml} [M.xml] [feature.model]
+//
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+#include "featuremodel.h"
+
+using namespace cv;
+using std::string;
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stdout, "\nUsage: %s {PCA.xml} [M.xml] [feature.model]\n\n",
+                argv[0]);
+        exit(0);
+    }
+
+    string m_path = argc > 2 ? argv[2] : "";
+    string model_path = argc > 3 ? argv[3] : kFeatureModelFile;
+
+    PCA pca;
+    FileStorage fs_pca(argv[1], FileStorage::READ);
+    fs_pca["mean"] >> pca.mean;
+    fs_pca["eigenvalues"] >> pca.eigenvalues;
+    fs_pca["eigenvectors"] >> pca.eigenvectors;
+    fs_pca.release();
+    if (pca.eigenvectors.empty()) {
+        fprintf(stderr, "ERROR - %s has no PCA\n", argv[1]);
+        exit(1);
+    }
+
+    Mat metric;
+    if (!m_path.empty()) {
+        FileStorage fs_m(m_path, FileStorage::READ);
+        fs_m["M"] >> metric;
+        fs_m.release();
+        if (metric.empty()) {
+            fprintf(stderr, "ERROR - %s has no M\n", m_path.c_str());
+            exit(1);
+        }
+    }
+
+    if (!WriteFeatureModel(model_path, pca, metric)) {
+        fprintf(stderr, "ERROR - fail to write %s\n", model_path.c_str());
+        exit(1);
+    }
+
+    // check it as the loaders will
+    FeatureModel model;
+    if (!model.open(model_path) || !model.is_mapped()) {
+        fprintf(stderr, "ERROR - %s does not load\n", model_path.c_str());
+        exit(1);
+    }
+    fprintf(stdout, "INFO - model - %s, %d x %d%s\n", model_path.c_str(),
+            pca.eigenvectors.rows, pca.eigenvectors.cols,
+            metric.empty() ? "" : ", with M");
+
+    return 0;
+}
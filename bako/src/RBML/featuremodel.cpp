@@ -0,0 +1,336 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "featuremodel.h"
+#include "../sugar/sugar.h"
+
+using namespace cv;
+using std::string;
+
+static const uint32_t kFeatureModelVersion = 1;
+
+static size_t Align(const size_t n)
+{
+    return (n + 63) / 64 * 64;
+}
+
+// offsets of mean, eigenvalues, eigenvectors and metric, and the size
+static size_t Layout(const size_t input_dims, const size_t dims,
+                     const bool metric, size_t offsets[4])
+{
+    offsets[0] = Align(sizeof(FeatureModelHeader));
+    offsets[1] = Align(offsets[0] + input_dims * sizeof(float));
+    offsets[2] = Align(offsets[1] + dims * sizeof(float));
+    offsets[3] = Align(offsets[2] + dims * input_dims * sizeof(float));
+
+    return metric ? offsets[3] + dims * dims * sizeof(float) : offsets[3];
+}
+
+static uint64_t Checksum(const uchar *data, const size_t size)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+FeatureModel::FeatureModel()
+{
+    mapping_ = NULL;
+    size_ = 0;
+    scale_ = 0;
+}
+
+FeatureModel::~FeatureModel()
+{
+    close();
+}
+
+bool FeatureModel::open(const string &path)
+{
+    close();
+
+    char magic[4] = {0};
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL)
+        return false;
+    size_t n = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+
+    if (n == sizeof(magic) && memcmp(magic, "GFMD", 4) == 0)
+        return map(path);
+
+    return parse(path);
+}
+
+void FeatureModel::close()
+{
+    pca_ = PCA();
+    metric_.release();
+    root_.release();
+    projection_.release();
+    bias_.release();
+    scale_ = 0;
+    if (mapping_ != NULL) {
+        munmap(mapping_, size_);
+        mapping_ = NULL;
+        size_ = 0;
+    }
+}
+
+bool FeatureModel::map(const string &path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+            (size_t)st.st_size >= sizeof(FeatureModelHeader))
+        addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    const FeatureModelHeader *header = (const FeatureModelHeader *)addr;
+    size_t offsets[4];
+    size_t size = st.st_size;
+    bool ok = header->version == kFeatureModelVersion &&
+              header->input_dims > 0 && header->dims > 0 &&
+              header->size == size &&
+              Layout(header->input_dims, header->dims, header->metric != 0,
+                     offsets) == size;
+    if (!ok) {
+        LogError("Feature model has a bad header.");
+        munmap(addr, size);
+        return false;
+    }
+    const uchar *base = (const uchar *)addr;
+    if (Checksum(base + sizeof(FeatureModelHeader),
+                 size - sizeof(FeatureModelHeader)) != header->checksum) {
+        LogError("Feature model fails its checksum.");
+        munmap(addr, size);
+        return false;
+    }
+
+    mapping_ = addr;
+    size_ = size;
+
+    // headers over the mapping, nothing is copied
+    int input_dims = header->input_dims, dims = header->dims;
+    pca_.mean = Mat(input_dims, 1, CV_32FC1, (void *)(base + offsets[0]));
+    pca_.eigenvalues = Mat(dims, 1, CV_32FC1, (void *)(base + offsets[1]));
+    pca_.eigenvectors = Mat(dims, input_dims, CV_32FC1,
+                            (void *)(base + offsets[2]));
+    if (header->metric)
+        metric_ = Mat(dims, dims, CV_32FC1, (void *)(base + offsets[3]));
+    fuse();
+
+    return true;
+}
+
+bool FeatureModel::parse(const string &path)
+{
+    PCA pca;
+    try {
+        FileStorage fs_pca(path, FileStorage::READ);
+        fs_pca["mean"] >> pca.mean;
+        fs_pca["eigenvalues"] >> pca.eigenvalues;
+        fs_pca["eigenvectors"] >> pca.eigenvectors;
+    } catch (const cv::Exception &) {
+        // not a FileStorage
+        pca = PCA();
+    }
+    if (pca.eigenvectors.empty() ||
+            pca.mean.total() != (size_t)pca.eigenvectors.cols) {
+        LogError("Feature model has no PCA.");
+        return false;
+    }
+
+    // the metric is next to the PCA
+    string dir = path.substr(0, path.find_last_of('/') + 1);
+    Mat metric;
+    try {
+        FileStorage fs_m(dir + "M.xml", FileStorage::READ);
+        if (fs_m.isOpened())
+            fs_m["M"] >> metric;
+    } catch (const cv::Exception &) {
+        metric.release();
+    }
+    if (!metric.empty() && (metric.rows != pca.eigenvectors.rows ||
+                            metric.cols != pca.eigenvectors.rows)) {
+        LogError("Metric does not fit the PCA, ignored.");
+        metric.release();
+    }
+
+    pca.mean.convertTo(pca_.mean, CV_32FC1);
+    pca_.mean = pca_.mean.reshape(1, (int)pca_.mean.total());
+    pca.eigenvalues.convertTo(pca_.eigenvalues, CV_32FC1);
+    pca.eigenvectors.convertTo(pca_.eigenvectors, CV_32FC1);
+    if (!metric.empty())
+        metric.convertTo(metric_, CV_32FC1);
+    fuse();
+
+    return true;
+}
+
+void FeatureModel::fuse()
+{
+    int dims = pca_.eigenvectors.rows;
+    Mat l;
+    if (metric_.empty()) {
+        l = Mat::eye(dims, dims, CV_64FC1);
+    } else {
+        // M is symmetric in theory, make it exact for the decomposition.
+        // Its entries are tiny, so in double.
+        Mat m, values;
+        metric_.convertTo(m, CV_64FC1);
+        m = (m + m.t()) * 0.5;
+        // eigenvectors as rows, M = V^T D V
+        eigen(m, values, l);
+        for (int i = 0; i < dims; i++) {
+            Mat row = l.row(i);
+            row *= std::sqrt(std::max(values.at<double>(i), 0.0));
+        }
+    }
+
+    Mat eigenvectors;
+    pca_.eigenvectors.convertTo(eigenvectors, CV_64FC1);
+    Mat projection = l * eigenvectors;
+    Mat mean;
+    pca_.mean.convertTo(mean, CV_64FC1);
+    Mat bias = -(projection * mean);
+
+    // 2 sum_j eigenvalue_j |L e_j|^2, e_j the columns of L
+    Mat eigenvalues, column_norms;
+    pca_.eigenvalues.reshape(1, 1).convertTo(eigenvalues, CV_64FC1);
+    reduce(l.mul(l), column_norms, 0, CV_REDUCE_SUM);
+    scale_ = 2 * std::max(eigenvalues.dot(column_norms), 0.0);
+
+    l.convertTo(root_, CV_32FC1);
+    projection.convertTo(projection_, CV_32FC1);
+    bias.convertTo(bias_, CV_32FC1);
+}
+
+Mat FeatureModel::embed(const Mat &feature) const
+{
+    Mat x;
+    feature.reshape(1, (int)feature.total()).convertTo(x, CV_32FC1);
+
+    // one GEMV, the mean is folded into the bias
+    Mat embedding;
+    gemm(projection_, x, 1, bias_, 1, embedding);
+
+    return embedding;
+}
+
+Mat FeatureModel::migrate(const Mat &projected) const
+{
+    Mat y;
+    projected.reshape(1, (int)projected.total()).convertTo(y, CV_32FC1);
+
+    return root_ * y;
+}
+
+bool WriteFeatureModel(const string &path, const PCA &pca,
+                       const Mat &metric)
+{
+    int input_dims = pca.eigenvectors.cols, dims = pca.eigenvectors.rows;
+    if (dims == 0 || pca.mean.total() != (size_t)input_dims ||
+            pca.eigenvalues.total() != (size_t)dims ||
+            (!metric.empty() && (metric.rows != dims || metric.cols != dims)))
+        return false;
+
+    size_t offsets[4];
+    size_t size = Layout(input_dims, dims, !metric.empty(), offsets);
+    std::vector<uchar> file(size, 0);
+
+    // each as float32, continuous
+    const Mat *sections[] = {&pca.mean, &pca.eigenvalues, &pca.eigenvectors,
+                             &metric};
+    for (int i = 0; i < 4; i++) {
+        if (sections[i]->empty())
+            continue;
+        Mat section;
+        sections[i]->convertTo(section, CV_32FC1);
+        memcpy(&file[offsets[i]], section.data,
+               section.total() * sizeof(float));
+    }
+
+    FeatureModelHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "GFMD", 4);
+    header.version = kFeatureModelVersion;
+    header.input_dims = input_dims;
+    header.dims = dims;
+    header.metric = metric.empty() ? 0 : 1;
+    header.size = size;
+    header.checksum = Checksum(&file[sizeof(header)], size - sizeof(header));
+    memcpy(&file[0], &header, sizeof(header));
+
+    string tmp_path = path + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == NULL)
+        return false;
+    bool ok = fwrite(&file[0], 1, size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<const FeatureModel> SharedFeatureModel(const string &path)
+{
+    static std::mutex mutex;
+    static std::map<string, std::shared_ptr<const FeatureModel> > models;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = models.find(path);
+    if (it != models.end())
+        return it->second;
+
+    std::shared_ptr<FeatureModel> model(new FeatureModel());
+    // tried again next time if it failed
+    if (model->open(path))
+        models[path] = model;
+
+    return model;
+}
+
+std::shared_ptr<const FeatureModel> DefaultFeatureModel()
+{
+    std::shared_ptr<const FeatureModel> model(
+            SharedFeatureModel(kFeatureModelFile));
+    if (model->is_open())
+        return model;
+
+    model = SharedFeatureModel("PCA.xml");
+    if (model->is_open())
+        LogInfo("Feature model", "parsed PCA.xml, convert it with "
+                "rbml_convert to load it faster");
+    else
+        LogError("No feature model, neither feature.model nor PCA.xml.");
+
+    return model;
+}
@@ -0,0 +1,132 @@
+//
+// FeatureModel: the PCA of the person features and the RBML metric M,
+// from a binary model file mapped read-only.
+//
+// Parsing PCA.xml, 1152 x 100 eigenvectors in ASCII, took seconds for
+// every GetFeature. A model file holds the same floats as they are in
+// memory, so opening it maps the file and checks it, and the pages are
+// shared by every instance and every process using the model.
+//
+// Layout, native endian, float32 row-major, sections 64-byte aligned:
+//  FeatureModelHeader
+//  mean            input_dims x 1
+//  eigenvalues     dims x 1
+//  eigenvectors    dims x input_dims
+//  metric          dims x dims, if the header says so
+// The checksum is FNV-1a over everything after the header.
+//
+// rbml_convert writes one from PCA.xml and M.xml. open() still parses
+// PCA.xml when given one, slowly.
+//
+// On open the PCA and the metric are fused into one affine map. With
+// M = L^T L, L = sqrt(max(D, 0)) V from the eigen decomposition
+// M = V^T D V, negative eigenvalues clipped so that M is a metric:
+//
+//  (y1 - y2)^T M (y1 - y2) = |L y1 - L y2|^2, y = E (x - mean)
+//  embed(x) = L E x - L E mean = W x + b
+//
+// A raw 1152-d histogram takes one GEMV to its embedding, in which the
+// distance of the metric is plain L2. Without a metric L is identity
+// and the embedding is the PCA projection.
+//
+// The entries of M are tiny, so are the distances. get_scale() is the
+// squared distance expected between two random persons, from the
+// variances of the PCA: E|L y1 - L y2|^2 = 2 sum_j eigenvalue_j |L e_j|^2.
+// It is in the units of PersonIndex, which ranks by squared L2, and
+// thresholds on distances (the Tracker's) are fractions of it.
+//
+// Vectors saved before the fusion, under psm: in redis, are PCA
+// projections y. migrate() takes them to L y, the embedding of the same
+// feature; PersonShots saved since are marked with kEmbeddingSpace.
+//
+#ifndef FEATUREMODEL_H
+#define FEATUREMODEL_H
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+static const char kFeatureModelFile[] = "feature.model";
+// vector_space of the PersonShots in redis whose vectors are embeddings,
+// those without are PCA projections, see migrate()
+static const char kEmbeddingSpace[] = "embedding";
+
+struct FeatureModelHeader {
+    char magic[4];              // "GFMD"
+    uint32_t version;
+    uint32_t input_dims;        // of a raw feature, 1152
+    uint32_t dims;              // after PCA, 100
+    uint32_t metric;            // 1 with the metric
+    uint32_t reserved;
+    uint64_t size;              // bytes of the file
+    uint64_t checksum;
+};
+
+class FeatureModel {
+public:
+    FeatureModel();
+    // unmaps
+    ~FeatureModel();
+
+    // a model file, or PCA.xml with M.xml next to it as the metric,
+    // false if it is neither or is corrupted
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const { return !pca_.eigenvectors.empty(); }
+    // from a model file rather than parsed
+    bool is_mapped() const { return mapping_ != NULL; }
+
+    // data as columns, the matrices of a mapped model are read-only
+    const cv::PCA &get_pca() const { return pca_; }
+    // dims x dims, empty without a metric
+    const cv::Mat &get_metric() const { return metric_; }
+    // W = L E, dims x input_dims, and b = -W mean, dims x 1
+    const cv::Mat &get_projection() const { return projection_; }
+    const cv::Mat &get_bias() const { return bias_; }
+
+    // mean squared distance of the embeddings of two random persons
+    double get_scale() const { return scale_; }
+
+    // dims x 1 CV_32FC1 embedding of a raw feature of input_dims
+    cv::Mat embed(const cv::Mat &feature) const;
+    // embedding of a feature from its PCA projection of dims, L y
+    cv::Mat migrate(const cv::Mat &projected) const;
+
+private:
+    FeatureModel(const FeatureModel &);
+    FeatureModel &operator=(const FeatureModel &);
+
+    bool map(const std::string &path);
+    bool parse(const std::string &path);
+    // root_, projection_, bias_ and scale_ of pca_ and metric_
+    void fuse();
+
+    cv::PCA pca_;
+    cv::Mat metric_;
+    cv::Mat root_;                  // L, dims x dims
+    cv::Mat projection_, bias_;     // CV_32FC1
+    double scale_;
+    void *mapping_;
+    size_t size_;
+};
+
+// Write the model file of pca, data as columns, and metric, which may be
+// empty. The file is replaced at once, mappings of the old one stay.
+//
+bool WriteFeatureModel(const std::string &path, const cv::PCA &pca,
+                       const cv::Mat &metric);
+
+// One model per path for the process, every user shares its mapping. It
+// is not open if loading failed.
+//
+std::shared_ptr<const FeatureModel> SharedFeatureModel(
+        const std::string &path);
+
+// kFeatureModelFile in the working directory, or PCA.xml and M.xml there
+// when there is none.
+//
+std::shared_ptr<const FeatureModel> DefaultFeatureModel();
+
+#endif // FEATUREMODEL_H
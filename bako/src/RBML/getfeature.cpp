@@ -2,13 +2,8 @@
 #include "getfeature.h"
 
 GetFeature::GetFeature() {
-	//初始化pca
-    FileStorage fs_pca("PCA.xml",
-                       FileStorage::READ);
-	fs_pca["mean"] >> pca.mean;
-	fs_pca["eigenvalues"] >> pca.eigenvalues;
-	fs_pca["eigenvectors"] >> pca.eigenvectors;
-	fs_pca.release();
+	//初始化pca, shared with every other instance
+	model = DefaultFeatureModel();
 }
 
 /************************************************************************
@@ -214,7 +209,8 @@ void GetFeature::cpyMat(Mat src, Mat dst, int& num)const {
 *返回：PCA降维后结果
 **************************************************************************/
 Mat GetFeature::doPCA(Mat feature)const {
-	return pca.project(feature);
+	// PCA and the metric fused, see FeatureModel
+	return model->embed(feature);
 }
 
 /************************************************************************
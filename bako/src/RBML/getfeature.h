@@ -12,13 +12,17 @@
 #ifndef GETFEATURE_H
 #define GETFEATURE_H
 
+#include <memory>
+
 #include <opencv2/opencv.hpp>
+#include "featuremodel.h"
 
 using namespace cv;
 
 class GetFeature {
 private:
-	PCA pca;	//use to PCA
+	//use to PCA and the metric
+	std::shared_ptr<const FeatureModel> model;
 
 private:
 	// create mask to divided the person image into six horizontal stripes.
@@ -33,10 +37,11 @@ private:
 	//copy src to dst
 	void cpyMat(Mat src, Mat dst, int& num)const;
 
-	//do PCA 
+	//do PCA, to the embedding of the model
 	Mat doPCA(Mat feature)const;
 
 public:
+	// the default model, see DefaultFeatureModel()
 	GetFeature();
 	~GetFeature(){}
 
@@ -1,64 +1,180 @@
 #include "rbml.h"
+#include "rbmltrainer.h"
 
 
 Mat doRBML(Mat train_a, Mat train_b) {
-	//分别计算正负样本的协方差矩阵∑1和∑0
-	Mat sigma1 = Mat::zeros(train_a.rows, train_a.rows, CV_32FC1);
-	Mat sigma0 = Mat::zeros(train_a.rows, train_a.rows, CV_32FC1);
+	//正负样本的协方差矩阵∑1和∑0由闭式求和得到，见rbmltrainer.h
+	RBMLTrainer trainer(train_a.rows);
+	trainer.add(train_a, train_b);
 
-	for (int i = 0; i < train_a.cols; ++i) {
-		sigma1 += (train_a.col(i) - train_b.col(i))*(train_a.col(i) - train_b.col(i)).t();
+	return trainer.solve();
+}
+
+//正则化后的特征值谱：前c个按0.9次幂压缩，之后按a/(i+b)衰减
+struct RegularizedSpectrum {
+	float a, b, K;
+	int c;
+
+	//s：降序特征值(前c个即可)
+	RegularizedSpectrum(const Mat &s, int c_) {
+		c = c_;
+		float s1 = s.at<float>(0, 0), sc = s.at<float>(c - 1, 0);
+		a = s1*sc*(c - 1) / (s1 - sc);
+		b = (c*sc - s1) / (s1 - sc);
+		K = a / (c + b) - pow(a / (b + c), 0.9);
 	}
-	for (int i = 0; i < train_a.cols; ++i) {
-		for (int j = 0; j < train_b.cols; ++j) {
-			if (i != j) {
-				sigma0+= (train_a.col(i) - train_b.col(j))*(train_a.col(i) - train_b.col(j)).t();
-			}
+
+	//第i个(从1开始)正则化特征值
+	float operator()(int i) const {
+		if (i <= c)
+			return pow(a / (i + b), 0.9) + K;
+		return a / (i + b);
+	}
+};
+
+//求90%能量的参数c，前缀和只遍历一次。s中不足c个特征值时返回0
+static int EnergyIndex(const Mat &s, double total) {
+	double prefix = 0;
+	for (int c = 1; c <= s.rows; ++c) {
+		prefix += s.at<float>(c - 1, 0);
+		if (prefix / total > 0.9) {
+			return c;
 		}
 	}
+	return 0;
+}
 
-	//cout << sigma1 << endl;
-	//cout << sigma0 << endl;
+//U^T*diag(s)*U，U的每行为一个特征向量；按行缩放后做一次GEMM
+static Mat Reconstruct(const Mat &u, const Mat &s) {
+	Mat scaled = u.clone();
+	for (int i = 0; i < u.rows; ++i) {
+		scaled.row(i) *= s.at<float>(i, 0);
+	}
+	Mat rv;
+	gemm(u, scaled, 1, noArray(), 0, rv, GEMM_1_T);
+	return rv;
+}
 
-	Mat regSigma1 = Regularization(sigma1);
-	Mat regSigma0 = Regularization(sigma0);
+//子空间迭代求前rank个特征对，u每行一个特征向量
+static void TopEigen(const Mat &sigama, int rank, Mat &s, Mat &u) {
+	const int kIterations = 50;
+	const double kEpsilon = 1e-6;
 
-	return regSigma1.inv() - regSigma0.inv();
-}
+	Mat a;
+	sigama.convertTo(a, CV_64FC1);
 
-float accumulation(Mat m, int n) {
-	float sum = 0;
-	for (int i = 0; i < n; ++i) {
-		sum += m.at<float>(i, 0);
+	Mat q(a.rows, rank, CV_64FC1);
+	randn(q, 0, 1);
+	Mat values, vectors, prev;
+	for (int it = 0; it < kIterations; ++it) {
+		//正交化：A*Q的QR分解取Q (修正Gram-Schmidt)
+		q = a*q;
+		for (int j = 0; j < rank; ++j) {
+			Mat qj = q.col(j);
+			for (int k = 0; k < j; ++k) {
+				qj -= q.col(k).dot(qj)*q.col(k);
+			}
+			double n = norm(qj);
+			if (n > 0) qj /= n;
+		}
+		//Rayleigh-Ritz
+		Mat t = q.t()*a*q;
+		eigen(t, values, vectors);
+		if (!prev.empty() && norm(values, prev, NORM_L2) <= kEpsilon*norm(values)) {
+			break;
+		}
+		prev = values.clone();
 	}
-	return sum;
+
+	Mat u64 = vectors*q.t();
+	values.convertTo(s, CV_32FC1);
+	u64.convertTo(u, CV_32FC1);
 }
 
-Mat Regularization(Mat sigama) {
-	SVD svd(sigama, SVD::FULL_UV);
-	Mat s = svd.w.clone();
+//正则化后的特征对：s为前k个正则化特征值(降序)，u每行一个特征向量。
+//max_rank>0时k=max_rank，其余特征值以均值tail近似，作用于u的正交补空间；
+//完整分解时k为维数，tail为0。
+//tail_error：以均值近似尾部特征值给逆矩阵带来的相对误差(谱范数)，即
+//||Δ||/||Σ^-1||。完整正则化的尾部特征值λ_{r+1}..λ_d单调递减，逆在补空间上
+//由diag(1/λ_i)变为I/tail，故
+//  ||Δ|| = max(1/λ_d - 1/tail, 1/tail - 1/λ_{r+1})，||Σ^-1|| = 1/λ_d
+//不含子空间迭代本身的收敛误差(kEpsilon)
+static void RegularizedEigen(const Mat &sigama, int max_rank, Mat &s, Mat &u,
+		float &tail, double *tail_error) {
+	tail = 0;
+	if (tail_error) *tail_error = 0;
 
-	//求90%能量的参数c
-	int c = 1;
-	for (; c <= s.rows; ++c) {
-		if (accumulation(s, c) / accumulation(s,s.rows)>0.9) {
-			break;
+	if (max_rank > 0 && max_rank + 10 < sigama.rows) {
+		//迹即全部特征值之和，前max_rank个特征值足以确定c
+		double total = trace(sigama)[0];
+		const int oversample = 10;
+		TopEigen(sigama, max_rank + oversample, s, u);
+		s = s.rowRange(0, max_rank).clone();
+		u = u.rowRange(0, max_rank).clone();
+
+		int c = EnergyIndex(s, total);
+		if (c > 0) {
+			RegularizedSpectrum spectrum(s, c);
+			for (int i = 1; i <= max_rank; ++i) {
+				s.at<float>(i - 1, 0) = spectrum(i);
+			}
+
+			double sum_tail = 0;
+			for (int i = max_rank + 1; i <= sigama.rows; ++i) {
+				sum_tail += spectrum(i);
+			}
+			tail = (float)(sum_tail / (sigama.rows - max_rank));
+
+			if (tail_error) {
+				double first = spectrum(max_rank + 1), last = spectrum(sigama.rows);
+				*tail_error = max(1 - last / tail, last / tail - last / first);
+			}
+			return;
 		}
+		//90%能量超出max_rank，退回完整分解
 	}
-	float a = s.at<float>(0, 0)*s.at<float>(c - 1, 0)*(c - 1) / (s.at<float>(0, 0) - s.at<float>(c - 1, 0));
-	float b = (c*s.at<float>(c - 1, 0) - s.at<float>(0, 0)) / (s.at<float>(0, 0) - s.at<float>(c - 1, 0));
-	float K = a / (c + b) - pow(a / (b + c), 0.9);
-	for (int i = 1; i <=s.rows; ++i) {
-		if (i <= c)
-			s.at<float>(i - 1, 0) = pow(a / (i + b), 0.9) + K;
-		else
-			s.at<float>(i - 1, 0) = a / (i + b);
+
+	//协方差矩阵对称，用对称特征分解代替SVD，特征值降序
+	eigen(sigama, s, u);
+
+	int c = EnergyIndex(s, sum(s)[0]);
+	if (c == 0) c = s.rows;
+	RegularizedSpectrum spectrum(s, c);
+	for (int i = 1; i <= s.rows; ++i) {
+		s.at<float>(i - 1, 0) = spectrum(i);
 	}
-	
-	//构建对角阵w
-	Mat w=Mat::zeros(s.rows, s.rows, CV_32FC1);
-	for (int i = 0; i < s.rows; ++i) {
-		w.at<float>(i, i) = s.at<float>(i, 0);
+}
+
+//U^T*diag(s)*U + tail*(I - U^T*U)，tail为0时即Reconstruct
+static Mat Compose(const Mat &u, const Mat &s, float tail) {
+	Mat rv = Reconstruct(u, s);
+	if (tail != 0) {
+		Mat projector;
+		gemm(u, u, -tail, noArray(), 0, projector, GEMM_1_T);
+		rv += projector;
+		rv += Mat::eye(u.cols, u.cols, CV_32FC1)*tail;
 	}
-	return svd.u*w*svd.vt;
+	return rv;
+}
+
+Mat Regularization(Mat sigama) {
+	return Regularization(sigama, 0);
+}
+
+Mat Regularization(Mat sigama, int max_rank) {
+	Mat s, u;
+	float tail;
+	RegularizedEigen(sigama, max_rank, s, u, tail, NULL);
+
+	return Compose(u, s, tail);
+}
+
+Mat RegularizedInverse(Mat sigama, int max_rank, double *tail_error) {
+	Mat s, u;
+	float tail;
+	RegularizedEigen(sigama, max_rank, s, u, tail, tail_error);
+
+	//同一特征基上特征值取倒数，补空间上为1/tail，不做d*d求逆
+	Mat inv_s = 1 / s;
+	return Compose(u, inv_s, tail != 0 ? 1 / tail : 0);
 }
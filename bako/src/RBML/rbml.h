@@ -10,3 +10,8 @@ using namespace cv;
 
 Mat doRBML(Mat train_a , Mat train_b );
 Mat Regularization(Mat sigama);
+//只求前max_rank个特征对，其余特征值以均值近似，用于高维特征
+Mat Regularization(Mat sigama, int max_rank);
+//Regularization(sigama, max_rank)的逆，在特征基上直接求得，不做O(d^3)的求逆。
+//tail_error非空时给出尾部均值近似带来的相对误差上界，见rbml.cpp
+Mat RegularizedInverse(Mat sigama, int max_rank = 0, double *tail_error = NULL);
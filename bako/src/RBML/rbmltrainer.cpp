@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "rbmltrainer.h"
+#include "rbml.h"
+
+using namespace cv;
+
+// partial X X^T of column blocks, summed after the loop
+//
+class GramBody : public ParallelLoopBody {
+public:
+    GramBody(const Mat &x, const int block, std::vector<Mat> &partials)
+          : x_(x), block_(block), partials_(partials) {}
+
+    void operator()(const Range &range) const
+    {
+        for (int b = range.start; b < range.end; ++b) {
+            int begin = b * block_;
+            int end = std::min(begin + block_, x_.cols);
+            // GEMM with the block itself
+            mulTransposed(x_.colRange(begin, end), partials_[b], false);
+        }
+    }
+
+private:
+    const Mat &x_;
+    const int block_;
+    std::vector<Mat> &partials_;
+};
+
+Mat ParallelGram(const Mat &x)
+{
+    const int kBlock = 4096;
+
+    Mat x64;
+    x.convertTo(x64, CV_64FC1);
+
+    int blocks = (x64.cols + kBlock - 1) / kBlock;
+    std::vector<Mat> partials(blocks);
+    parallel_for_(Range(0, blocks), GramBody(x64, kBlock, partials));
+
+    Mat gram = Mat::zeros(x64.rows, x64.rows, CV_64FC1);
+    for (int b = 0; b < blocks; ++b)
+        gram += partials[b];
+
+    return gram;
+}
+
+RBMLTrainer::RBMLTrainer(const int dimension)
+{
+    dimension_ = dimension;
+    pairs_ = 0;
+
+    sum_a_ = Mat::zeros(dimension_, 1, CV_64FC1);
+    sum_b_ = Mat::zeros(dimension_, 1, CV_64FC1);
+    gram_a_ = Mat::zeros(dimension_, dimension_, CV_64FC1);
+    gram_b_ = Mat::zeros(dimension_, dimension_, CV_64FC1);
+    gram_d_ = Mat::zeros(dimension_, dimension_, CV_64FC1);
+}
+
+void RBMLTrainer::add(const Mat &cam_a, const Mat &cam_b)
+{
+    CV_Assert(cam_a.rows == dimension_ && cam_b.rows == dimension_);
+    CV_Assert(cam_a.cols == cam_b.cols);
+
+    Mat a, b;
+    cam_a.convertTo(a, CV_64FC1);
+    cam_b.convertTo(b, CV_64FC1);
+
+    Mat s;
+    reduce(a, s, 1, CV_REDUCE_SUM, CV_64FC1);
+    sum_a_ += s;
+    reduce(b, s, 1, CV_REDUCE_SUM, CV_64FC1);
+    sum_b_ += s;
+
+    gram_a_ += ParallelGram(a);
+    gram_b_ += ParallelGram(b);
+    gram_d_ += ParallelGram(a - b);
+
+    pairs_ += a.cols;
+}
+
+Mat RBMLTrainer::sigma1() const
+{
+    Mat sigma;
+    gram_d_.convertTo(sigma, CV_32FC1);
+
+    return sigma;
+}
+
+Mat RBMLTrainer::sigma0() const
+{
+    Mat all = pairs_ * gram_a_ + pairs_ * gram_b_
+            - sum_a_ * sum_b_.t() - sum_b_ * sum_a_.t();
+
+    Mat sigma;
+    Mat(all - gram_d_).convertTo(sigma, CV_32FC1);
+
+    return sigma;
+}
+
+Mat RBMLTrainer::solve(const int max_rank, double *tail_error) const
+{
+    // inverted in their eigenbases, no dense inverse
+    double error1, error0;
+    Mat inv_sigma1 = RegularizedInverse(sigma1(), max_rank, &error1);
+    Mat inv_sigma0 = RegularizedInverse(sigma0(), max_rank, &error0);
+    if (tail_error != NULL)
+        *tail_error = std::max(error1, error0);
+
+    return inv_sigma1 - inv_sigma0;
+}
+
+bool RBMLTrainer::save_state(const std::string &path) const
+{
+    FileStorage fs(path, FileStorage::WRITE);
+    if (!fs.isOpened())
+        return false;
+
+    fs << "pairs" << pairs_
+       << "sum_a" << sum_a_ << "sum_b" << sum_b_
+       << "gram_a" << gram_a_ << "gram_b" << gram_b_
+       << "gram_d" << gram_d_;
+    fs.release();
+
+    return true;
+}
+
+bool RBMLTrainer::load_state(const std::string &path)
+{
+    FileStorage fs(path, FileStorage::READ);
+    if (!fs.isOpened())
+        return false;
+
+    Mat sum_a, sum_b, gram_a, gram_b, gram_d;
+    double pairs = 0;
+    fs["pairs"] >> pairs;
+    fs["sum_a"] >> sum_a;
+    fs["sum_b"] >> sum_b;
+    fs["gram_a"] >> gram_a;
+    fs["gram_b"] >> gram_b;
+    fs["gram_d"] >> gram_d;
+    fs.release();
+
+    if (sum_a.rows != dimension_ || gram_a.rows != dimension_)
+        return false;
+
+    pairs_ = pairs;
+    sum_a_ = sum_a;
+    sum_b_ = sum_b;
+    gram_a_ = gram_a;
+    gram_b_ = gram_b;
+    gram_d_ = gram_d;
+
+    return true;
+}
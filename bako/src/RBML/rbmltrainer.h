@@ -0,0 +1,67 @@
+//
+// Closed-form, incremental training of the RBML metric.
+//
+// doRBML() needs the covariances of the positive and negative pairs:
+//
+//  sigma1 = sum_i (a_i - b_i)(a_i - b_i)^T
+//  sigma0 = sum_{i != j} (a_i - b_j)(a_i - b_j)^T
+//
+// Both follow from a few sums, so no pair is ever visited:
+//
+//  sum_{i,j} (a_i - b_j)(a_i - b_j)^T
+//      = n_b A A^T + n_a B B^T - s_a s_b^T - s_b s_a^T
+//  sigma0 = sum_{i,j} (a_i - b_j)(a_i - b_j)^T - sigma1
+//
+// where s_a, s_b are column sums. A A^T, B B^T and D D^T (D = A - B) are
+// Gram matrices computed as GEMMs over column blocks in parallel. The sums
+// only grow, so new labelled pairs are added without retraining, and the
+// state can be saved and loaded between runs.
+//
+#ifndef RBMLTRAINER_H
+#define RBMLTRAINER_H
+
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+class RBMLTrainer {
+public:
+    RBMLTrainer(const int dimension = 100);
+    ~RBMLTrainer() {}
+
+    // labelled pairs: column i of cam_a and of cam_b is the same person,
+    // both dimension x n
+    void add(const cv::Mat &cam_a, const cv::Mat &cam_b);
+
+    // covariances of the positive and negative pairs, CV_32FC1
+    cv::Mat sigma1() const;
+    cv::Mat sigma0() const;
+
+    // the metric M, max_rank > 0 regularizes with the top max_rank
+    // eigenpairs only, for high dimensional features. Both covariances
+    // are inverted in their eigenbases, O(d^2 max_rank) with max_rank.
+    // tail_error gets the relative error that averaging the eigenvalues
+    // past max_rank adds to either inverse, see RegularizedInverse().
+    cv::Mat solve(const int max_rank = 0, double *tail_error = NULL) const;
+
+    // accumulated sums, to continue training later
+    bool save_state(const std::string &path) const;
+    bool load_state(const std::string &path);
+
+    int get_dimension() const { return dimension_; }
+    double get_pairs() const { return pairs_; }
+
+private:
+    int dimension_;
+    double pairs_;              // n_a == n_b, pairs come in together
+    // CV_64FC1 accumulators
+    cv::Mat sum_a_, sum_b_;     // dimension x 1
+    cv::Mat gram_a_, gram_b_;   // A A^T, B B^T
+    cv::Mat gram_d_;            // D D^T, that is sigma1
+};
+
+// X X^T of a dimension x n matrix, in parallel over column blocks
+//
+cv::Mat ParallelGram(const cv::Mat &x);
+
+#endif // RBMLTRAINER_H
@@ -0,0 +1,91 @@
+//
+// rbml_train: train PCA.xml and M.xml from labelled camera pairs, and
+// the feature.model of both, see featuremodel.h.
+//
+// Input is a FileStorage file with "cam_a" and "cam_b", 1152 x n raw
+// features where column i of both is the same person.
+//
+// Without PCA.xml in the output directory, PCA is computed from the
+// training set and saved. With a state file, the pairs are added to the
+// saved sums, so only the new pairs are processed.
+//
+// Usage: rbml_train {camera.xml} [output_dir] [state.xml]
+//
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+#include "featuremodel.h"
+#include "rbml.h"
+#include "rbmltrainer.h"
+
+using namespace cv;
+using std::string;
+
+const int kMaxComponents = 100;
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stdout, "\nUsage: %s {camera.xml} [output_dir] [state.xml]\n\n",
+                argv[0]);
+        exit(0);
+    }
+
+    string output_dir = argc > 2 ? string(argv[2]) + "/" : "";
+    string state_path = argc > 3 ? argv[3] : "";
+
+    // labelled pairs
+    FileStorage fs_cam(argv[1], FileStorage::READ);
+    Mat cam_a, cam_b;
+    fs_cam["cam_a"] >> cam_a;
+    fs_cam["cam_b"] >> cam_b;
+    fs_cam.release();
+    if (cam_a.empty() || cam_a.size() != cam_b.size()) {
+        fprintf(stderr, "ERROR - cam_a and cam_b must have the same size\n");
+        exit(1);
+    }
+
+    // PCA is kept once trained, sums of the state live in its space
+    PCA pca;
+    FileStorage fs_pca(output_dir + "PCA.xml", FileStorage::READ);
+    if (fs_pca.isOpened()) {
+        fs_pca["mean"] >> pca.mean;
+        fs_pca["eigenvalues"] >> pca.eigenvalues;
+        fs_pca["eigenvectors"] >> pca.eigenvectors;
+        fs_pca.release();
+    } else {
+        Mat train_set;
+        hconcat(cam_a, cam_b, train_set);
+        pca(train_set, Mat(), CV_PCA_DATA_AS_COL, kMaxComponents);
+
+        FileStorage fs_out(output_dir + "PCA.xml", FileStorage::WRITE);
+        fs_out << "mean" << pca.mean
+               << "eigenvalues" << pca.eigenvalues
+               << "eigenvectors" << pca.eigenvectors;
+        fs_out.release();
+    }
+
+    RBMLTrainer trainer(pca.eigenvectors.rows);
+    if (!state_path.empty() && !trainer.load_state(state_path))
+        fprintf(stdout, "INFO - state - start with a new state\n");
+
+    trainer.add(pca.project(cam_a), pca.project(cam_b));
+    fprintf(stdout, "INFO - pairs - %.0f\n", trainer.get_pairs());
+
+    if (!state_path.empty())
+        trainer.save_state(state_path);
+
+    Mat metric = trainer.solve();
+    FileStorage fs_m(output_dir + "M.xml", FileStorage::WRITE);
+    fs_m << "M" << metric;
+    fs_m.release();
+
+    if (!WriteFeatureModel(output_dir + kFeatureModelFile, pca, metric)) {
+        fprintf(stderr, "ERROR - fail to write %s\n", kFeatureModelFile);
+        exit(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,384 @@
+#include <stdint.h>
+#include <string>
+#include <mutex>
+
+#include <opencv2/opencv.hpp>
+#include "avstream.h"
+#include "sugar/sugar.h"
+
+using std::string;
+
+static void InitLibAV()
+{
+    static std::once_flag once;
+
+    std::call_once(once, []() {
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+        av_register_all();
+#endif
+        avformat_network_init();
+    });
+}
+
+int64_t PacketTimeMs(const AVPacket *packet, const AVRational time_base)
+{
+    int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (ts == AV_NOPTS_VALUE)
+        return 0;
+
+    AVRational ms = { 1, 1000 };
+    return av_rescale_q(ts, time_base, ms);
+}
+
+//
+// AVInput
+//
+AVInput::AVInput()
+{
+    format_ctx_ = NULL;
+    codec_ctx_ = NULL;
+    sws_ctx_ = NULL;
+    proxy_sws_ctx_ = NULL;
+    frame_ = NULL;
+    stream_index_ = -1;
+    decode_skip_ = kDecodeAll;
+}
+
+bool AVInput::open(const string &url)
+{
+    InitLibAV();
+    close();
+
+    // sdp files refer to rtp over udp
+    AVDictionary *options = NULL;
+    av_dict_set(&options, "protocol_whitelist", "file,udp,rtp,tcp,rtsp", 0);
+    int rv = avformat_open_input(&format_ctx_, url.c_str(), NULL, &options);
+    av_dict_free(&options);
+    if (rv < 0) {
+        LogError("Fail to open input.");
+        format_ctx_ = NULL;
+        return false;
+    }
+
+    if (avformat_find_stream_info(format_ctx_, NULL) < 0) {
+        LogError("Fail to find stream info.");
+        close();
+        return false;
+    }
+
+    stream_index_ = av_find_best_stream(format_ctx_, AVMEDIA_TYPE_VIDEO,
+                                        -1, -1, NULL, 0);
+    if (stream_index_ < 0) {
+        LogError("No video stream in input.");
+        close();
+        return false;
+    }
+
+    const AVCodecParameters *codecpar = get_codecpar();
+    const AVCodec *codec = avcodec_find_decoder(codecpar->codec_id);
+    if (!codec) {
+        LogError("No decoder for video stream.");
+        close();
+        return false;
+    }
+
+    codec_ctx_ = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codec_ctx_, codecpar);
+    // frame threads delay output, slices do not
+    codec_ctx_->thread_count = 0;
+    codec_ctx_->thread_type = FF_THREAD_SLICE;
+    set_decode_skip(decode_skip_);
+    if (avcodec_open2(codec_ctx_, codec, NULL) < 0) {
+        LogError("Fail to open decoder.");
+        close();
+        return false;
+    }
+
+    frame_ = av_frame_alloc();
+
+    return true;
+}
+
+void AVInput::close()
+{
+    if (frame_)
+        av_frame_free(&frame_);
+    if (codec_ctx_)
+        avcodec_free_context(&codec_ctx_);
+    if (sws_ctx_) {
+        sws_freeContext(sws_ctx_);
+        sws_ctx_ = NULL;
+    }
+    if (proxy_sws_ctx_) {
+        sws_freeContext(proxy_sws_ctx_);
+        proxy_sws_ctx_ = NULL;
+    }
+    if (format_ctx_)
+        avformat_close_input(&format_ctx_);
+    stream_index_ = -1;
+}
+
+bool AVInput::read(AVPacket *packet)
+{
+    while (av_read_frame(format_ctx_, packet) >= 0) {
+        if (packet->stream_index == stream_index_)
+            return true;
+        av_packet_unref(packet);
+    }
+
+    return false;
+}
+
+bool AVInput::receive(const AVPacket *packet)
+{
+    if (avcodec_send_packet(codec_ctx_, packet) < 0)
+        return false;
+
+    return avcodec_receive_frame(codec_ctx_, frame_) >= 0;
+}
+
+bool AVInput::decode(const AVPacket *packet)
+{
+    if (!receive(packet))
+        return false;
+    av_frame_unref(frame_);
+
+    return true;
+}
+
+bool AVInput::seek(const int64_t pts)
+{
+    if (av_seek_frame(format_ctx_, stream_index_, pts,
+                      AVSEEK_FLAG_BACKWARD) < 0)
+        return false;
+    avcodec_flush_buffers(codec_ctx_);
+
+    return true;
+}
+
+void AVInput::set_decode_skip(const DecodeSkip decode_skip)
+{
+    decode_skip_ = decode_skip;
+    if (!codec_ctx_)
+        return;
+
+    switch (decode_skip) {
+    case kDecodeKeyframes:
+        codec_ctx_->skip_frame = AVDISCARD_NONKEY;
+        break;
+    case kDecodeReference:
+        codec_ctx_->skip_frame = AVDISCARD_NONREF;
+        break;
+    default:
+        codec_ctx_->skip_frame = AVDISCARD_DEFAULT;
+        break;
+    }
+}
+
+bool AVInput::needs_decode(const AVPacket *packet) const
+{
+    switch (decode_skip_) {
+    case kDecodeKeyframes:
+        return IsKeyPacket(packet);
+    case kDecodeReference:
+#ifdef AV_PKT_FLAG_DISPOSABLE
+        // not every demuxer marks them, the decoder drops the rest
+        return (packet->flags & AV_PKT_FLAG_DISPOSABLE) == 0;
+#else
+        return true;
+#endif
+    default:
+        return true;
+    }
+}
+
+void AVInput::convert(SwsContext *&sws_ctx, cv::Mat &frame,
+                      const int width, const int height)
+{
+    // buffer of frame is reused while the size holds
+    frame.create(height, width, CV_8UC3);
+    sws_ctx = sws_getCachedContext(sws_ctx,
+                                   frame_->width, frame_->height,
+                                   (AVPixelFormat)frame_->format,
+                                   width, height,
+                                   AV_PIX_FMT_BGR24,
+                                   width < frame_->width ? SWS_AREA
+                                                         : SWS_BILINEAR,
+                                   NULL, NULL, NULL);
+    uint8_t *dst[] = { frame.data };
+    int dst_stride[] = { (int)frame.step[0] };
+    sws_scale(sws_ctx, frame_->data, frame_->linesize, 0, frame_->height,
+              dst, dst_stride);
+}
+
+bool AVInput::decode(const AVPacket *packet, cv::Mat &frame)
+{
+    if (!receive(packet))
+        return false;
+
+    convert(sws_ctx_, frame, frame_->width, frame_->height);
+    av_frame_unref(frame_);
+
+    return true;
+}
+
+bool AVInput::decode(const AVPacket *packet, cv::Mat &frame, cv::Mat &proxy,
+                     const int proxy_width)
+{
+    if (!receive(packet))
+        return false;
+
+    convert(sws_ctx_, frame, frame_->width, frame_->height);
+    if (proxy_width <= 0 || proxy_width >= frame_->width) {
+        proxy = frame;
+    } else {
+        int proxy_height = (int)((int64_t)frame_->height * proxy_width /
+                                 frame_->width);
+        convert(proxy_sws_ctx_, proxy, proxy_width, proxy_height);
+    }
+    av_frame_unref(frame_);
+
+    return true;
+}
+
+bool AVInput::can_stream_copy() const
+{
+    const AVOutputFormat *mkv = av_guess_format("matroska", NULL, NULL);
+
+    return mkv && avformat_query_codec(mkv, get_codecpar()->codec_id,
+                                       FF_COMPLIANCE_NORMAL) == 1;
+}
+
+const AVCodecParameters *AVInput::get_codecpar() const
+{
+    return format_ctx_->streams[stream_index_]->codecpar;
+}
+
+AVRational AVInput::get_time_base() const
+{
+    return format_ctx_->streams[stream_index_]->time_base;
+}
+
+double AVInput::get_fps() const
+{
+    AVRational rate = av_guess_frame_rate(format_ctx_,
+                                          format_ctx_->streams[stream_index_],
+                                          NULL);
+
+    return rate.den ? av_q2d(rate) : 0;
+}
+
+int AVInput::get_width() const
+{
+    return get_codecpar()->width;
+}
+
+int AVInput::get_height() const
+{
+    return get_codecpar()->height;
+}
+
+string AVInput::get_codec_name() const
+{
+    return avcodec_get_name(get_codecpar()->codec_id);
+}
+
+//
+// AVRemuxer
+//
+AVRemuxer::AVRemuxer()
+{
+    format_ctx_ = NULL;
+    stream_ = NULL;
+    start_pts_ = AV_NOPTS_VALUE;
+}
+
+bool AVRemuxer::open(const string &filename,
+                     const AVCodecParameters *codecpar,
+                     const AVRational time_base)
+{
+    InitLibAV();
+    close();
+
+    if (avformat_alloc_output_context2(&format_ctx_, NULL, "matroska",
+                                       filename.c_str()) < 0) {
+        LogError("Fail to create output context.");
+        format_ctx_ = NULL;
+        return false;
+    }
+
+    stream_ = avformat_new_stream(format_ctx_, NULL);
+    avcodec_parameters_copy(stream_->codecpar, codecpar);
+    stream_->codecpar->codec_tag = 0;
+    stream_->time_base = time_base;
+    time_base_ = time_base;
+    start_pts_ = AV_NOPTS_VALUE;
+
+    if (avio_open(&format_ctx_->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0) {
+        LogError("Fail to open output file.");
+        avformat_free_context(format_ctx_);
+        format_ctx_ = NULL;
+        return false;
+    }
+
+    if (avformat_write_header(format_ctx_, NULL) < 0) {
+        LogError("Fail to write header.");
+        avio_closep(&format_ctx_->pb);
+        avformat_free_context(format_ctx_);
+        format_ctx_ = NULL;
+        return false;
+    }
+
+    // stream time base is chosen by the muxer
+    index_.clear();
+    index_.set_time_base(stream_->time_base.num, stream_->time_base.den);
+
+    return true;
+}
+
+bool AVRemuxer::write(const AVPacket *packet, const int64_t frame_pos)
+{
+    AVPacket *out = av_packet_alloc();
+    av_packet_ref(out, packet);
+
+    // segment starts at 0
+    if (start_pts_ == AV_NOPTS_VALUE)
+        start_pts_ = out->dts != AV_NOPTS_VALUE ? out->dts : out->pts;
+    if (start_pts_ != AV_NOPTS_VALUE) {
+        if (out->pts != AV_NOPTS_VALUE) out->pts -= start_pts_;
+        if (out->dts != AV_NOPTS_VALUE) out->dts -= start_pts_;
+    }
+
+    av_packet_rescale_ts(out, time_base_, stream_->time_base);
+    out->stream_index = stream_->index;
+    out->pos = -1;
+
+    // keyframes are found by pts, see FrameSeeker
+    int64_t pts = out->pts != AV_NOPTS_VALUE ? out->pts : out->dts;
+    if (frame_pos < 0)
+        index_.add(pts, IsKeyPacket(out));
+    else
+        index_.set(frame_pos, pts, IsKeyPacket(out));
+
+    // one stream, nothing to interleave
+    int rv = av_write_frame(format_ctx_, out);
+    av_packet_free(&out);
+    if (rv < 0) {
+        LogError("Fail to write packet.");
+        return false;
+    }
+
+    return true;
+}
+
+void AVRemuxer::close()
+{
+    if (!format_ctx_)
+        return;
+
+    av_write_trailer(format_ctx_);
+    avio_closep(&format_ctx_->pb);
+    avformat_free_context(format_ctx_);
+    format_ctx_ = NULL;
+    stream_ = NULL;
+}
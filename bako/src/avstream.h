@@ -0,0 +1,137 @@
+#ifndef AVSTREAM_H
+#define AVSTREAM_H
+
+//
+// libav* wrappers for the stream copy path:
+//  AVInput: demux the video stream of a source, decode packets on demand.
+//  AVRemuxer: write packets as they are into a matroska file.
+//
+// With these the camera's compressed packets go to disk untouched, and
+// decoding only feeds analytics.
+//
+
+#include <stdint.h>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+#include "frameindex.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+using std::string;
+
+// which frames AVInput decodes, the rest are skipped at the packet level
+//
+enum DecodeSkip {
+    kDecodeAll,             // every frame
+    kDecodeKeyframes,       // I-frames only
+    kDecodeReference        // frames others refer to, disposable ones are
+                            // skipped
+};
+
+class AVInput {
+public:
+    AVInput();
+    ~AVInput() { close(); }
+
+    bool open(const string &url);
+    void close();
+    bool is_open() const { return format_ctx_ != NULL; }
+
+    // next packet of the video stream, false at the end or on error
+    bool read(AVPacket *packet);
+    // decode a packet, true when a frame comes out (BGR)
+    //
+    // Decoding uses slice threads only, so for streams without B-frames
+    // (as IP cameras send) the frame belongs to the packet just decoded.
+    bool decode(const AVPacket *packet, cv::Mat &frame);
+    // decode into frame and into a proxy proxy_width wide for the
+    // analytics, both scaled from the decoded picture in one go each
+    bool decode(const AVPacket *packet, cv::Mat &frame, cv::Mat &proxy,
+                const int proxy_width);
+    // decode without converting, to walk up to a frame
+    bool decode(const AVPacket *packet);
+    // seek to the keyframe at or before pts, in the stream time base
+    bool seek(const int64_t pts);
+
+    // Packets for which needs_decode() is false must not be passed to
+    // decode(), the decoder also drops the frames the mode skips. Switch
+    // modes on a keyframe.
+    void set_decode_skip(const DecodeSkip decode_skip);
+    DecodeSkip get_decode_skip() const { return decode_skip_; }
+    bool needs_decode(const AVPacket *packet) const;
+
+    // whether packets can be muxed into matroska as they are
+    bool can_stream_copy() const;
+
+    const AVCodecParameters *get_codecpar() const;
+    AVRational get_time_base() const;
+    double get_fps() const;
+    int get_width() const;
+    int get_height() const;
+    string get_codec_name() const;
+
+private:
+    AVInput(const AVInput &);
+    AVInput &operator=(const AVInput &);
+
+    // decode into frame_
+    bool receive(const AVPacket *packet);
+    // frame_ into a BGR Mat of width x height
+    void convert(SwsContext *&sws_ctx, cv::Mat &frame,
+                 const int width, const int height);
+
+    AVFormatContext *format_ctx_;
+    AVCodecContext *codec_ctx_;
+    SwsContext *sws_ctx_;
+    SwsContext *proxy_sws_ctx_;     // for the analytics proxy
+    AVFrame *frame_;
+    int stream_index_;
+    DecodeSkip decode_skip_;
+};
+
+class AVRemuxer {
+public:
+    AVRemuxer();
+    ~AVRemuxer() { close(); }
+
+    // timestamps are shifted so the file starts at 0
+    bool open(const string &filename,
+              const AVCodecParameters *codecpar,
+              const AVRational time_base);
+    // frame_pos of the packet in the index, < 0 for the next one
+    bool write(const AVPacket *packet, const int64_t frame_pos = -1);
+    // write the trailer and close the file
+    void close();
+    bool is_open() const { return format_ctx_ != NULL; }
+
+    // index of the packets written since open()
+    const FrameIndex &get_index() const { return index_; }
+
+private:
+    AVRemuxer(const AVRemuxer &);
+    AVRemuxer &operator=(const AVRemuxer &);
+
+    AVFormatContext *format_ctx_;
+    AVStream *stream_;
+    AVRational time_base_;      // of the input packets
+    int64_t start_pts_;
+    FrameIndex index_;
+};
+
+// whether the packet starts a GOP
+//
+inline bool IsKeyPacket(const AVPacket *packet)
+{
+    return (packet->flags & AV_PKT_FLAG_KEY) != 0;
+}
+
+// packet timestamp in ms
+//
+int64_t PacketTimeMs(const AVPacket *packet, const AVRational time_base);
+
+#endif // AVSTREAM_H
@@ -0,0 +1,254 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "blobstore.h"
+#include "shotid.h"
+#include "sugar/sugar.h"
+
+using std::string;
+
+static const char kRecordMagic[4] = {'G', 'B', 'L', 'B'};
+static const size_t kRecordHeader = 12;     // magic, key size, data size
+static const size_t kEntryHeader = 16;      // offset, data size, key size
+
+static int64_t FileSize(const int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return -1;
+
+    return st.st_size;
+}
+
+// whole of size bytes at offset
+//
+static bool ReadAt(const int fd, char *data, const size_t size,
+                   const uint64_t offset)
+{
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, data + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+
+    return true;
+}
+
+BlobStore::Pack::~Pack()
+{
+    if (fd >= 0)
+        close(fd);
+    if (index_fd >= 0)
+        close(index_fd);
+}
+
+void BlobStore::Pack::refresh()
+{
+    int64_t index_size = FileSize(index_fd);
+    int64_t pack_size = FileSize(fd);
+    if (index_size <= (int64_t)index_read || pack_size < 0)
+        return;
+
+    std::vector<char> buffer(index_size - index_read);
+    if (!ReadAt(index_fd, &buffer[0], buffer.size(), index_read))
+        return;
+
+    // an entry being appended by another process is left for later
+    size_t pos = 0;
+    while (pos + kEntryHeader <= buffer.size()) {
+        BlobRef ref;
+        uint32_t key_size;
+        memcpy(&ref.offset, &buffer[pos], 8);
+        memcpy(&ref.size, &buffer[pos + 8], 4);
+        memcpy(&key_size, &buffer[pos + 12], 4);
+        if (pos + kEntryHeader + key_size > buffer.size())
+            break;
+
+        if (ref.offset + ref.size <= (uint64_t)pack_size)
+            index[string(&buffer[pos + kEntryHeader], key_size)] = ref;
+        pos += kEntryHeader + key_size;
+    }
+    index_read += pos;
+}
+
+bool BlobStore::Pack::find(const string &key, BlobRef &ref)
+{
+    std::unordered_map<string, BlobRef>::const_iterator it = index.find(key);
+    if (it == index.end())
+        return false;
+
+    ref = it->second;
+    return true;
+}
+
+BlobStore::BlobStore(const string &root)
+{
+    root_ = root;
+    uses_ = 0;
+
+    // every put() would fail without it
+    if (!MakeDirs(root_))
+        LogError(("Fail to create blob directory " + root_ + ".").c_str());
+}
+
+string BlobStore::pack_path(const string &key) const
+{
+    VideoId video_id;
+    if (key.size() < kVideoIdChars ||
+            !ParseId(key.substr(0, kVideoIdChars), video_id))
+        return "";
+
+    return root_ + video_id.camera.to_string() + "_" +
+           FormatEpochMs(IdTimeMs(video_id.video), "%Y%m%d%H") + ".pack";
+}
+
+std::shared_ptr<BlobStore::Pack> BlobStore::open_pack(const string &key,
+                                                      const bool create)
+{
+    string path = pack_path(key);
+    if (path.empty()) {
+        LogError("Blob key without video id.");
+        return std::shared_ptr<Pack>();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<string, std::shared_ptr<Pack> >::iterator it = packs_.find(path);
+    if (it != packs_.end()) {
+        it->second->last_use = ++uses_;
+        return it->second;
+    }
+
+    std::shared_ptr<Pack> pack(new Pack());
+    pack->fd = open(path.c_str(),
+                    O_RDWR | O_APPEND | (create ? O_CREAT : 0), 0644);
+    if (pack->fd < 0) {
+        if (create)
+            LogError("Fail to open blob pack.");
+        return std::shared_ptr<Pack>();
+    }
+    pack->index_fd = open((path + ".idx").c_str(),
+                          O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (pack->index_fd < 0) {
+        LogError("Fail to open blob index.");
+        return std::shared_ptr<Pack>();
+    }
+    pack->refresh();
+    pack->last_use = ++uses_;
+
+    // readers of a closed pack keep it open until they are done
+    while (packs_.size() >= kMaxOpenPacks) {
+        std::map<string, std::shared_ptr<Pack> >::iterator lru =
+                packs_.begin();
+        for (it = packs_.begin(); it != packs_.end(); ++it)
+            if (it->second->last_use < lru->second->last_use)
+                lru = it;
+        packs_.erase(lru);
+    }
+    packs_[path] = pack;
+
+    return pack;
+}
+
+bool BlobStore::put(const string &key, const char *data, const size_t size)
+{
+    std::shared_ptr<Pack> pack = open_pack(key, true);
+    if (!pack)
+        return false;
+
+    uint32_t key_size = key.size(), data_size = size;
+    char header[kRecordHeader];
+    memcpy(header, kRecordMagic, 4);
+    memcpy(header + 4, &key_size, 4);
+    memcpy(header + 8, &data_size, 4);
+
+    struct iovec record[3];
+    record[0].iov_base = header;
+    record[0].iov_len = kRecordHeader;
+    record[1].iov_base = (void *)key.data();
+    record[1].iov_len = key_size;
+    record[2].iov_base = (void *)data;
+    record[2].iov_len = size;
+    size_t record_size = kRecordHeader + key_size + size;
+
+    std::lock_guard<std::mutex> lock(pack->mutex);
+
+    // O_APPEND leaves the file offset at the end of this record
+    if (writev(pack->fd, record, 3) != (ssize_t)record_size) {
+        LogError("Fail to append blob.");
+        return false;
+    }
+    BlobRef ref;
+    ref.offset = lseek(pack->fd, 0, SEEK_CUR) - size;
+    ref.size = data_size;
+
+    string entry(kEntryHeader, '\0');
+    memcpy(&entry[0], &ref.offset, 8);
+    memcpy(&entry[8], &ref.size, 4);
+    memcpy(&entry[12], &key_size, 4);
+    entry += key;
+    if (write(pack->index_fd, entry.data(), entry.size()) !=
+            (ssize_t)entry.size()) {
+        LogError("Fail to index blob.");
+        return false;
+    }
+    pack->index[key] = ref;
+
+    return true;
+}
+
+bool BlobStore::get(const string &key, string &data)
+{
+    std::shared_ptr<Pack> pack = open_pack(key, false);
+    if (!pack)
+        return false;
+
+    BlobRef ref;
+    {
+        std::lock_guard<std::mutex> lock(pack->mutex);
+        if (!pack->find(key, ref)) {
+            // put by another process since
+            pack->refresh();
+            if (!pack->find(key, ref))
+                return false;
+        }
+    }
+
+    data.resize(ref.size);
+    return ref.size == 0 || ReadAt(pack->fd, &data[0], ref.size, ref.offset);
+}
+
+bool BlobStore::contains(const string &key)
+{
+    std::shared_ptr<Pack> pack = open_pack(key, false);
+    if (!pack)
+        return false;
+
+    BlobRef ref;
+    std::lock_guard<std::mutex> lock(pack->mutex);
+    if (pack->find(key, ref))
+        return true;
+    pack->refresh();
+
+    return pack->find(key, ref);
+}
+
+BlobStore &SharedBlobStore()
+{
+    static BlobStore blob_store("/tmp/gee/blobs/");
+
+    return blob_store;
+}
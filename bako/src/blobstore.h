@@ -0,0 +1,96 @@
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+//
+// BlobStore: small files (keyframes, person crops) packed per camera and
+// hour instead of one file each.
+//
+// A blob is keyed by an id string which starts with a VideoId string
+// (see shotid.h), e.g. a FrameId or PersonShotId. Its camera and the
+// hour of its video id pick the pack:
+//  root + camera + "_" + %Y%m%d%H + ".pack"
+// Packs are append-only, each put() is one write() at the end of the
+// pack, then one write() of its entry at the end of the index sidecar
+// (pack path + ".idx"). Reads are a pread() at the indexed offset.
+//
+// Binary layout, little endian:
+//  pack: records { "GBLB", uint32 key size, uint32 data size, key, data }
+//  index: entries { uint64 data offset, uint32 data size,
+//                   uint32 key size, key }
+// Records are self-describing, so the index can be rebuilt from the
+// pack. A record written without its index entry (crash in between) is
+// skipped. Both files are opened O_APPEND, so processes may share a
+// pack, and the index is read again on a miss to see blobs put by
+// others. A key put twice is read as its last put.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using std::string;
+
+// open packs kept, the least recently used are closed beyond it
+static const size_t kMaxOpenPacks = 64;
+
+class BlobStore {
+public:
+    // root is a directory, e.g. "/tmp/gee/blobs/", created if missing
+    BlobStore(const string &root);
+    ~BlobStore() {}
+
+    bool put(const string &key, const char *data, const size_t size);
+    bool put(const string &key, const string &data)
+    { return put(key, data.data(), data.size()); }
+    // false if not found
+    bool get(const string &key, string &data);
+    bool contains(const string &key);
+
+    const string &get_root() const { return root_; }
+    // pack of a key, empty if the key does not start with a VideoId
+    string pack_path(const string &key) const;
+
+private:
+    BlobStore(const BlobStore &);
+    BlobStore &operator=(const BlobStore &);
+
+    struct BlobRef {
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    struct Pack {
+        Pack() : fd(-1), index_fd(-1), index_read(0), last_use(0) {}
+        ~Pack();
+
+        // read index entries appended since the last call
+        void refresh();
+        bool find(const string &key, BlobRef &ref);
+
+        std::mutex mutex;           // index and appends
+        int fd, index_fd;
+        std::unordered_map<string, BlobRef> index;
+        uint64_t index_read;        // bytes of the index loaded
+        uint64_t last_use;
+    };
+
+    // nullptr if the pack does not exist and create is false
+    std::shared_ptr<Pack> open_pack(const string &key, const bool create);
+
+    string root_;
+    std::mutex mutex_;
+    std::map<string, std::shared_ptr<Pack> > packs_;    // by path
+    uint64_t uses_;
+};
+
+// BlobStore of bako under /tmp/gee/blobs/.
+//
+BlobStore &SharedBlobStore();
+
+#endif // BLOBSTORE_H
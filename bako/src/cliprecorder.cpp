@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "cliprecorder.h"
+#include "frameindex.h"
+#include "sugar/sugar.h"
+
+using std::string;
+
+ClipRecorder::ClipRecorder(const int preroll, const int postroll,
+                           const size_t max_bytes)
+      : ring_(preroll, max_bytes)
+{
+    codecpar_ = NULL;
+    path_ = "/tmp/gee/clips/";
+    preroll_ms_ = (int64_t)preroll * 1000;
+    postroll_ms_ = (int64_t)postroll * 1000;
+    end_ms_ = 0;
+
+    // every clip would fail to open without it
+    if (!MakeDirs(path_))
+        LogError(("Fail to create clip directory " + path_ + ".").c_str());
+}
+
+void ClipRecorder::init(const AVInput &input, const string &cam_id)
+{
+    release();
+    ring_.clear();
+
+    codecpar_ = input.get_codecpar();
+    time_base_ = input.get_time_base();
+    cam_id_ = cam_id;
+}
+
+void ClipRecorder::push(const AVPacket *packet, const int64_t time_ms)
+{
+    ring_.push(packet, time_ms);
+
+    if (!is_recording())
+        return;
+
+    if (time_ms > end_ms_) {
+        release();
+        return;
+    }
+    remuxer_.write(packet);
+}
+
+void ClipRecorder::trigger(const int64_t time_ms)
+{
+    if (!codecpar_)
+        return;
+
+    end_ms_ = time_ms + postroll_ms_;
+    if (is_recording())
+        return;
+
+    // e.g. cam_id + 20151007221022 + _ + stream time + .mkv
+    filename_ = cam_id_ + FormatEpochMs(GetEpochMsNow()) + "_" +
+                NumberToString(time_ms) + ".mkv";
+    if (!remuxer_.open(path_ + filename_, codecpar_, time_base_)) {
+        LogError("Fail to open clip.");
+        return;
+    }
+
+    // pre-roll, up to the packet of the event
+    std::vector<AVPacket *> packets;
+    ring_.snapshot(time_ms - preroll_ms_, packets);
+    for (size_t i = 0; i < packets.size(); ++i) {
+        remuxer_.write(packets[i]);
+        av_packet_free(&packets[i]);
+    }
+}
+
+void ClipRecorder::release()
+{
+    if (!is_recording())
+        return;
+
+    remuxer_.close();
+    remuxer_.get_index().save(FrameIndexPath(path_ + filename_));
+    LogInfo("ClipRecorder", ("Clip saved: " + filename_).c_str());
+    filename_.clear();
+}
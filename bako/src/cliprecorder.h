@@ -0,0 +1,57 @@
+#ifndef CLIPRECORDER_H
+#define CLIPRECORDER_H
+
+//
+// ClipRecorder: event-triggered clips of a video stream.
+//
+// Every packet goes through a PacketRing. On an event (e.g. a keyframe
+// with persons) a clip is started from the ring, so it begins with
+// `preroll` seconds before the event, and it goes on until `postroll`
+// seconds after the last event. Clips are remuxed like the video pieces,
+// with a frame index sidecar, and do not depend on where pieces are cut.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <string>
+
+#include "avstream.h"
+#include "packetring.h"
+
+using std::string;
+
+class ClipRecorder {
+public:
+    ClipRecorder(const int preroll = 10, const int postroll = 10,
+                 const size_t max_bytes = 16 << 20);
+    ~ClipRecorder() { release(); }
+
+    // source of the packets
+    void init(const AVInput &input, const string &cam_id);
+
+    // every packet of the stream, time_ms from PacketTimeMs()
+    void push(const AVPacket *packet, const int64_t time_ms);
+    // event at time_ms, after its packet is pushed
+    void trigger(const int64_t time_ms);
+    // close the clip in progress
+    void release();
+
+    bool is_recording() const { return remuxer_.is_open(); }
+
+private:
+    ClipRecorder(const ClipRecorder &);
+    ClipRecorder &operator=(const ClipRecorder &);
+
+    PacketRing ring_;
+    AVRemuxer remuxer_;
+    const AVCodecParameters *codecpar_;
+    AVRational time_base_;
+    string cam_id_;
+    string path_;               // /tmp/gee/clips/, created if missing
+    string filename_;
+    int64_t preroll_ms_, postroll_ms_;
+    int64_t end_ms_;            // of the clip in progress
+};
+
+#endif // CLIPRECORDER_H
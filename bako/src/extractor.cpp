@@ -3,7 +3,10 @@
 // opencv 2
 // #include <opencv2/gpu/gpu.hpp>
 #include "extractor.h"
+#include "blobstore.h"
+#include "keyframewriter.h"
 #include "memcache.h"
+#include "tracker.h"
 #include "sugar/sugar.h"
 #include "sugar/gdebug.h"
 
@@ -12,54 +15,67 @@ using std::string;
 
 Extractor::Extractor()
 {
-    path_ = "/tmp/gee/keyframes/";
+    // keyframes are blobs, see KeyframeWriter
+    path_ = SharedBlobStore().get_root();
     filename_ = "";
     is_init_ = false;
 }
 
-void Extractor::set_frame_refer(const Mat &frame)
+void Extractor::set_frame_refer(const Frame &proxy)
 {
-    // init Mat with the frame from video stream
-    if (frame_refer_.empty()) {
-        frame_refer_ = frame.clone();
-    // TODO (@Zhiqiang He): reset Mat's content
-    } else {
-        frame_refer_.release();
-        frame_refer_ = frame.clone();
-    }
+    // hold the proxy itself, nothing writes a frame once decoded
+    frame_refer_ = proxy;
 
     is_init_ = true;
 }
 
-void Extractor::handler(const IPCamera ip_camera, const string &video_id,
-                        const size_t frame_pos, const Mat &frame)
+ExtractorSignal Extractor::handler(const IPCamera ip_camera,
+                                   const uint64_t video_id,
+                                   const size_t frame_pos,
+                                   const Frame &pooled_frame,
+                                   const Frame &pooled_proxy)
 {
+    const Mat &frame = pooled_frame.view();
+    const Mat &proxy = pooled_proxy.view();
+    ExtractorSignal signal;
+
     // set frame reference
     if (!is_init_) {
-        set_frame_refer(frame);
+        set_frame_refer(pooled_proxy);
     }
 
     // extracting keyframe
-    if (HistDiff(frame_refer_, frame)) {
+    if (HistDiff(frame_refer_.view(), proxy)) {
 #ifndef NOGDEBUG
         cout << "New keyframe!" << endl;
         imshow("Keyframe", frame);
 #endif
         // cache the new keyframe
-        filename_ = ip_camera.get_id() +
-                    video_id + FormatUnsignedInt(frame_pos, 5) + ".jpeg";
-        string fullpath = path_ + filename_;
-        vector<int> c_params;
-        c_params.push_back(CV_IMWRITE_JPEG_QUALITY);
-        imwrite(fullpath, frame, c_params);
-        KeyframeShot key_frame_shot(video_id, ip_camera.get_id(),
-                                    frame_pos,
-                                    path_, filename_,
-                                    frame);
-        memcache_.save(key_frame_shot);
-
-        // found human and get bound in rectangle
-        vector<Rect> found_rects(HumanDetect(frame));
+        FrameId frame_id(VideoId(ip_camera.get_camera_id(), video_id),
+                         frame_pos);
+        filename_ = frame_id.to_string() + ".jpeg";
+        KeyframeShot key_frame_shot(frame_id, path_, filename_);
+        // written and saved by a worker, here only if its queue is full
+        KeyframeWriter &keyframe_writer = SharedKeyframeWriter();
+        if (!keyframe_writer.submit(pooled_frame, key_frame_shot) &&
+                keyframe_writer.write(frame, key_frame_shot))
+            memcache_.save(key_frame_shot);
+
+        // found human on the proxy and get bound in rectangle of the frame
+        vector<Rect> found_rects;
+        vector<Rect> proxy_rects(person_detector_.detect(proxy));
+        for (size_t i = 0; i < proxy_rects.size(); i++) {
+            Rect r = ScaleRect(proxy_rects[i], proxy.size(), frame.size());
+            // sequence of a person shot id has 2 digits
+            if (r.area() > 0 && found_rects.size() <= kMaxShotSequence)
+                found_rects.push_back(r);
+        }
+        signal.keyframe = true;
+        signal.persons = found_rects.size();
+        signal.rects = found_rects;
+        int64_t timestamp = GetEpochMsNow();
+        vector<PersonShot> person_shots;
+        Mat person_image;   // its buffer is reused for every person
 
         for (size_t i = 0; i < found_rects.size(); i++) {
 #ifndef NOGDEBUG
@@ -68,20 +84,11 @@ void Extractor::handler(const IPCamera ip_camera, const string &video_id,
             imshow("cut", frame_show);
 #endif
 
-            Mat person_image;
-
-            try {
-                frame(found_rects[i]).copyTo(person_image);
-                // person_image = frame.clone(found_rects[i]);
-            } catch (const char *e) {
-                LogError(e);
-            }
-
 #ifndef NOGDEBUG
-            imshow("person shot raw", person_image);
+            imshow("person shot raw", frame(found_rects[i]));
 #endif
 
-            resize(person_image, person_image, Size(48, 128), 0, 0, INTER_AREA);
+            CropPerson(frame, found_rects[i], person_image);
 
 #ifndef NOGDEBUG
             imshow("person shot", person_image);
@@ -97,22 +104,26 @@ void Extractor::handler(const IPCamera ip_camera, const string &video_id,
 			rect.push_back(found_rects[i].x + found_rects[i].width);
 			rect.push_back(found_rects[i].y + found_rects[i].height);
 
-            PersonShot person_shot(i,
-                                   ip_camera.get_id(),
-                                   video_id,
-                                   key_frame_shot.get_id(),
-                                   frame_pos,
+            PersonShot person_shot(PersonShotId(frame_id, i),
+                                   timestamp,
                                    rect,
                                    person_feature);
             memcache_.save(person_shot);
+            person_shots.push_back(person_shot);
 #ifndef NOGDEBUG
         cout << "Proper vector save done!" << endl;
 #endif
         }
 
+        // link person shots into tracks
+        SharedTracker().update(ip_camera.get_camera_id(), timestamp,
+                               person_shots);
+
         // update frame refer
-        set_frame_refer(frame);
+        set_frame_refer(pooled_proxy);
     }
+
+    return signal;
 }
 
 // Judge keyframe by diff frame.
@@ -183,61 +194,3 @@ bool HistDiff(const Mat &frame_t1, const Mat &frame_t2)
 
     return true;
 }
-
-// Human detect.
-//
-vector<Rect> HumanDetect(const Mat &frame)
-{
-    vector<Rect> found_rects, found_rects_filtered;
-
-    // prepare HOG descripter
-    try {
-        // for OpenCV 2.4.9
-        // gpu::HOGDescriptor gpu_hog(Size(64, 128), Size(16, 16), Size(8, 8), Size(8, 8), 9,
-        //                            cv::gpu::HOGDescriptor::DEFAULT_WIN_SIGMA, 0.2, true,
-        //                            cv::gpu::HOGDescriptor::DEFAULT_NLEVELS);
-        // gpu_hog.setSVMDetector(gpu::HOGDescriptor::getDefaultPeopleDetector());
-
-        // gpu::GpuMat frame_gpu(frame);
-        // gpu_hog.detectMultiScale(frame_gpu, found_rects, 0, Size(8, 8), Size(0, 0), 1.05, 2);
-
-        // for OpenCV 3.0
-        // Ptr<cuda::HOG> gpu_hog = cuda::HOG::create();
-        // gpu_hog->setSVMDetector(gpu_hog->getDefaultPeopleDetector());
-
-        // cuda::GpuMat gpu_img(frame);
-        // gpu_hog->detectMultiScale(gpu_img, found_rects);
-    } catch (const char *e) {
-        LogError("No gpu support. Move to cpu hog.");
-    }
-
-    HOGDescriptor cpu_hog;
-    cpu_hog.setSVMDetector(HOGDescriptor::getDefaultPeopleDetector());
-    cpu_hog.detectMultiScale(frame, found_rects, 0, Size(8,8), Size(32, 32), 1.05, 2);
-
-    for (size_t i = 0; i < found_rects.size(); i++) {
-        Rect r = found_rects[i];
-        // to fix over bound bug
-        // if (flag) continue;
-        bool overbound = !(0 <= r.x && 0 <= r.width &&
-                           r.x + r.width <= frame.cols &&
-                           0 <= r.y && 0 <= r.height &&
-                           r.y + r.height <= frame.rows);
-        if (overbound) continue;
-
-        size_t j = 0;
-        for (j = 0; j < found_rects.size(); j++)
-            if (j != i && (r & found_rects[j]) == r) break;
-        if (j == found_rects.size())
-            found_rects_filtered.push_back(r);
-    }
-
-    for (size_t i = 0; i<found_rects_filtered.size(); i++) {
-        found_rects_filtered[i].x += cvRound(found_rects_filtered[i].width*0.2);
-        found_rects_filtered[i].width = cvRound(found_rects_filtered[i].width*0.6);
-        found_rects_filtered[i].y += cvRound(found_rects_filtered[i].height*0.07);
-        found_rects_filtered[i].height = cvRound(found_rects_filtered[i].height*0.8);
-    }
-
-    return found_rects_filtered;
-}
@@ -7,7 +7,11 @@
 //  S2: Cut fixed photos with person from key frames.
 //  S3: Convert photo into vector.
 //
-// Input: VideoCapture, current frame
+// Input: current frame and its analytics proxy
+//
+// Keyframe and human detection run on the proxy, a downscaled copy of
+// the frame, and detections are mapped back to the frame for the crops,
+// so their cost follows the proxy size instead of the camera's.
 //
 #ifndef EXTRACTOR_H
 #define EXTRACTOR_H
@@ -20,37 +24,45 @@
 #include "redisclient/redissyncclient.h"
 #include "RBML/getfeature.h"
 #include "gdatatype.h"
+#include "framepool.h"
 #include "memcache.h"
+#include "persondetector.h"
 
 using namespace std;
 using namespace cv;
 
+// what a frame turned out to be, for event triggers
+struct ExtractorSignal {
+    ExtractorSignal() : keyframe(false), persons(0) {}
+
+    bool keyframe;      // a new keyframe
+    size_t persons;     // persons detected in the keyframe
+    vector<Rect> rects; // of the persons, on the frame
+};
+
 class Extractor {
 public:
     Extractor();
     ~Extractor() {}
 
-    void set_frame_refer(const Mat &frame);
+    void set_frame_refer(const Frame &proxy);
     bool is_init() { return is_init_; }
 
-    // new frame filter
-    void handler(const IPCamera ip_camera, const string &video_id,
-                 const size_t frame_pos,const Mat &frame);
+    // new frame filter, proxy may be frame itself. Frames are held, not
+    // copied, when the extractor needs them later.
+    ExtractorSignal handler(const IPCamera ip_camera, const uint64_t video_id,
+                            const size_t frame_pos, const Frame &frame,
+                            const Frame &proxy);
 
 private:
-    // id (char[27]): cam_id + video_id + frame_pos + sequence
-    string get_id(const string &cam_id,
-                  const string &video_id,
-                  const size_t &frame_pos,
-                  const int sequence);
-
-private:
-    Mat frame_refer_;   // frame reference
+    Frame frame_refer_; // frame reference, a proxy
     bool is_init_;      // default false
-    // for imwrite
+    // of the keyframes, see KeyframeWriter
     string path_;
     string filename_;
 
+    // HOG set up once
+    PersonDetector person_detector_;
     // using to get feature and PCA
     GetFeature get_feature_;
 
@@ -66,8 +78,4 @@ bool FrameDiff(const Mat &frame_t1, const Mat &frame_t2);
 //
 bool HistDiff(const Mat &frame_t1, const Mat &frame_t2);
 
-// Human detect.
-//
-vector<Rect> HumanDetect(const Mat &frame);
-
 #endif // EXTRACTOR_H
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "frameindex.h"
+#include "sugar/sugar.h"
+
+using std::string;
+
+static const char kMagic[4] = { 'G', 'I', 'D', 'X' };
+static const uint32_t kVersion = 2;
+
+// bytes on disk, see the layout in frameindex.h
+static const size_t kHeaderBytes = 20;
+static const size_t kEntryBytes = 16;
+static const size_t kEntryBytesV1 = 24;    // with the cluster offset
+
+// little endian, whatever the host is
+//
+static inline void PutLE(uint8_t *p, uint64_t value, const size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i) {
+        p[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+static inline uint64_t GetLE(const uint8_t *p, const size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = bytes; i-- > 0; )
+        value = value << 8 | p[i];
+
+    return value;
+}
+
+void FrameIndex::set_time_base(const int num, const int den)
+{
+    time_base_num_ = num;
+    time_base_den_ = den;
+}
+
+void FrameIndex::add(const int64_t pts, const bool is_key)
+{
+    FrameIndexEntry entry;
+    if (is_key)
+        key_pos_ = (uint32_t)entries_.size();
+
+    entry.pts = pts;
+    entry.key_pos = key_pos_;
+    entry.flags = is_key ? FrameIndexEntry::kFrameKey : 0;
+    entries_.push_back(entry);
+}
+
+void FrameIndex::set(const size_t frame_pos, const int64_t pts,
+                     const bool is_key)
+{
+    if (frame_pos < entries_.size()) {
+        LogError("Frame index goes backwards.");
+        return;
+    }
+
+    FrameIndexEntry missing;
+    missing.pts = pts;
+    missing.flags = FrameIndexEntry::kFrameMissing;
+    while (entries_.size() < frame_pos) {
+        // a GOP never spans a gap
+        missing.key_pos = key_pos_ = (uint32_t)entries_.size();
+        entries_.push_back(missing);
+    }
+
+    add(pts, is_key);
+}
+
+void FrameIndex::clear()
+{
+    entries_.clear();
+    time_base_num_ = 1;
+    time_base_den_ = 1000;
+    key_pos_ = 0;
+}
+
+bool FrameIndex::save(const string &path) const
+{
+    // the whole file in one write
+    std::vector<uint8_t> buffer(kHeaderBytes + entries_.size() * kEntryBytes);
+    uint8_t *p = &buffer[0];
+    memcpy(p, kMagic, sizeof(kMagic));
+    PutLE(p + 4, kVersion, 4);
+    PutLE(p + 8, entries_.size(), 4);
+    PutLE(p + 12, (uint32_t)time_base_num_, 4);
+    PutLE(p + 16, (uint32_t)time_base_den_, 4);
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        p = &buffer[kHeaderBytes + i * kEntryBytes];
+        PutLE(p, (uint64_t)entries_[i].pts, 8);
+        PutLE(p + 8, entries_[i].key_pos, 4);
+        PutLE(p + 12, entries_[i].flags, 4);
+    }
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        LogError("Fail to create frame index.");
+        return false;
+    }
+
+    bool ok = fwrite(&buffer[0], buffer.size(), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok)
+        LogError("Fail to write frame index.");
+
+    return ok;
+}
+
+bool FrameIndex::load(const string &path)
+{
+    clear();
+
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return false;
+
+    uint8_t header[kHeaderBytes];
+    bool ok = fread(header, sizeof(header), 1, fp) == 1 &&
+              memcmp(header, kMagic, sizeof(kMagic)) == 0;
+    uint32_t version = ok ? (uint32_t)GetLE(header + 4, 4) : 0;
+    size_t entry_bytes = version == kVersion ? kEntryBytes :
+                         version == 1 ? kEntryBytesV1 : 0;
+    ok = ok && entry_bytes > 0;
+
+    std::vector<uint8_t> buffer;
+    if (ok) {
+        entries_.resize((uint32_t)GetLE(header + 8, 4));
+        buffer.resize(entries_.size() * entry_bytes);
+        if (!buffer.empty())
+            ok = fread(&buffer[0], buffer.size(), 1, fp) == 1;
+        time_base_num_ = (int32_t)GetLE(header + 12, 4);
+        time_base_den_ = (int32_t)GetLE(header + 16, 4);
+    }
+    fclose(fp);
+
+    // version 1 has the cluster offset between pts and key_pos
+    const size_t skip = entry_bytes - kEntryBytes;
+    for (size_t i = 0; ok && i < entries_.size(); ++i) {
+        const uint8_t *p = &buffer[i * entry_bytes];
+        entries_[i].pts = (int64_t)GetLE(p, 8);
+        entries_[i].key_pos = (uint32_t)GetLE(p + 8 + skip, 4);
+        entries_[i].flags = (uint32_t)GetLE(p + 12 + skip, 4);
+        ok = entries_[i].key_pos <= i;
+    }
+
+    if (!ok) {
+        LogError("Bad frame index.");
+        clear();
+    }
+
+    return ok;
+}
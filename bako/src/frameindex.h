@@ -0,0 +1,81 @@
+#ifndef FRAMEINDEX_H
+#define FRAMEINDEX_H
+
+//
+// Frame index of a video piece, saved as a sidecar next to it
+// (filename + ".idx").
+//
+// Entry i is frame_pos i of the piece, so a lookup is O(1):
+//  pts: in the time base of the piece's video stream, keyframes are
+//      sought by it.
+//  key_pos: frame_pos of the nearest preceding keyframe.
+// Frames which were not recorded (see RecordPolicy) are kept as missing
+// entries so that frame_pos stays the position in the stream.
+//
+// Binary layout, little endian whatever the host is:
+//  header: "GIDX", uint32 version, uint32 frames,
+//          int32 time_base num, int32 time_base den
+//  entries: frames x { int64 pts, uint32 key_pos, uint32 flags }
+// Version 1 had an int64 cluster offset after pts, which is skipped.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using std::string;
+
+struct FrameIndexEntry {
+    int64_t pts;
+    uint32_t key_pos;
+    uint32_t flags;     // kFrameKey, kFrameMissing
+
+    static const uint32_t kFrameKey = 1;
+    static const uint32_t kFrameMissing = 2;
+
+    bool is_key() const { return (flags & kFrameKey) != 0; }
+    bool is_missing() const { return (flags & kFrameMissing) != 0; }
+};
+
+class FrameIndex {
+public:
+    FrameIndex() { clear(); }
+    ~FrameIndex() {}
+
+    void set_time_base(const int num, const int den);
+    // append the next frame
+    void add(const int64_t pts, const bool is_key);
+    // set frame_pos, frames skipped before it are missing
+    void set(const size_t frame_pos, const int64_t pts, const bool is_key);
+    void clear();
+
+    bool save(const string &path) const;
+    bool load(const string &path);
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    const FrameIndexEntry &at(const size_t frame_pos) const
+    { return entries_[frame_pos]; }
+    // keyframe the frame's GOP starts from
+    const FrameIndexEntry &keyframe(const size_t frame_pos) const
+    { return entries_[entries_[frame_pos].key_pos]; }
+
+    int get_time_base_num() const { return time_base_num_; }
+    int get_time_base_den() const { return time_base_den_; }
+
+private:
+    std::vector<FrameIndexEntry> entries_;
+    int time_base_num_, time_base_den_;
+    uint32_t key_pos_;      // of the last keyframe added
+};
+
+// filename of the sidecar of a video piece
+//
+inline string FrameIndexPath(const string &video_path)
+{
+    return video_path + ".idx";
+}
+
+#endif // FRAMEINDEX_H
@@ -0,0 +1,110 @@
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "framepool.h"
+
+// give a buffer back to its pool, or drop it
+//
+static void ReleaseBuffer(const std::shared_ptr<FramePoolState> &state,
+                          cv::Mat *mat)
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        // the first buffer back sizes a pool created without one
+        if (state->rows == 0 && !mat->empty() && mat->type() == state->type) {
+            state->rows = mat->rows;
+            state->cols = mat->cols;
+        }
+        // a buffer a stage resized is not the pool's any more
+        bool fits = mat->rows == state->rows && mat->cols == state->cols &&
+                    mat->type() == state->type && mat->isContinuous();
+        if (fits && state->free.size() < state->capacity)
+            state->free.push_back(*mat);
+    }
+
+    // outside of the lock, it may free the data
+    delete mat;
+}
+
+Frame AcquireFrame(const std::shared_ptr<FramePoolState> &state)
+{
+    cv::Mat *mat = new cv::Mat;
+    // the size as of the lock, ReleaseBuffer() sets it under the lock
+    int rows, cols, type;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->free.empty()) {
+            *mat = state->free.back();
+            state->free.pop_back();
+        } else {
+            state->misses++;
+        }
+        rows = state->rows;
+        cols = state->cols;
+        type = state->type;
+    }
+
+    // allocated outside of the lock, the caller's create() allocates when
+    // the size is not known yet
+    if (mat->empty() && rows > 0)
+        mat->create(rows, cols, type);
+
+    Frame frame;
+    frame.mat_.reset(mat, [state](cv::Mat *m) { ReleaseBuffer(state, m); });
+    frame.state_ = state;
+
+    return frame;
+}
+
+const cv::Mat &Frame::view() const
+{
+    static const cv::Mat kEmpty;
+
+    return mat_ ? *mat_ : kEmpty;
+}
+
+cv::Mat &Frame::mutable_view()
+{
+    if (mat_ && !unique()) {
+        Frame copy = AcquireFrame(state_);
+        mat_->copyTo(*copy.mat_);
+        mat_.swap(copy.mat_);
+    }
+
+    return *mat_;
+}
+
+FramePool::FramePool(const size_t capacity, const int rows, const int cols,
+                     const int type)
+    : state_(new FramePoolState)
+{
+    state_->capacity = capacity;
+    state_->rows = rows > 0 && cols > 0 ? rows : 0;
+    state_->cols = rows > 0 && cols > 0 ? cols : 0;
+    state_->type = type;
+    state_->misses = 0;
+
+    for (size_t i = 0; state_->rows > 0 && i < capacity; ++i)
+        state_->free.push_back(cv::Mat(state_->rows, state_->cols, type));
+}
+
+Frame FramePool::acquire()
+{
+    return AcquireFrame(state_);
+}
+
+size_t FramePool::get_free()
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+
+    return state_->free.size();
+}
+
+size_t FramePool::get_misses()
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+
+    return state_->misses;
+}
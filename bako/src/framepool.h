@@ -0,0 +1,90 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+//
+// Ref-counted frames from a pool of preallocated buffers.
+//
+// A Frame is a shared handle on a pooled cv::Mat: copying a Frame copies
+// the handle, and the buffer goes back to its pool when the last handle
+// is released. Every stage (extractor, forwarder, ...) holds the frames
+// it needs as Frames, so nothing has to be cloned to outlive the capture
+// loop, and the loop reuses the buffers once the stages let go of them.
+//
+// view() is read-only. mutable_view() copies the buffer first when
+// another handle shares it (copy on write). A cv::Mat taken from view()
+// is only valid while a Frame of the buffer is held.
+//
+// Buffers are allocated up front at the stream resolution, so steady
+// state capture allocates nothing. When every buffer is held, acquire()
+// allocates one more instead of blocking, and counts a miss.
+//
+// @Zhiqiang He
+//
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+struct FramePoolState;
+class Frame;
+
+// frame of state's pool, for FramePool and copy on write
+//
+Frame AcquireFrame(const std::shared_ptr<FramePoolState> &state);
+
+// free buffers and their size, shared by the pool and its frames
+struct FramePoolState {
+    std::mutex mutex;
+    std::vector<cv::Mat> free;
+    size_t capacity;
+    int rows, cols, type;   // 0 rows until known, see FramePool
+    size_t misses;
+};
+
+class Frame {
+public:
+    Frame() {}
+    ~Frame() {}
+
+    bool empty() const { return !mat_; }
+    // whether this is the only handle of the buffer
+    bool unique() const { return mat_.use_count() == 1; }
+    void release() { mat_.reset(); state_.reset(); }
+
+    const cv::Mat &view() const;
+    // the frame must not be empty
+    cv::Mat &mutable_view();
+
+private:
+    friend Frame AcquireFrame(const std::shared_ptr<FramePoolState> &state);
+
+    std::shared_ptr<cv::Mat> mat_;
+    std::shared_ptr<FramePoolState> state_;     // to copy on write
+};
+
+class FramePool {
+public:
+    // rows x cols of type, rows 0 to take the size of the first buffer
+    // given back
+    FramePool(const size_t capacity, const int rows, const int cols,
+              const int type = CV_8UC3);
+    ~FramePool() {}
+
+    Frame acquire();
+
+    size_t get_capacity() const { return state_->capacity; }
+    size_t get_free();
+    // acquires which found no free buffer
+    size_t get_misses();
+
+private:
+    FramePool(const FramePool &);
+    FramePool &operator=(const FramePool &);
+
+    // buffers outlive the pool while frames hold them
+    std::shared_ptr<FramePoolState> state_;
+};
+
+#endif // FRAMEPOOL_H
@@ -0,0 +1,355 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+#include "framering.h"
+#include "sugar/sugar.h"
+
+using std::string;
+
+static const uint32_t kFrameRingVersion = 2;
+// reader polls spinning first, then sleeping
+static const int kSpinPolls = 200;
+static const int kSleepUs = 200;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared memory needs lock-free 64-bit atomics");
+
+static size_t HeaderSize()
+{
+    // slots start cache line aligned
+    return (sizeof(FrameRingHeader) + 63) / 64 * 64;
+}
+
+static FrameRingSlot *SlotAt(const FrameRingHeader *header, const size_t i)
+{
+    return (FrameRingSlot *)((char *)header + HeaderSize() +
+                             i * header->slot_size);
+}
+
+static char *SlotData(FrameRingSlot *slot)
+{
+    return (char *)slot + sizeof(FrameRingSlot);
+}
+
+static size_t FrameBytes(const int rows, const int cols, const int type)
+{
+    return (size_t)rows * cols * CV_ELEM_SIZE(type);
+}
+
+FrameRing::FrameRing(const string &name, const size_t slots)
+{
+    name_ = name;
+    slots_ = slots < 2 ? 2 : slots;
+    header_ = NULL;
+    size_ = 0;
+    published_ = rejected_ = 0;
+}
+
+FrameRing::~FrameRing()
+{
+    if (header_ == NULL)
+        return;
+
+    munmap(header_, size_);
+    shm_unlink(name_.c_str());
+}
+
+bool FrameRing::create(const cv::Mat &frame)
+{
+    size_t slot_size = (sizeof(FrameRingSlot) +
+                        FrameBytes(frame.rows, frame.cols, frame.type()) +
+                        63) / 64 * 64;
+    size_t size = HeaderSize() + slots_ * slot_size;
+
+    // a segment left by a writer which died is made again
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        LogError("Fail to create frame ring.");
+        return false;
+    }
+    if (ftruncate(fd, size) != 0) {
+        LogError("Fail to size frame ring.");
+        ::close(fd);
+        shm_unlink(name_.c_str());
+        return false;
+    }
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        LogError("Fail to map frame ring.");
+        shm_unlink(name_.c_str());
+        return false;
+    }
+
+    // the new segment is zeroed, so every sequence starts at 0
+    header_ = new (addr) FrameRingHeader;
+    header_->version = kFrameRingVersion;
+    header_->slots = slots_;
+    header_->rows = frame.rows;
+    header_->cols = frame.cols;
+    header_->type = frame.type();
+    header_->slot_size = slot_size;
+    header_->head.store(0);
+    for (size_t i = 0; i < slots_; i++)
+        new (SlotAt(header_, i)) FrameRingSlot;
+    size_ = size;
+
+    // readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header_->magic, "GRNG", 4);
+
+    return true;
+}
+
+bool FrameRing::publish(const cv::Mat &frame, const uint64_t video_id,
+                        const size_t frame_pos,
+                        const std::vector<cv::Rect> &rects)
+{
+    if (frame.empty())
+        return false;
+    if (header_ == NULL && !create(frame))
+        return false;
+    if (frame.rows != header_->rows || frame.cols != header_->cols ||
+            frame.type() != header_->type) {
+        rejected_++;
+        return false;
+    }
+
+    uint64_t n = header_->head.load(std::memory_order_relaxed) + 1;
+    FrameRingSlot *slot = SlotAt(header_, n % header_->slots);
+
+    // odd while the slot is filled
+    slot->sequence.store(2 * n - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->video_id = video_id;
+    slot->frame_pos = (uint32_t)frame_pos;
+    slot->rects = std::min(rects.size(), kFrameRingRects);
+    for (size_t i = 0; i < slot->rects; i++) {
+        slot->rect[i][0] = rects[i].x;
+        slot->rect[i][1] = rects[i].y;
+        slot->rect[i][2] = rects[i].width;
+        slot->rect[i][3] = rects[i].height;
+    }
+    char *data = SlotData(slot);
+    if (frame.isContinuous()) {
+        memcpy(data, frame.data, FrameBytes(frame.rows, frame.cols,
+                                            frame.type()));
+    } else {
+        size_t row_bytes = FrameBytes(1, frame.cols, frame.type());
+        for (int i = 0; i < frame.rows; i++)
+            memcpy(data + i * row_bytes, frame.ptr(i), row_bytes);
+    }
+    slot->published = SteadyNs();
+
+    slot->sequence.store(2 * n, std::memory_order_release);
+    header_->head.store(n, std::memory_order_release);
+    published_++;
+
+    return true;
+}
+
+FrameRingReader::FrameRingReader()
+{
+    header_ = NULL;
+    last_ = 0;
+    read_ = skipped_ = retries_ = 0;
+}
+
+FrameRingReader::~FrameRingReader()
+{
+    close();
+}
+
+bool FrameRingReader::open(const string &name)
+{
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= HeaderSize())
+        addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    const FrameRingHeader *header = (const FrameRingHeader *)addr;
+    bool ok = memcmp(header->magic, "GRNG", 4) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!ok || header->version != kFrameRingVersion ||
+            HeaderSize() + header->slots * header->slot_size >
+            (size_t)st.st_size) {
+        munmap(addr, st.st_size);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    mapping_.reset(addr, [size](void *p) { munmap(p, size); });
+    header_ = header;
+    // frames before opening are not skipped ones
+    last_ = header_->head.load(std::memory_order_acquire);
+
+    return true;
+}
+
+void FrameRingReader::close()
+{
+    // unmapped once the views handed out are gone too
+    mapping_.reset();
+    header_ = NULL;
+}
+
+uint64_t FrameRingReader::wait_after(const uint64_t frame,
+                                     const int64_t deadline)
+{
+    for (int polls = 0; ; polls++) {
+        uint64_t n = header_->head.load(std::memory_order_acquire);
+        if (n == frame) {
+            if (SteadyNs() >= deadline)
+                return 0;
+            if (polls < kSpinPolls)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(
+                        std::chrono::microseconds(kSleepUs));
+            continue;
+        }
+
+        // newest frame, older ones are skipped
+        if (valid(n))
+            return n;
+        retries_++;
+    }
+}
+
+void FrameRingReader::count_read(const uint64_t frame)
+{
+    // read again by peek_newest()
+    if (frame > last_) {
+        skipped_ += frame - last_ - 1;
+        last_ = frame;
+    }
+    read_++;
+}
+
+void FrameRingReader::fill_view(const uint64_t frame,
+                                FrameRingView &view) const
+{
+    FrameRingSlot *slot = SlotAt(header_, frame % header_->slots);
+    view.frame = frame;
+    view.video_id = slot->video_id;
+    view.frame_pos = slot->frame_pos;
+    view.rows = header_->rows;
+    view.cols = header_->cols;
+    view.type = header_->type;
+    view.data = (const uchar *)SlotData(slot);
+    view.rects = std::min((size_t)slot->rects, kFrameRingRects);
+    view.rect = &slot->rect[0][0];
+}
+
+bool FrameRingReader::next(cv::Mat &frame, FrameRingInfo &info,
+                           const int timeout_ms)
+{
+    if (header_ == NULL)
+        return false;
+
+    int64_t deadline = SteadyNs() + (int64_t)timeout_ms * 1000000;
+    frame.create(header_->rows, header_->cols, header_->type);
+    size_t bytes = FrameBytes(header_->rows, header_->cols, header_->type);
+
+    while (1) {
+        uint64_t n = wait_after(last_, deadline);
+        if (n == 0)
+            return false;
+
+        FrameRingSlot *slot = SlotAt(header_, n % header_->slots);
+        info.frame = n;
+        info.video_id = slot->video_id;
+        info.frame_pos = slot->frame_pos;
+        info.published = slot->published;
+        size_t rects = std::min((size_t)slot->rects, kFrameRingRects);
+        info.rects.resize(rects);
+        for (size_t i = 0; i < rects; i++)
+            info.rects[i] = cv::Rect(slot->rect[i][0], slot->rect[i][1],
+                                     slot->rect[i][2], slot->rect[i][3]);
+        memcpy(frame.data, SlotData(slot), bytes);
+
+        // the writer may have come around while copying
+        if (!valid(n)) {
+            retries_++;
+            continue;
+        }
+
+        count_read(n);
+        return true;
+    }
+}
+
+bool FrameRingReader::peek(FrameRingView &view, const int timeout_ms)
+{
+    if (header_ == NULL)
+        return false;
+
+    uint64_t n = wait_after(last_,
+                            SteadyNs() + (int64_t)timeout_ms * 1000000);
+    if (n == 0)
+        return false;
+
+    fill_view(n, view);
+    count_read(n);
+    return true;
+}
+
+bool FrameRingReader::peek_newest(FrameRingView &view)
+{
+    if (header_ == NULL)
+        return false;
+
+    // no waiting, unless the writer is overwriting the newest slot
+    uint64_t n = wait_after(0, SteadyNs());
+    if (n == 0)
+        return false;
+
+    fill_view(n, view);
+    count_read(n);
+    return true;
+}
+
+bool FrameRingReader::valid(const uint64_t frame) const
+{
+    if (header_ == NULL || frame == 0)
+        return false;
+
+    // reads of the slot before this are done
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const FrameRingSlot *slot = SlotAt(header_, frame % header_->slots);
+
+    return slot->sequence.load(std::memory_order_acquire) == 2 * frame;
+}
+
+string FrameRingName(const CameraId &camera_id)
+{
+    return "/gee-frames-" + camera_id.to_string();
+}
+
+int64_t SteadyNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
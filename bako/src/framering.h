@@ -0,0 +1,169 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+//
+// FrameRing: live frames of a camera for local consumers, through a ring
+// of slots in POSIX shared memory.
+//
+// One writer, the capture loop, copies each frame into the next slot.
+// Every slot has a sequence number used as a seqlock: it is odd while
+// the writer fills the slot and 2 * n once frame n is in it. The writer
+// never waits for readers, it overwrites the oldest slot.
+//
+// A reader always takes the newest frame, the frames it was too slow for
+// are skipped and counted. peek_newest() takes it even if it was read
+// already, for consumers polling faster than frames come. It copies the slot out, then checks that the
+// sequence number did not change, and retries with the newest frame if
+// the writer came around in the meantime. A reader which keeps timing
+// out may open() again, to follow a writer which was restarted.
+//
+// Each frame carries the persons found in the camera's latest keyframe,
+// so local consumers (the actor) show frames and boxes without decoding
+// or detecting again. peek() hands out the slot itself instead of a
+// copy, the consumer checks valid() once done with it.
+//
+// Layout: FrameRingHeader, then slots x { FrameRingSlot, data }. The
+// segment is made on the first frame, sized for it, so frames of another
+// size are not published. Readers map it read-only.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "shotid.h"
+
+using std::string;
+
+static const size_t kFrameRingSlots = 4;
+// persons of a frame, as many as a keyframe saves
+static const size_t kFrameRingRects = kMaxShotSequence + 1;
+
+struct FrameRingHeader {
+    char magic[4];              // "GRNG"
+    uint32_t version;
+    uint32_t slots;
+    int32_t rows, cols, type;   // of every frame
+    uint64_t slot_size;         // bytes of a slot with its data
+    std::atomic<uint64_t> head; // newest frame published, 0 none
+};
+
+struct FrameRingSlot {
+    std::atomic<uint64_t> sequence;     // seqlock, 2 * frame
+    uint64_t video_id;
+    uint32_t frame_pos;
+    int64_t published;          // steady clock ns, to measure latency
+    uint32_t rects;
+    int32_t rect[kFrameRingRects][4];   // x, y, width, height
+};
+
+// what a reader gets with a frame
+struct FrameRingInfo {
+    uint64_t frame;             // 1, 2, ... in publish order
+    uint64_t video_id;
+    size_t frame_pos;
+    int64_t published;          // steady clock ns
+    std::vector<cv::Rect> rects;
+};
+
+// a slot as it is in the ring, only while valid(frame)
+struct FrameRingView {
+    uint64_t frame;
+    uint64_t video_id;
+    size_t frame_pos;
+    int rows, cols, type;
+    const uchar *data;
+    size_t rects;
+    const int32_t *rect;        // rects x { x, y, width, height }
+};
+
+class FrameRing {
+public:
+    // name as in shm_open, see FrameRingName()
+    FrameRing(const string &name, const size_t slots = kFrameRingSlots);
+    // unlinks the segment, readers keep what they mapped
+    ~FrameRing();
+
+    // copy frame and its persons into the next slot, false if it does not
+    // fit the ring
+    bool publish(const cv::Mat &frame, const uint64_t video_id,
+                 const size_t frame_pos,
+                 const std::vector<cv::Rect> &rects = std::vector<cv::Rect>());
+
+    uint64_t get_published() const { return published_; }
+    // frames dropped for their size
+    uint64_t get_rejected() const { return rejected_; }
+
+private:
+    FrameRing(const FrameRing &);
+    FrameRing &operator=(const FrameRing &);
+
+    bool create(const cv::Mat &frame);
+
+    string name_;
+    size_t slots_;
+    FrameRingHeader *header_;
+    size_t size_;               // bytes mapped
+    uint64_t published_, rejected_;
+};
+
+class FrameRingReader {
+public:
+    FrameRingReader();
+    ~FrameRingReader();
+
+    // false while the writer has not made the segment yet
+    bool open(const string &name);
+    void close();
+    bool is_open() const { return header_ != NULL; }
+
+    // newest frame after the last one read, false on timeout
+    bool next(cv::Mat &frame, FrameRingInfo &info, const int timeout_ms);
+    // as next() without copying, the view is overwritten once the writer
+    // comes around
+    bool peek(FrameRingView &view, const int timeout_ms);
+    // as peek() for the newest frame published, read before or not, false
+    // only when there is none
+    bool peek_newest(FrameRingView &view);
+    // whether frame is still in its slot, a view of it read before is
+    // whole if it is
+    bool valid(const uint64_t frame) const;
+
+    // keeps the segment mapped for views which outlive the reader
+    std::shared_ptr<const void> get_mapping() const { return mapping_; }
+
+    uint64_t get_read() const { return read_; }
+    // frames published between two reads which were not read
+    uint64_t get_skipped() const { return skipped_; }
+    // reads which raced with the writer and were done again
+    uint64_t get_retries() const { return retries_; }
+
+private:
+    FrameRingReader(const FrameRingReader &);
+    FrameRingReader &operator=(const FrameRingReader &);
+
+    // newest frame after frame when its slot is complete, 0 on timeout
+    uint64_t wait_after(const uint64_t frame, const int64_t deadline);
+    void count_read(const uint64_t frame);
+    void fill_view(const uint64_t frame, FrameRingView &view) const;
+
+    std::shared_ptr<const void> mapping_;
+    const FrameRingHeader *header_;
+    uint64_t last_;             // last frame read
+    uint64_t read_, skipped_, retries_;
+};
+
+// "/gee-frames-" + camera id
+//
+string FrameRingName(const CameraId &camera_id);
+
+// steady clock ns, comparable between processes
+//
+int64_t SteadyNs();
+
+#endif // FRAMERING_H
@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "frameseeker.h"
+#include "sugar/sugar.h"
+
+using std::string;
+
+FrameSeeker::FrameSeeker()
+{
+    packet_ = av_packet_alloc();
+    next_pos_ = -1;
+}
+
+FrameSeeker::~FrameSeeker()
+{
+    close();
+    av_packet_free(&packet_);
+}
+
+bool FrameSeeker::open(const string &video_path)
+{
+    close();
+
+    if (!index_.load(FrameIndexPath(video_path))) {
+        LogError("No frame index for video.");
+        return false;
+    }
+    if (!input_.open(video_path)) {
+        index_.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void FrameSeeker::close()
+{
+    input_.close();
+    index_.clear();
+    next_pos_ = -1;
+}
+
+bool FrameSeeker::seek(const size_t frame_pos, cv::Mat &frame)
+{
+    if (!is_open() || frame_pos >= index_.size() ||
+            index_.keyframe(frame_pos).is_missing())
+        return false;
+
+    const FrameIndexEntry &key = index_.keyframe(frame_pos);
+    const FrameIndexEntry &target = index_.at(frame_pos);
+
+    // go back to the keyframe unless the decoder is already in the GOP
+    // and before the frame
+    if (next_pos_ < 0 || (size_t)next_pos_ > frame_pos ||
+            (size_t)next_pos_ < target.key_pos) {
+        if (!input_.seek(key.pts)) {
+            LogError("Fail to seek video.");
+            next_pos_ = -1;
+            return false;
+        }
+        next_pos_ = target.key_pos;
+    }
+
+    // decode the frames in between without converting them
+    while (input_.read(packet_)) {
+        int64_t pts = packet_->pts != AV_NOPTS_VALUE ? packet_->pts
+                                                     : packet_->dts;
+        bool done = pts >= target.pts;
+        bool ok = done ? input_.decode(packet_, frame)
+                       : input_.decode(packet_);
+        av_packet_unref(packet_);
+
+        if (!ok) {
+            next_pos_ = -1;
+            return false;
+        }
+        if (done) {
+            if (pts != target.pts) {
+                LogError("Frame index does not match video.");
+                next_pos_ = -1;
+                return false;
+            }
+            next_pos_ = frame_pos + 1;
+            return true;
+        }
+    }
+
+    next_pos_ = -1;
+    return false;
+}
+
+bool FrameSeeker::read_gop(const size_t frame_pos,
+                           std::vector<cv::Mat> &frames,
+                           cv::MatAllocator *allocator)
+{
+    frames.clear();
+    if (!is_open() || frame_pos >= index_.size() ||
+            index_.keyframe(frame_pos).is_missing())
+        return false;
+
+    // GOP runs up to the next keyframe or gap
+    size_t key_pos = index_.at(frame_pos).key_pos;
+    size_t end_pos = key_pos + 1;
+    while (end_pos < index_.size() && !index_.at(end_pos).is_key() &&
+           !index_.at(end_pos).is_missing())
+        ++end_pos;
+
+    next_pos_ = -1;
+    if (!input_.seek(index_.at(key_pos).pts)) {
+        LogError("Fail to seek video.");
+        return false;
+    }
+
+    size_t pos = key_pos;
+    while (pos < end_pos && input_.read(packet_)) {
+        int64_t pts = packet_->pts != AV_NOPTS_VALUE ? packet_->pts
+                                                     : packet_->dts;
+        // the demuxer may land before the keyframe
+        if (pts < index_.at(key_pos).pts) {
+            input_.decode(packet_);
+            av_packet_unref(packet_);
+            continue;
+        }
+
+        cv::Mat frame;
+        frame.allocator = allocator;
+        bool ok = input_.decode(packet_, frame);
+        av_packet_unref(packet_);
+        if (!ok || pts != index_.at(pos).pts) {
+            LogError("Frame index does not match video.");
+            frames.clear();
+            return false;
+        }
+
+        frames.push_back(frame);
+        ++pos;
+    }
+
+    if (pos < end_pos) {
+        frames.clear();
+        return false;
+    }
+    next_pos_ = end_pos;
+
+    return true;
+}
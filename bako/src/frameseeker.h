@@ -0,0 +1,56 @@
+#ifndef FRAMESEEKER_H
+#define FRAMESEEKER_H
+
+//
+// FrameSeeker: fetch a frame of a video piece by frame_pos.
+//
+// With the frame index sidecar a fetch seeks to the keyframe of the
+// frame's GOP and decodes forward up to the frame, so it costs at most
+// one GOP instead of decoding from the start of the piece. Fetching
+// forward inside the current GOP continues decoding without seeking.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "avstream.h"
+#include "frameindex.h"
+
+using std::string;
+
+class FrameSeeker {
+public:
+    FrameSeeker();
+    ~FrameSeeker();
+
+    // open a video piece and its sidecar
+    bool open(const string &video_path);
+    void close();
+    bool is_open() const { return input_.is_open(); }
+
+    // decode frame at frame_pos, BGR, false for frames not recorded
+    bool seek(const size_t frame_pos, cv::Mat &frame);
+    // decode the whole GOP of frame_pos, frames[0] is its keyframe,
+    // buffers come from allocator if given
+    bool read_gop(const size_t frame_pos, std::vector<cv::Mat> &frames,
+                  cv::MatAllocator *allocator = NULL);
+
+    size_t get_frames() const { return index_.size(); }
+    const FrameIndex &get_index() const { return index_; }
+
+private:
+    FrameSeeker(const FrameSeeker &);
+    FrameSeeker &operator=(const FrameSeeker &);
+
+    AVInput input_;
+    FrameIndex index_;
+    AVPacket *packet_;
+    int64_t next_pos_;      // frame_pos the decoder is about to output, -1
+                            // if unknown
+};
+
+#endif // FRAMESEEKER_H
@@ -0,0 +1,143 @@
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "frameserver.h"
+#include "frameseeker.h"
+#include "sugar/sugar.h"
+
+using std::string;
+
+// frame indexes are small, keep those of the recent pieces
+static const size_t kCachedIndexes = 64;
+
+FrameServer::FrameServer(const size_t cache_bytes,
+                         const size_t workers,
+                         cv::MatAllocator *allocator)
+      : allocator_(allocator),
+        gops_(cache_bytes),
+        indexes_(kCachedIndexes),
+        pool_(workers)
+{
+}
+
+bool FrameServer::fetch(const string &video_path, const size_t frame_pos,
+                        cv::Mat &frame)
+{
+    GopKey key;
+    if (!locate(video_path, frame_pos, key))
+        return false;
+
+    GopPtr gop = request(key).get();
+    if (!gop)
+        return false;
+
+    // shares the cached buffer
+    frame = gop->frames[frame_pos - gop->key_pos];
+    return true;
+}
+
+void FrameServer::prefetch(const string &video_path, const size_t frame_pos)
+{
+    GopKey key;
+    if (locate(video_path, frame_pos, key))
+        request(key);
+}
+
+size_t FrameServer::get_cached_gops()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return gops_.size();
+}
+
+size_t FrameServer::get_cached_bytes()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return gops_.get_cost();
+}
+
+bool FrameServer::locate(const string &video_path, const size_t frame_pos,
+                         GopKey &key)
+{
+    IndexPtr index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        indexes_.get(video_path, index);
+    }
+
+    // load outside of the lock, a race only loads it twice
+    if (!index) {
+        std::shared_ptr<FrameIndex> loaded(new FrameIndex);
+        if (!loaded->load(FrameIndexPath(video_path)))
+            return false;
+
+        index = loaded;
+        std::vector<IndexPtr> evicted;
+        std::lock_guard<std::mutex> lock(mutex_);
+        indexes_.put(video_path, index, 1, evicted);
+    }
+
+    if (frame_pos >= index->size())
+        return false;
+
+    key = GopKey(video_path, index->at(frame_pos).key_pos);
+    return true;
+}
+
+std::shared_future<FrameServer::GopPtr> FrameServer::request(
+        const GopKey &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    GopPtr gop;
+    if (gops_.get(key, gop)) {
+        std::promise<GopPtr> ready;
+        ready.set_value(gop);
+        return ready.get_future().share();
+    }
+
+    // join the decode in flight
+    std::map<GopKey, std::shared_future<GopPtr> >::iterator it =
+            pending_.find(key);
+    if (it != pending_.end())
+        return it->second;
+
+    std::shared_future<GopPtr> future =
+            pool_.submit([this, key]() { return decode(key); }).share();
+    pending_[key] = future;
+
+    return future;
+}
+
+FrameServer::GopPtr FrameServer::decode(const GopKey &key)
+{
+    std::shared_ptr<DecodedGop> gop(new DecodedGop);
+    gop->key_pos = key.second;
+
+    FrameSeeker seeker;
+    bool ok = seeker.open(key.first) &&
+              seeker.read_gop(key.second, gop->frames, allocator_);
+    if (!ok)
+        gop.reset();
+
+    size_t bytes = 0;
+    for (size_t i = 0; gop && i < gop->frames.size(); ++i)
+        bytes += gop->frames[i].total() * gop->frames[i].elemSize();
+
+    // evicted frames are released after unlocking, their allocator may
+    // need other locks (e.g. python's)
+    std::vector<GopPtr> evicted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (gop)
+            gops_.put(key, gop, bytes, evicted);
+        pending_.erase(key);
+    }
+
+    return gop;
+}
@@ -0,0 +1,155 @@
+#ifndef FRAMESERVER_H
+#define FRAMESERVER_H
+
+//
+// FrameServer: fetch frames of video pieces for the front-end.
+//
+// Decoding is done a GOP at a time on a pool of workers and the decoded
+// GOPs are kept in an LRU cache keyed by (video path, GOP), the GOP being
+// named by the frame_pos of its keyframe. Scrubbing through neighbouring
+// frames then hits the cache, and concurrent requests for a GOP which is
+// still being decoded wait on the same decode instead of starting another.
+//
+// The cache is bounded by the bytes of the decoded frames rather than by
+// GOPs, as a GOP of 1080p may take some hundred MB.
+//
+// Frames handed out share the cached buffers, they must not be written.
+// Pieces need the frame index sidecar, see FrameSeeker.
+//
+// @Zhiqiang He
+//
+
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "frameindex.h"
+#include "sugar/threadpool.h"
+
+using std::string;
+
+// LRU map from Key to Value, Value is cheap to copy (a shared_ptr).
+// Each item costs what put() says, the least recent ones are evicted
+// while the total is over capacity, except the newest one.
+//
+template <typename Key, typename Value>
+class LruCache {
+public:
+    explicit LruCache(const size_t capacity) : capacity_(capacity), cost_(0) {}
+
+    bool get(const Key &key, Value &value)
+    {
+        typename Map::iterator it = map_.find(key);
+        if (it == map_.end())
+            return false;
+
+        // move to the front
+        items_.splice(items_.begin(), items_, it->second);
+        value = it->second->value;
+        return true;
+    }
+
+    // evicted values are appended to evicted, so the caller can release
+    // them outside of its lock
+    void put(const Key &key, const Value &value, const size_t cost,
+             std::vector<Value> &evicted)
+    {
+        typename Map::iterator it = map_.find(key);
+        if (it != map_.end()) {
+            evicted.push_back(it->second->value);
+            cost_ -= it->second->cost;
+            it->second->value = value;
+            it->second->cost = cost;
+            items_.splice(items_.begin(), items_, it->second);
+        } else {
+            Item item = { key, value, cost };
+            items_.push_front(item);
+            map_[key] = items_.begin();
+        }
+        cost_ += cost;
+
+        while (cost_ > capacity_ && items_.size() > 1) {
+            evicted.push_back(items_.back().value);
+            cost_ -= items_.back().cost;
+            map_.erase(items_.back().key);
+            items_.pop_back();
+        }
+    }
+
+    size_t size() const { return items_.size(); }
+    size_t get_cost() const { return cost_; }
+
+private:
+    struct Item {
+        Key key;
+        Value value;
+        size_t cost;
+    };
+    typedef std::list<Item> List;
+    typedef std::map<Key, typename List::iterator> Map;
+
+    size_t capacity_;
+    size_t cost_;
+    List items_;
+    Map map_;
+};
+
+// decoded frames kept by default, some GOPs of 1080p
+static const size_t kFrameCacheBytes = (size_t)512 << 20;
+
+// decoded frames of a GOP
+struct DecodedGop {
+    size_t key_pos;             // frame_pos of frames[0]
+    std::vector<cv::Mat> frames;
+};
+
+class FrameServer {
+public:
+    // cache_bytes bounds the decoded frames kept, the GOP decoded last is
+    // kept even if larger, allocator is for the decoded frames, OpenCV's
+    // if NULL
+    FrameServer(const size_t cache_bytes = kFrameCacheBytes,
+                const size_t workers = 4,
+                cv::MatAllocator *allocator = NULL);
+    ~FrameServer() {}
+
+    // frame at frame_pos of the video piece, blocks until decoded
+    bool fetch(const string &video_path, const size_t frame_pos,
+               cv::Mat &frame);
+    // start decoding the GOP of frame_pos in the background
+    void prefetch(const string &video_path, const size_t frame_pos);
+
+    size_t get_cached_gops();
+    size_t get_cached_bytes();
+
+private:
+    FrameServer(const FrameServer &);
+    FrameServer &operator=(const FrameServer &);
+
+    typedef std::pair<string, size_t> GopKey;
+    typedef std::shared_ptr<const DecodedGop> GopPtr;
+    typedef std::shared_ptr<const FrameIndex> IndexPtr;
+
+    // GOP key of frame_pos, false if the piece has no index or is shorter
+    bool locate(const string &video_path, const size_t frame_pos,
+                GopKey &key);
+    // cached GOP, or the decode in flight, or a new decode
+    std::shared_future<GopPtr> request(const GopKey &key);
+    GopPtr decode(const GopKey &key);
+
+    cv::MatAllocator *allocator_;
+    std::mutex mutex_;
+    LruCache<GopKey, GopPtr> gops_;
+    LruCache<string, IndexPtr> indexes_;
+    std::map<GopKey, std::shared_future<GopPtr> > pending_;
+    // last member, workers stop before the rest is destroyed
+    ThreadPool pool_;
+};
+
+#endif // FRAMESERVER_H
@@ -10,21 +10,13 @@ using std::vector;
 using std::to_string;
 
 
-PersonShot::PersonShot(const size_t sequence,
-                       const string cam_id,
-                       const string video_id,
-                       const string frame_id,
-                       const size_t frame_pos,
+PersonShot::PersonShot(const PersonShotId &id,
+                       const int64_t timestamp,
                        const vector<int> &rect,
                        const cv::Mat &proper_vector)
 {
-    id_ = cam_id + video_id +
-          FormatUnsignedInt(frame_pos, 5) +
-          FormatUnsignedInt(sequence, 2);
-    cam_id_ = cam_id;
-    video_id_ = video_id;
-    frame_id_ = frame_id;
-    frame_pos_ = frame_pos;
+    id_ = id;
+    timestamp_ = timestamp;
     rect_ = rect;
     proper_vector_ = proper_vector;
 }
@@ -40,13 +32,13 @@ FloatArray PersonShot::get_mat() const
 	return f;
 }
 
-VideoShot::VideoShot(const string &video_id, const string &cam_id,
+VideoShot::VideoShot(const VideoId &id,
                      const size_t fps, const size_t frames,
                      const string &format, const string &codec,
                      const string &start_time, const string &end_time,
                      const string &path, const string &filename)
 {
-    id_ = cam_id + video_id;
+    id_ = id;
 
     fps_ = fps;
     frames_ = frames;
@@ -54,36 +46,39 @@ VideoShot::VideoShot(const string &video_id, const string &cam_id,
     codec_ = codec;
     start_time_ = start_time;
     end_time_ = end_time;
-    cam_id_ = cam_id;
 
     // temp solution
     filename_ = filename;
     path_ = path;
 }
 
-KeyframeShot::KeyframeShot(const string &video_id,
-                           const string &cam_id,
-                           const size_t frame_pos,
-                           const string &path,
-                           const string &filename,
-                           const cv::Mat &frame)
+string VideoShot::get_gaps_str() const
 {
-    // frame_pos must have in format %d{5}
-    id_ = cam_id + video_id + FormatUnsignedInt(frame_pos, 5);
-    frame_ = frame.clone();
-    path_ = path;
-    filename_ = filename;
+    string gaps;
+    for (size_t i = 0; i < gaps_.size(); ++i) {
+        if (i)
+            gaps += ",";
+        gaps += NumberToString(gaps_[i].time_start) + "-" +
+                NumberToString(gaps_[i].time_end);
+    }
+
+    return gaps;
 }
 
-vector<float> KeyframeShot::get_frame_mat()
+KeyframeShot::KeyframeShot(const FrameId &id,
+                           const string &path,
+                           const string &filename)
 {
-    // TODO (@Zhiqiang He): convert Mat to array
-    return vector<float>();
+    id_ = id;
+    path_ = path;
+    filename_ = filename;
 }
 
 IPCamera::IPCamera(const string &ip, const string &address)
 {
     id_ = IP2HexStr(ip);
+    camera_id_ = CameraIdFromIP(ip);
+    num_ = CameraNumber(ip);
     ip_ = ip;
     address_ = address;
 }
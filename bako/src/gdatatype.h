@@ -1,10 +1,12 @@
 #ifndef GDATATYPE_H
 #define GDATATYPE_H
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 
 #include <opencv2/opencv.hpp>
+#include "shotid.h"
 #include "sugar/sugar.h"
 
 using std::string;
@@ -21,35 +23,28 @@ struct FloatArray {
 
 class PersonShot {
 public:
-    PersonShot();
-    // id (char[27]): cam_id + video_id + frame_pos + sequence
-    // cam_id (char[8]): COA87101 (192.168.113.1)
-    // video_id (char[12]): 201510072210 (2015-10-07 22:10)
+    // id: camera + video + frame_pos + sequence, see shotid.h
     // rect: point_1 (rect[0], rect[1]), point_2 (rect[2], rect[3])
-    PersonShot(const size_t sequence,
-               const string cam_id,
-               const string video_id,
-               const string frame_id,
-               const size_t frame_pos,
+    // timestamp: epoch ms of the keyframe, used by time-range search
+    PersonShot(const PersonShotId &id,
+               const int64_t timestamp,
                const vector<int> &rect,
                const cv::Mat &proper_vector);
     ~PersonShot(){}
 
-    string get_id() const  { return id_; }
-    string get_cam_id() const { return cam_id_; }
-    string get_video_id() const { return video_id_; }
-    string get_frame_id() const { return frame_id_; }
-    size_t get_frame_pos() const { return frame_pos_; }
-    vector<int> get_rect() const { return rect_; }
+    const PersonShotId &get_id() const { return id_; }
+    const CameraId &get_cam_id() const { return id_.camera; }
+    VideoId get_video_id() const { return id_.get_video_id(); }
+    FrameId get_frame_id() const { return id_.get_frame_id(); }
+    size_t get_frame_pos() const { return id_.frame_pos; }
+    int64_t get_timestamp() const { return timestamp_; }
+    const vector<int> &get_rect() const { return rect_; }
+    const cv::Mat &get_proper_vector() const { return proper_vector_; }
     // covert Mat to float array
     FloatArray get_mat() const ;
 private:
-    // hex(ip) + %Y%m%d%I%M%S + frame_pos(len=5) + sequence(len=2)
-    string id_,
-           cam_id_,
-           video_id_,
-           frame_id_;
-    size_t frame_pos_;
+    PersonShotId id_;
+    int64_t timestamp_;
     vector<int> rect_;
     cv::Mat proper_vector_;
 };
@@ -65,62 +60,68 @@ struct VideoStreamMeta {
 };
 
 struct VideoTime {
-    string time_start, time_end;    // 10min per piece
-                                    // time format: %Y%m%d%I%M%S
+    int64_t time_start, time_end;   // 10min per piece, epoch ms
+};
+
+// part of a piece which was not recorded, [time_start, time_end) in
+// epoch ms
+struct VideoGap {
+    int64_t time_start, time_end;
 };
 
 // video snapshot object
 //
 class VideoShot {
 public:
-    VideoShot(const string &video_id, const string &cam_id,
+    VideoShot(const VideoId &id,
               const size_t fps, const size_t frames,
               const string &format, const string &codec,
               const string &start_time, const string &end_time,
               const string &path, const string &filename);
     ~VideoShot() {}
 
-    string get_id() const { return id_; }
-    string get_cam_id() const { return cam_id_; }
-    string get_format() const { return format_; }
-    string get_codec() const { return codec_; }
+    const VideoId &get_id() const { return id_; }
+    const CameraId &get_cam_id() const { return id_.camera; }
+    const string &get_format() const { return format_; }
+    const string &get_codec() const { return codec_; }
     size_t get_fps() const { return fps_; }
     size_t get_frames() const { return frames_; }
-    string get_start_time() const { return start_time_; }
-    string get_end_time() const { return end_time_; }
-    string get_filename() const { return filename_; }
-    string get_path() const { return path_; }
+    const string &get_start_time() const { return start_time_; }
+    const string &get_end_time() const { return end_time_; }
+    const string &get_filename() const { return filename_; }
+    const string &get_path() const { return path_; }
+    const vector<VideoGap> &get_gaps() const { return gaps_; }
+    // gaps as "start-end,start-end" for redis
+    string get_gaps_str() const;
+
+    void set_gaps(const vector<VideoGap> &gaps) { gaps_ = gaps; }
 
 private:
-    string id_;     // hex(ip) + %Y%m%d%I%M%S
+    VideoId id_;
     string format_, codec_; // codec for en/decoding, format for container
     size_t fps_, frames_;
-    string start_time_, end_time_;
+    string start_time_, end_time_;  // %Y%m%d%H%M%S
     string path_, filename_;
-    string cam_id_;
+    vector<VideoGap> gaps_; // see RecordPolicy
 };
 
 // key frame object
 //
 class KeyframeShot {
 public:
-    KeyframeShot(const string &video_id,
-                 const string &cam_id,
-                 const size_t frame_pos,
+    // the frame itself is saved as path + filename
+    KeyframeShot(const FrameId &id,
                  const string &path,
-                 const string &filename,
-                 const cv::Mat &frame);
+                 const string &filename);
     ~KeyframeShot() {}
 
-    string get_id() const { return id_; }
-    string get_filename() const { return filename_; }
-    string get_path() const { return path_; }
-    vector<float> get_frame_mat();
+    const FrameId &get_id() const { return id_; }
+    const string &get_filename() const { return filename_; }
+    const string &get_path() const { return path_; }
 
 private:
-    string id_;     // hex(ip) + %Y%m%d%I%M%S + frame_pos (len=5)
+    FrameId id_;
     string path_, filename_;
-    cv::Mat frame_;
 };
 
 // camera object
@@ -131,12 +132,18 @@ public:
              const string &address);
     ~IPCamera() {}
 
-    string get_id() const { return id_; }
-    string get_ip() const { return ip_; }
-    string get_address() const { return address_; }
+    // hex(ip)
+    const string &get_id() const { return id_; }
+    const CameraId &get_camera_id() const { return camera_id_; }
+    const string &get_ip() const { return ip_; }
+    const string &get_address() const { return address_; }
+    // camera part of ids, see IdGenerator
+    uint32_t get_num() const { return num_; }
 
 private:
     string id_; // hex(ip)
+    CameraId camera_id_;
+    uint32_t num_;
     string ip_;
     string address_;    // physical address
 };
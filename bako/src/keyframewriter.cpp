@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "keyframewriter.h"
+#include "memcache.h"
+#include "sugar/sugar.h"
+
+using std::string;
+using std::vector;
+
+KeyframeWriter::KeyframeWriter(BlobStore &blob_store, const size_t workers,
+                               const size_t max_queue, const int quality)
+      : blob_store_(blob_store)
+{
+    params_.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params_.push_back(quality);
+#if CV_MAJOR_VERSION >= 3
+    params_.push_back(cv::IMWRITE_JPEG_OPTIMIZE);
+    params_.push_back(0);
+    params_.push_back(cv::IMWRITE_JPEG_PROGRESSIVE);
+    params_.push_back(0);
+#endif
+
+    max_queue_ = max_queue;
+    stop_ = false;
+    for (size_t i = 0; i < std::max(workers, (size_t)1); i++)
+        threads_.push_back(std::thread(&KeyframeWriter::run, this));
+}
+
+KeyframeWriter::~KeyframeWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (size_t i = 0; i < threads_.size(); i++)
+        threads_[i].join();
+}
+
+bool KeyframeWriter::submit(const Frame &frame,
+                            const KeyframeShot &keyframe_shot)
+{
+    std::unique_ptr<KeyframeJob> job(new KeyframeJob(frame, keyframe_shot));
+    job->submitted = GetEpochMsNow();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (jobs_.size() >= max_queue_)
+            return false;
+        jobs_.push_back(job.release());
+        metrics_.submitted++;
+        metrics_.queue_depth = jobs_.size();
+        metrics_.max_queue_depth = std::max(metrics_.max_queue_depth,
+                                            jobs_.size());
+    }
+    cond_.notify_one();
+
+    return true;
+}
+
+bool KeyframeWriter::write(const cv::Mat &frame,
+                           const KeyframeShot &keyframe_shot)
+{
+    int64_t start = GetEpochMsNow();
+    vector<uchar> buffer;
+    bool ok = encode(frame, keyframe_shot.get_id().to_string(), buffer);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    metrics_.sync_writes++;
+    account(ok, GetEpochMsNow() - start);
+
+    return ok;
+}
+
+KeyframeMetrics KeyframeWriter::get_metrics()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return metrics_;
+}
+
+void KeyframeWriter::run()
+{
+    // redis connection of this thread
+    MemCache memcache;
+    // keeps its capacity across keyframes
+    vector<uchar> buffer;
+
+    while (1) {
+        std::unique_ptr<KeyframeJob> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+            if (jobs_.empty())
+                return;
+            job.reset(jobs_.front());
+            jobs_.pop_front();
+            metrics_.queue_depth = jobs_.size();
+        }
+
+        const KeyframeShot &shot = job->keyframe_shot;
+        bool ok = encode(job->frame.view(), shot.get_id().to_string(),
+                         buffer) &&
+                  memcache.save(shot);
+        // back to the pool before the next keyframe
+        job->frame.release();
+        int64_t elapsed = GetEpochMsNow() - job->submitted;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        account(ok, elapsed);
+    }
+}
+
+bool KeyframeWriter::encode(const cv::Mat &frame, const string &key,
+                            vector<uchar> &buffer)
+{
+    if (!cv::imencode(".jpeg", frame, buffer, params_)) {
+        LogError("Fail to encode keyframe.");
+        return false;
+    }
+
+    return blob_store_.put(key, (const char *)&buffer[0], buffer.size());
+}
+
+void KeyframeWriter::account(const bool ok, const int64_t elapsed)
+{
+    if (ok)
+        metrics_.written++;
+    else
+        metrics_.failed++;
+    metrics_.last_ms = elapsed;
+    metrics_.max_ms = std::max(metrics_.max_ms, elapsed);
+    metrics_.total_ms += elapsed;
+
+    size_t done = metrics_.written + metrics_.failed;
+    if (done % kKeyframeReport == 0)
+        LogInfo("KeyframeWriter",
+                (NumberToString(metrics_.written) + " written, " +
+                 NumberToString(metrics_.failed) + " failed, " +
+                 NumberToString(metrics_.sync_writes) + " on the caller, "
+                 "queue max " + NumberToString(metrics_.max_queue_depth) +
+                 ", " + NumberToString(metrics_.total_ms / done) +
+                 "ms mean, " + NumberToString(metrics_.max_ms) +
+                 "ms max").c_str());
+}
+
+KeyframeWriter &SharedKeyframeWriter()
+{
+    static KeyframeWriter keyframe_writer(SharedBlobStore());
+
+    return keyframe_writer;
+}
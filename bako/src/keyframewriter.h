@@ -0,0 +1,112 @@
+#ifndef KEYFRAMEWRITER_H
+#define KEYFRAMEWRITER_H
+
+//
+// KeyframeWriter: encode and write keyframes off the capture thread.
+//
+// The extractor submits the pooled frame of a keyframe with its shot.
+// Workers hold the Frame while they encode it to JPEG in memory, append
+// it to the BlobStore under its FrameId and save the KeyframeShot into
+// redis, so a keyframe shows up only once it is stored. Each worker has
+// its own MemCache and reuses its encode buffer.
+//
+// The queue is bounded. submit() returns false when it is full, and the
+// caller writes the keyframe itself with write(), so a busy scene slows
+// the capture thread down instead of piling up frames.
+//
+// JPEG is encoded for speed: quality kKeyframeQuality, no Huffman
+// optimization, baseline. OpenCV 2.4 has no flags for the last two and
+// encodes so anyway.
+//
+// The metrics are logged every kKeyframeReport keyframes.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "blobstore.h"
+#include "framepool.h"
+#include "gdatatype.h"
+
+using std::string;
+
+static const size_t kKeyframeWorkers = 2;
+// each camera pools frames for a full queue, see VideoStreamHandler
+static const size_t kKeyframeQueue = 8;
+static const int kKeyframeQuality = 85;
+// keyframes between two metrics logs
+static const size_t kKeyframeReport = 100;
+
+// a keyframe to write
+struct KeyframeJob {
+    KeyframeJob(const Frame &frame, const KeyframeShot &keyframe_shot)
+        : frame(frame), keyframe_shot(keyframe_shot) {}
+
+    Frame frame;                // held until written
+    KeyframeShot keyframe_shot;
+    int64_t submitted;          // epoch ms
+};
+
+struct KeyframeMetrics {
+    KeyframeMetrics()
+          : submitted(0), written(0), failed(0), sync_writes(0),
+            queue_depth(0), max_queue_depth(0),
+            last_ms(0), max_ms(0), total_ms(0) {}
+
+    size_t submitted, written, failed;
+    size_t sync_writes;         // written by the caller, queue full
+    size_t queue_depth, max_queue_depth;
+    // from submit to saved in redis, sync writes from encode to written
+    int64_t last_ms, max_ms, total_ms;
+};
+
+class KeyframeWriter {
+public:
+    KeyframeWriter(BlobStore &blob_store,
+                   const size_t workers = kKeyframeWorkers,
+                   const size_t max_queue = kKeyframeQueue,
+                   const int quality = kKeyframeQuality);
+    // writes the keyframes still queued
+    ~KeyframeWriter();
+
+    // false when the queue is full, nothing is queued then
+    bool submit(const Frame &frame, const KeyframeShot &keyframe_shot);
+    // encode and write on the calling thread, the caller saves the shot
+    bool write(const cv::Mat &frame, const KeyframeShot &keyframe_shot);
+
+    KeyframeMetrics get_metrics();
+
+private:
+    KeyframeWriter(const KeyframeWriter &);
+    KeyframeWriter &operator=(const KeyframeWriter &);
+
+    void run();
+    bool encode(const cv::Mat &frame, const string &key,
+                std::vector<uchar> &buffer);
+    void account(const bool ok, const int64_t elapsed);
+
+    BlobStore &blob_store_;
+    std::vector<int> params_;   // imencode parameters
+    size_t max_queue_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<KeyframeJob *> jobs_;
+    bool stop_;
+    KeyframeMetrics metrics_;
+    std::vector<std::thread> threads_;
+};
+
+// KeyframeWriter shared by the extractors of all cameras.
+//
+KeyframeWriter &SharedKeyframeWriter();
+
+#endif // KEYFRAMEWRITER_H
@@ -1,10 +1,15 @@
+#include <stdint.h>
+#include <cstdlib>
 #include <string>
 #include <list>
+#include <vector>
 #include <boost/asio/ip/address.hpp>
 #include <boost/bind.hpp>
 
 #include "gdatatype.h"
 #include "memcache.h"
+#include "tracker.h"
+#include "RBML/featuremodel.h"
 #include "sugar/sugar.h"
 
 using std::string;
@@ -26,13 +31,14 @@ MemCache::MemCache()
     }
 }
 
-bool MemCache::save(const PersonShot person_shot)
+bool MemCache::save(const PersonShot &person_shot)
 {
     RedisValue res;
 
     // cache mat of person shot - dimension + elements
     //
-    string person_shot_matrix_id = "psm:" + person_shot.get_id();
+    string shot_id = person_shot.get_id().to_string();
+    string person_shot_matrix_id = "psm:" + shot_id;
     FloatArray mat_array = person_shot.get_mat();
 
     res = redis_sync_.command("RPUSH",
@@ -57,20 +63,24 @@ bool MemCache::save(const PersonShot person_shot)
     //
     // convert vector<int> rect_ to string
     //  e.g. "10 10 20 20"
-    vector<int> rect = person_shot.get_rect();
+    const vector<int> &rect = person_shot.get_rect();
     string rect_in_str;
     for (size_t i = 0; i < rect.size(); ++i)
         rect_in_str = rect_in_str + to_string(rect[i]) + " ";
     rect_in_str.pop_back();
 
-    string person_shot_id = "ps:" + person_shot.get_id();
+    string person_shot_id = "ps:" + shot_id;
     list<string> args = {
         person_shot_id,
-        "cam_id", person_shot.get_cam_id(),
-        "frame_id", person_shot.get_frame_id(),
+        "cam_id", person_shot.get_cam_id().to_string(),
+        "frame_id", person_shot.get_frame_id().to_string(),
         "frame_pos", to_string(person_shot.get_frame_pos()),
-        "video_id", person_shot.get_video_id(),
+        // without the camera, "vs:" + cam_id + video_id is the piece
+        "video_id", IdToString(person_shot.get_id().video),
+        "timestamp", to_string(person_shot.get_timestamp()),
         "proper_vector_id", person_shot_matrix_id,
+        // embeddings, older vectors are migrated by migrate_vectors.py
+        "vector_space", kEmbeddingSpace,
         "rect", rect_in_str
     };
     res = redis_sync_.command("HMSET", args);
@@ -79,26 +89,36 @@ bool MemCache::save(const PersonShot person_shot)
         exit(1);
     }
 
+    // ids in the order saved, the actor indexes the new ones from its
+    // last offset, see load_person_index() of the actor
+    res = redis_sync_.command("RPUSH", kPersonShotList, shot_id);
+    if (res.isError()) {
+        LogError(res.toString().c_str());
+        exit(1);
+    }
+
     return true;
 }
 
-bool MemCache::save(const VideoShot video_shot)
+bool MemCache::save(const VideoShot &video_shot)
 {
     RedisValue res;
 
     // custom id
-    string video_shot_id = "vs:" + video_shot.get_id();
-    string video_shot_binary_id = "vsb:" + video_shot.get_id();
+    string id = video_shot.get_id().to_string();
+    string video_shot_id = "vs:" + id;
+    string video_shot_binary_id = "vsb:" + id;
 
     list<string> vs_args = {
         video_shot_id,
-        "cam_id", video_shot.get_cam_id(),
+        "cam_id", video_shot.get_cam_id().to_string(),
         "format", video_shot.get_format(),
         "codec", video_shot.get_codec(),
         "fps", to_string(video_shot.get_fps()),
         "frames", to_string(video_shot.get_frames()),
         "start_time", video_shot.get_start_time(),
         "end_time", video_shot.get_end_time(),
+        "gaps", video_shot.get_gaps_str(),
         "binary", video_shot_binary_id
     };
 
@@ -126,11 +146,11 @@ bool MemCache::save(const VideoShot video_shot)
 }
 
 
-bool MemCache::save(const KeyframeShot key_frame_shot)
+bool MemCache::save(const KeyframeShot &key_frame_shot)
 {
     RedisValue res;
 
-    string keyframe_shot_id = "kf:" + key_frame_shot.get_id();
+    string keyframe_shot_id = "kf:" + key_frame_shot.get_id().to_string();
 
     list<string> kf_args = {
         keyframe_shot_id,
@@ -146,3 +166,140 @@ bool MemCache::save(const KeyframeShot key_frame_shot)
 
     return true;
 }
+
+int64_t MemCache::next_track_id()
+{
+    RedisValue res = redis_sync_.command("INCR", string("tk:next"));
+    if (!res.isInt()) {
+        LogError(("Fail to get a track id: " + res.toString()).c_str());
+        return -1;
+    }
+
+    return res.toInt();
+}
+
+bool MemCache::save(const Track &track)
+{
+    RedisValue res;
+    string id = to_string(track.id);
+
+    // shots, and where each of them belongs
+    list<string> shots_args = {"tks:" + id};
+    list<string> map_args = {"tk:shots"};
+    for (size_t i = 0; i < track.points.size(); ++i) {
+        string shot_id = track.points[i].shot_id.to_string();
+        shots_args.push_back(shot_id);
+        map_args.push_back(shot_id);
+        map_args.push_back(id);
+    }
+    list<string> vector_args = {"tkv:" + id,
+                                to_string(track.feature.total())};
+    cv::Mat feature;
+    track.feature.reshape(1, (int)track.feature.total()).convertTo(
+            feature, CV_32FC1);
+    for (int i = 0; i < feature.rows; ++i)
+        vector_args.push_back(to_string(feature.at<float>(i, 0)));
+
+    // next is left to link_tracks()
+    list<string> track_args = {
+        "tk:" + id,
+        "cam_id", track.cam_id.to_string(),
+        "start_time", to_string(track.points.front().timestamp),
+        "end_time", to_string(track.points.back().timestamp),
+        "shots", "tks:" + id,
+        "proper_vector_id", "tkv:" + id,
+        "vector_space", kEmbeddingSpace
+    };
+    if (track.prev >= 0) {
+        track_args.push_back("prev");
+        track_args.push_back(to_string(track.prev));
+    }
+
+    const list<string> *commands[] = {
+        &shots_args, &map_args, &vector_args, &track_args
+    };
+    const char *names[] = {"RPUSH", "HMSET", "RPUSH", "HMSET"};
+    for (int i = 0; i < 4; ++i) {
+        res = redis_sync_.command(names[i], *commands[i]);
+        if (res.isError()) {
+            LogError(res.toString().c_str());
+            return false;
+        }
+    }
+
+    // a candidate once complete
+    res = redis_sync_.command("ZADD", string("tk:ends"),
+                              to_string(track.points.back().timestamp), id);
+    if (res.isError()) {
+        LogError(res.toString().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+vector<TrackEnd> MemCache::load_track_ends(const int64_t time_start,
+                                           const int64_t time_end)
+{
+    vector<TrackEnd> ends;
+
+    RedisValue res = redis_sync_.command("ZREMRANGEBYSCORE",
+                                         string("tk:ends"), string("-inf"),
+                                         "(" + to_string(time_start));
+    if (res.isError())
+        LogError(res.toString().c_str());
+
+    res = redis_sync_.command("ZRANGEBYSCORE", string("tk:ends"),
+                              to_string(time_start), to_string(time_end),
+                              string("WITHSCORES"));
+    if (res.isError()) {
+        LogError(res.toString().c_str());
+        return ends;
+    }
+
+    // id, end_time pairs
+    vector<RedisValue> items = res.toArray();
+    for (size_t i = 0; i + 1 < items.size(); i += 2) {
+        TrackEnd end;
+        string id = items[i].toString();
+        end.id = atoll(id.c_str());
+        end.time_end = atoll(items[i + 1].toString().c_str());
+
+        vector<RedisValue> fields = redis_sync_.command(
+                "HMGET", "tk:" + id, string("cam_id"),
+                string("next")).toArray();
+        if (fields.size() != 2 ||
+                !ParseId(fields[0].toString(), end.cam_id))
+            continue;
+        end.linked = !fields[1].isNull();
+
+        // dimension + elements
+        vector<RedisValue> values = redis_sync_.command(
+                "LRANGE", "tkv:" + id, string("0"),
+                string("-1")).toArray();
+        if (values.size() < 2 ||
+                atoi(values[0].toString().c_str()) + 1 != (int)values.size())
+            continue;
+        end.feature.create((int)values.size() - 1, 1, CV_32FC1);
+        for (size_t j = 1; j < values.size(); ++j)
+            end.feature.at<float>((int)j - 1, 0) =
+                    (float)atof(values[j].toString().c_str());
+
+        ends.push_back(end);
+    }
+
+    return ends;
+}
+
+bool MemCache::link_tracks(const int64_t prev, const int64_t next)
+{
+    // atomic, of the cameras which try to chain after prev one wins
+    RedisValue res = redis_sync_.command("HSETNX", "tk:" + to_string(prev),
+                                         string("next"), to_string(next));
+    if (!res.isInt()) {
+        LogError(res.toString().c_str());
+        return false;
+    }
+
+    return res.toInt() == 1;
+}
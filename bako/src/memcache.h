@@ -1,19 +1,25 @@
 #ifndef MEMCACHE_H
 #define MEMCACHE_H
 
+#include <stdint.h>
 #include <string>
+#include <vector>
 #include <boost/asio.hpp>
 
 #include "redisclient/redissyncclient.h"
 #include "gdatatype.h"
+#include "tracker.h"
 
 using std::string;
 
+// list of the person shot ids, outside of ps:* as it is no hash
+static const char kPersonShotList[] = "psl";
+
 //
 // `redis-client` wrapper for the project.
 //
 // Support data struct:
-//  PersonShot, VideoShot
+//  PersonShot, VideoShot, Track
 //
 // Design pattern:
 //  1. Hide details.
@@ -30,9 +36,27 @@ public:
 
     // save
     //
-    bool save(const PersonShot person_shot);
-    bool save(const VideoShot video_shot);
-    bool save(const KeyframeShot key_frame_shot);
+    bool save(const PersonShot &person_shot);
+    bool save(const VideoShot &video_shot);
+    bool save(const KeyframeShot &key_frame_shot);
+
+    // tracks, see Tracker, errors are logged and do not exit
+    //
+    //  tk:<id>     hash of cam_id, start_time, end_time, prev, next
+    //  tks:<id>    list of its shot ids
+    //  tkv:<id>    proper vector of its last shot, as psm:
+    //  tk:shots    hash of shot id -> track id
+    //  tk:ends     ids by end_time, the link candidates
+    //
+    // id of a new track, -1 on error
+    int64_t next_track_id();
+    bool save(const Track &track);
+    // tracks which ended in [time_start, time_end], the candidates which
+    // ended before are dropped
+    std::vector<TrackEnd> load_track_ends(const int64_t time_start,
+                                          const int64_t time_end);
+    // chain next after prev, false if prev has a successor already
+    bool link_tracks(const int64_t prev, const int64_t next);
 
     // callback
     //
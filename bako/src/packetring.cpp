@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "packetring.h"
+
+PacketRing::PacketRing(const int seconds, const size_t max_bytes)
+{
+    next_seq_ = 0;
+    bytes_ = 0;
+    window_ms_ = (int64_t)seconds * 1000;
+    max_bytes_ = max_bytes;
+}
+
+void PacketRing::push(const AVPacket *packet, const int64_t time_ms)
+{
+    bool is_key = IsKeyPacket(packet);
+
+    // the ring starts with a keyframe
+    if (entries_.empty() && !is_key)
+        return;
+
+    Entry entry;
+    entry.packet = av_packet_alloc();
+    av_packet_ref(entry.packet, packet);
+    entry.time_ms = time_ms;
+    entry.seq = next_seq_++;
+    if (is_key)
+        keys_.push_back(entry.seq);
+    entries_.push_back(entry);
+    bytes_ += packet->size;
+
+    // drop the first GOP while the next one still covers the window
+    while (keys_.size() > 1) {
+        const Entry &next_gop = entries_[keys_[1] - entries_.front().seq];
+        if (next_gop.time_ms > time_ms - window_ms_ && bytes_ <= max_bytes_)
+            break;
+        pop_gop();
+    }
+
+    // a single GOP over the bound, start over at the next keyframe
+    if (bytes_ > max_bytes_)
+        clear();
+}
+
+void PacketRing::pop_gop()
+{
+    uint64_t end = keys_.size() > 1 ? keys_[1] : next_seq_;
+
+    while (!entries_.empty() && entries_.front().seq < end) {
+        bytes_ -= entries_.front().packet->size;
+        av_packet_free(&entries_.front().packet);
+        entries_.pop_front();
+    }
+    keys_.pop_front();
+}
+
+void PacketRing::clear()
+{
+    while (!keys_.empty())
+        pop_gop();
+}
+
+void PacketRing::snapshot(const int64_t time_ms,
+                          std::vector<AVPacket *> &packets) const
+{
+    packets.clear();
+    if (entries_.empty())
+        return;
+
+    // last keyframe at or before time_ms
+    uint64_t start = keys_.front();
+    for (size_t i = 1; i < keys_.size(); ++i) {
+        if (entries_[keys_[i] - entries_.front().seq].time_ms > time_ms)
+            break;
+        start = keys_[i];
+    }
+
+    packets.reserve(entries_.size());
+    for (size_t i = start - entries_.front().seq; i < entries_.size(); ++i) {
+        AVPacket *packet = av_packet_alloc();
+        av_packet_ref(packet, entries_[i].packet);
+        packets.push_back(packet);
+    }
+}
+
+int64_t PacketRing::get_span() const
+{
+    if (entries_.empty())
+        return 0;
+
+    return entries_.back().time_ms - entries_.front().time_ms;
+}
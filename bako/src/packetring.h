@@ -0,0 +1,63 @@
+#ifndef PACKETRING_H
+#define PACKETRING_H
+
+//
+// PacketRing: the recent compressed packets of a video stream.
+//
+// The ring keeps whole GOPs, it always starts with a keyframe and holds
+// at least the last `seconds` of the stream when they are available.
+// Older GOPs are dropped as new packets come, and so are the oldest ones
+// whenever the packets take more than `max_bytes`, so memory is fixed per
+// camera. Packets are references to the demuxed buffers, nothing is
+// decoded or copied.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "avstream.h"
+
+class PacketRing {
+public:
+    PacketRing(const int seconds = 10, const size_t max_bytes = 16 << 20);
+    ~PacketRing() { clear(); }
+
+    // time_ms is the packet's time, see PacketTimeMs()
+    void push(const AVPacket *packet, const int64_t time_ms);
+    void clear();
+
+    // references to the packets from the last keyframe at or before
+    // time_ms (the first keyframe if none), to be freed by the caller
+    void snapshot(const int64_t time_ms, std::vector<AVPacket *> &packets) const;
+
+    bool empty() const { return entries_.empty(); }
+    size_t size() const { return entries_.size(); }
+    size_t get_bytes() const { return bytes_; }
+    // time covered, ms
+    int64_t get_span() const;
+
+private:
+    PacketRing(const PacketRing &);
+    PacketRing &operator=(const PacketRing &);
+
+    struct Entry {
+        AVPacket *packet;
+        int64_t time_ms;
+        uint64_t seq;
+    };
+
+    // drop the first GOP
+    void pop_gop();
+
+    std::deque<Entry> entries_;
+    std::deque<uint64_t> keys_;     // seq of the keyframes in entries_
+    uint64_t next_seq_;
+    size_t bytes_;
+    int64_t window_ms_;
+    size_t max_bytes_;
+};
+
+#endif // PACKETRING_H
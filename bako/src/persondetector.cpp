@@ -0,0 +1,81 @@
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "persondetector.h"
+
+using namespace cv;
+using std::vector;
+
+PersonDetector::PersonDetector()
+{
+    // for OpenCV 3.0 with cuda
+    // Ptr<cuda::HOG> gpu_hog = cuda::HOG::create();
+    // gpu_hog->setSVMDetector(gpu_hog->getDefaultPeopleDetector());
+    hog_.setSVMDetector(HOGDescriptor::getDefaultPeopleDetector());
+}
+
+vector<Rect> PersonDetector::detect(const Mat &frame) const
+{
+    vector<Rect> found_rects, found_rects_filtered;
+
+    hog_.detectMultiScale(frame, found_rects, 0, Size(8, 8), Size(32, 32),
+                          1.05, 2);
+
+    for (size_t i = 0; i < found_rects.size(); i++) {
+        Rect r = found_rects[i];
+        // to fix over bound bug
+        bool overbound = !(0 <= r.x && 0 <= r.width &&
+                           r.x + r.width <= frame.cols &&
+                           0 <= r.y && 0 <= r.height &&
+                           r.y + r.height <= frame.rows);
+        if (overbound) continue;
+
+        size_t j = 0;
+        for (j = 0; j < found_rects.size(); j++)
+            if (j != i && (r & found_rects[j]) == r) break;
+        if (j == found_rects.size())
+            found_rects_filtered.push_back(r);
+    }
+
+    for (size_t i = 0; i < found_rects_filtered.size(); i++) {
+        found_rects_filtered[i].x += cvRound(found_rects_filtered[i].width*0.2);
+        found_rects_filtered[i].width = cvRound(found_rects_filtered[i].width*0.6);
+        found_rects_filtered[i].y += cvRound(found_rects_filtered[i].height*0.07);
+        found_rects_filtered[i].height = cvRound(found_rects_filtered[i].height*0.8);
+    }
+
+    return found_rects_filtered;
+}
+
+void CropPerson(const Mat &frame, const Rect &rect, Mat &person)
+{
+    // straight from the frame, rect is inside it
+    resize(frame(rect), person, Size(kPersonWidth, kPersonHeight), 0, 0,
+           INTER_AREA);
+}
+
+void MakeProxy(const Mat &frame, Mat &proxy, const int width)
+{
+    if (width <= 0 || width >= frame.cols) {
+        proxy = frame;
+        return;
+    }
+
+    int height = (int)((int64_t)frame.rows * width / frame.cols);
+    resize(frame, proxy, Size(width, height), 0, 0, INTER_AREA);
+}
+
+Rect ScaleRect(const Rect &rect, const Size &proxy_size,
+               const Size &frame_size)
+{
+    if (proxy_size == frame_size)
+        return rect;
+
+    double sx = (double)frame_size.width / proxy_size.width;
+    double sy = (double)frame_size.height / proxy_size.height;
+    Rect scaled(cvRound(rect.x * sx), cvRound(rect.y * sy),
+                cvRound(rect.width * sx), cvRound(rect.height * sy));
+
+    // rounding may step over the bound
+    return scaled & Rect(0, 0, frame_size.width, frame_size.height);
+}
@@ -0,0 +1,58 @@
+#ifndef PERSONDETECTOR_H
+#define PERSONDETECTOR_H
+
+//
+// PersonDetector: the persons of a frame, as the extractor indexes them.
+//
+// HOG people detection, then boxes which fall off the frame or contain
+// another one are dropped, and the rest are shrunk to the body. The HOG
+// is set up once per detector instead of once per frame, and detect()
+// does not change it, so a detector may be shared by threads.
+//
+// A person is cropped and resized to kPersonWidth x kPersonHeight before
+// its feature is taken, see GetFeature.
+//
+// The bako extractor and the RBML python module (PersonDetector) both
+// use it, on a proxy kProxyWidth wide by default, so the actor finds the
+// same persons bako indexed.
+//
+// @Zhiqiang He
+//
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+static const int kPersonWidth = 48;
+static const int kPersonHeight = 128;
+// width of the analytics proxy which persons are detected on
+static const int kProxyWidth = 640;
+
+class PersonDetector {
+public:
+    PersonDetector();
+    ~PersonDetector() {}
+
+    // persons inside the frame
+    std::vector<cv::Rect> detect(const cv::Mat &frame) const;
+
+private:
+    cv::HOGDescriptor hog_;
+};
+
+// Person at rect of the frame, resized for its feature. The buffer of
+// person is reused.
+//
+void CropPerson(const cv::Mat &frame, const cv::Rect &rect, cv::Mat &person);
+
+// Downscale frame to width for the analytics, frame itself if it is not
+// wider.
+//
+void MakeProxy(const cv::Mat &frame, cv::Mat &proxy, const int width);
+
+// Map a rect on the proxy to the frame.
+//
+cv::Rect ScaleRect(const cv::Rect &rect, const cv::Size &proxy_size,
+                   const cv::Size &frame_size);
+
+#endif // PERSONDETECTOR_H
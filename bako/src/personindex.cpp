@@ -0,0 +1,514 @@
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "personindex.h"
+#include "gdatatype.h"
+#include "sugar/sugar.h"
+
+using namespace cv;
+using std::string;
+using std::vector;
+
+SearchFilter::SearchFilter()
+{
+    time_start = std::numeric_limits<int64_t>::min();
+    time_end = std::numeric_limits<int64_t>::max();
+}
+
+PersonIndex::PersonIndex(const int dimension, const int64_t bucket_ms,
+                         const int64_t retention_ms)
+{
+    dimension_ = dimension;
+    bucket_ms_ = bucket_ms;
+    retention_buckets_ = retention_ms > 0 ?
+            (retention_ms + bucket_ms - 1) / bucket_ms : 0;
+    bucket_first_ = std::numeric_limits<int64_t>::min();
+    size_ = 0;
+}
+
+void PersonIndex::set_metric(const Mat &metric)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (metric.rows != dimension_ || metric.cols != dimension_) {
+        LogError("Metric does not match the dimension of index.");
+        return;
+    }
+
+    // M is symmetric in theory, make it exact for the expansion
+    Mat m;
+    metric.convertTo(m, CV_32FC1);
+    metric_ = (m + m.t()) * 0.5;
+
+    // norms depend on the metric
+    std::map<PartitionKey, Partition>::iterator it;
+    for (it = partitions_.begin(); it != partitions_.end(); ++it) {
+        Partition &partition = it->second;
+        for (size_t r = 0; r < partition.norms.size(); ++r) {
+            partition.norms[r] =
+                    self_distance(&partition.vectors[r * dimension_]);
+        }
+    }
+}
+
+float PersonIndex::self_distance(const float *x) const
+{
+    float sum = 0;
+
+    if (metric_.empty()) {
+        for (int i = 0; i < dimension_; ++i)
+            sum += x[i] * x[i];
+        return sum;
+    }
+
+    for (int i = 0; i < dimension_; ++i) {
+        const float *m_row = metric_.ptr<float>(i);
+        float m_x = 0;
+        for (int j = 0; j < dimension_; ++j)
+            m_x += m_row[j] * x[j];
+        sum += x[i] * m_x;
+    }
+
+    return sum;
+}
+
+void PersonIndex::insert(const PersonShot &person_shot)
+{
+    insert(person_shot.get_id(), person_shot.get_timestamp(),
+           person_shot.get_proper_vector());
+}
+
+void PersonIndex::insert(const PersonShotId &id, const int64_t timestamp,
+                         const Mat &proper_vector)
+{
+    if ((int)proper_vector.total() != dimension_) {
+        LogError("Proper vector does not match the dimension of index.");
+        return;
+    }
+
+    Mat x;
+    proper_vector.reshape(1, 1).convertTo(x, CV_32FC1);
+    const float *data = x.ptr<float>(0);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int64_t bucket = timestamp / bucket_ms_;
+    if (bucket < bucket_first_)
+        return;
+    if (retention_buckets_ > 0 &&
+            bucket - retention_buckets_ > bucket_first_)
+        evict(bucket - retention_buckets_);
+
+    PartitionKey key(id.camera, bucket);
+    Partition &partition = partitions_[key];
+
+    if (!partition.timestamps.empty() &&
+            partition.timestamps.back() > timestamp)
+        partition.sorted = false;
+
+    partition.vectors.insert(partition.vectors.end(),
+                             data, data + dimension_);
+    partition.norms.push_back(self_distance(data));
+    partition.timestamps.push_back(timestamp);
+    partition.ids.push_back(id);
+
+    cam_ids_.insert(key.first);
+    size_++;
+}
+
+void PersonIndex::evict(const int64_t bucket_first)
+{
+    bucket_first_ = bucket_first;
+
+    // a camera's buckets are a contiguous run, the old ones lead it
+    std::set<CameraId>::iterator cam;
+    for (cam = cam_ids_.begin(); cam != cam_ids_.end(); ) {
+        std::map<PartitionKey, Partition>::iterator first =
+                partitions_.lower_bound(PartitionKey(
+                        *cam, std::numeric_limits<int64_t>::min()));
+        std::map<PartitionKey, Partition>::iterator last =
+                partitions_.lower_bound(PartitionKey(*cam, bucket_first));
+        for (std::map<PartitionKey, Partition>::iterator it = first;
+                it != last; ++it)
+            size_ -= it->second.ids.size();
+        partitions_.erase(first, last);
+
+        if (last == partitions_.end() || last->first.first != *cam)
+            cam_ids_.erase(cam++);
+        else
+            ++cam;
+    }
+}
+
+size_t PersonIndex::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return size_;
+}
+
+float PersonIndex::distance(const Mat &x, const Mat &y) const
+{
+    Mat d;
+    subtract(x.reshape(1, 1), y.reshape(1, 1), d, noArray(), CV_32F);
+    if ((int)d.total() != dimension_)
+        return std::numeric_limits<float>::max();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return self_distance(d.ptr<float>(0));
+}
+
+// keep the k smallest hits in a max-heap
+//
+template <typename T>
+static inline void PushHeap(vector<T> &heap, const size_t k, const T &item)
+{
+    if (heap.size() < k) {
+        heap.push_back(item);
+        std::push_heap(heap.begin(), heap.end());
+    } else if (item.distance < heap.front().distance) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = item;
+        std::push_heap(heap.begin(), heap.end());
+    }
+}
+
+void PersonIndex::scan(const Partition &partition, const CameraId &cam_id,
+                       const vector<float> &m_query, const float query_norm,
+                       const SearchFilter &filter, const size_t k,
+                       vector<SearchResult> &heap) const
+{
+    const size_t rows = partition.timestamps.size();
+    const vector<int64_t> &ts = partition.timestamps;
+
+    // rows [begin, end) are candidates, bitmap narrows them further
+    // when the partition is not in time order
+    size_t begin = 0, end = rows;
+    vector<uint64_t> bitmap;
+
+    if (partition.sorted) {
+        begin = std::lower_bound(ts.begin(), ts.end(),
+                                 filter.time_start) - ts.begin();
+        end = std::lower_bound(ts.begin() + begin, ts.end(),
+                               filter.time_end) - ts.begin();
+    } else {
+        bitmap.assign((rows + 63) / 64, 0);
+        for (size_t r = 0; r < rows; ++r) {
+            if (filter.time_start <= ts[r] && ts[r] < filter.time_end)
+                bitmap[r / 64] |= (uint64_t)1 << (r % 64);
+        }
+    }
+
+    SearchResult result;
+    result.cam_id = cam_id;
+
+    for (size_t w = begin / 64; w * 64 < end; ++w) {
+        uint64_t word = bitmap.empty() ? ~(uint64_t)0 : bitmap[w];
+        while (word) {
+            size_t r = w * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            if (r < begin) continue;
+            if (r >= end) break;
+
+            const float *x = &partition.vectors[r * dimension_];
+            float dot = 0;
+            for (int i = 0; i < dimension_; ++i)
+                dot += m_query[i] * x[i];
+
+            result.distance = query_norm + partition.norms[r] - 2 * dot;
+            if (heap.size() == k && result.distance >= heap.front().distance)
+                continue;
+            result.id = partition.ids[r];
+            result.timestamp = ts[r];
+            PushHeap(heap, k, result);
+        }
+    }
+}
+
+vector<PersonIndex::Selection>
+PersonIndex::select(const SearchFilter &filter) const
+{
+    vector<Selection> selections;
+
+    const std::set<CameraId> &cam_ids =
+            filter.cam_ids.empty() ? cam_ids_ : filter.cam_ids;
+
+    // buckets overlapping the time range
+    int64_t bucket_first = filter.time_start / bucket_ms_;
+    int64_t bucket_last = (filter.time_end - 1) / bucket_ms_;
+
+    std::set<CameraId>::const_iterator cam;
+    for (cam = cam_ids.begin(); cam != cam_ids.end(); ++cam) {
+        std::map<PartitionKey, Partition>::const_iterator it =
+                partitions_.lower_bound(PartitionKey(*cam, bucket_first));
+        for (; it != partitions_.end() && it->first.first == *cam &&
+                it->first.second <= bucket_last; ++it) {
+            // partition fully inside the range needs no predicate
+            const int64_t bucket_start = it->first.second * bucket_ms_;
+
+            Selection selection;
+            selection.partition = &it->second;
+            selection.cam_id = &it->first.first;
+            selection.whole = filter.time_start <= bucket_start &&
+                    bucket_start + bucket_ms_ <= filter.time_end;
+            selections.push_back(selection);
+        }
+    }
+
+    return selections;
+}
+
+void PersonIndex::select_rows(const Selection &selection,
+                              const SearchFilter &filter,
+                              vector<size_t> &rows) const
+{
+    const vector<int64_t> &ts = selection.partition->timestamps;
+
+    rows.clear();
+    if (selection.whole) {
+        for (size_t r = 0; r < ts.size(); ++r)
+            rows.push_back(r);
+    } else if (selection.partition->sorted) {
+        size_t begin = std::lower_bound(ts.begin(), ts.end(),
+                                        filter.time_start) - ts.begin();
+        size_t end = std::lower_bound(ts.begin() + begin, ts.end(),
+                                      filter.time_end) - ts.begin();
+        for (size_t r = begin; r < end; ++r)
+            rows.push_back(r);
+    } else {
+        for (size_t r = 0; r < ts.size(); ++r) {
+            if (filter.time_start <= ts[r] && ts[r] < filter.time_end)
+                rows.push_back(r);
+        }
+    }
+}
+
+vector<SearchResult> PersonIndex::search(const Mat &query, const size_t k,
+                                         const SearchFilter &filter) const
+{
+    vector<SearchResult> heap;
+
+    if ((int)query.total() != dimension_ || k == 0 ||
+            filter.time_start >= filter.time_end)
+        return heap;
+
+    Mat q;
+    query.reshape(1, dimension_).convertTo(q, CV_32FC1);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // M q and q^T M q are shared by every row
+    Mat m_q = metric_.empty() ? q : Mat(metric_ * q);
+    vector<float> m_query(m_q.begin<float>(), m_q.end<float>());
+    float query_norm = (float)q.dot(m_q);
+
+    const SearchFilter all;
+    vector<Selection> selections = select(filter);
+    for (size_t i = 0; i < selections.size(); ++i) {
+        scan(*selections[i].partition, *selections[i].cam_id,
+             m_query, query_norm, selections[i].whole ? all : filter,
+             k, heap);
+    }
+
+    std::sort_heap(heap.begin(), heap.end());
+
+    return heap;
+}
+
+vector<PersonIndex::Hit>
+PersonIndex::batch_search(const Mat &queries, const size_t k,
+                          const SearchFilter &filter,
+                          const Aggregation aggregation) const
+{
+    const int kBlockRows = 1024;
+    const int n_queries = queries.cols;
+
+    // (M Q)^T and diag(Q^T M Q) are shared by every block
+    Mat m_q = metric_.empty() ? queries : Mat(metric_ * queries);
+    Mat m_q_t = m_q.t();
+    vector<float> query_norms(n_queries);
+    for (int j = 0; j < n_queries; ++j)
+        query_norms[j] = (float)queries.col(j).dot(m_q.col(j));
+
+    vector<Hit> heap;
+    vector<size_t> rows;
+    Mat block(kBlockRows, dimension_, CV_32FC1), dots;
+
+    vector<Selection> selections = select(filter);
+    for (size_t i = 0; i < selections.size(); ++i) {
+        const Partition &partition = *selections[i].partition;
+        select_rows(selections[i], filter, rows);
+
+        for (size_t b = 0; b < rows.size(); b += kBlockRows) {
+            int n = (int)std::min(rows.size() - b, (size_t)kBlockRows);
+
+            // contiguous rows are used in place, others are gathered
+            Mat x;
+            if (rows[b + n - 1] - rows[b] == (size_t)n - 1) {
+                x = Mat(n, dimension_, CV_32FC1,
+                        (void *)&partition.vectors[rows[b] * dimension_]);
+            } else {
+                x = block.rowRange(0, n);
+                for (int r = 0; r < n; ++r) {
+                    const float *src = &partition.vectors[rows[b + r] * dimension_];
+                    std::copy(src, src + dimension_, x.ptr<float>(r));
+                }
+            }
+
+            // K x n inner products (M q_j)^T x_r
+            gemm(m_q_t, x, 1, noArray(), 0, dots, GEMM_2_T);
+
+            for (int r = 0; r < n; ++r) {
+                const size_t row = rows[b + r];
+                const float x_norm = partition.norms[row];
+
+                float agg = aggregation == kAggregateMean ? 0 :
+                        std::numeric_limits<float>::max();
+                for (int j = 0; j < n_queries; ++j) {
+                    float d = query_norms[j] + x_norm - 2 * dots.at<float>(j, r);
+                    if (aggregation == kAggregateMean)
+                        agg += d;
+                    else
+                        agg = std::min(agg, d);
+                }
+                if (aggregation == kAggregateMean)
+                    agg /= n_queries;
+
+                Hit hit;
+                hit.distance = agg;
+                hit.partition = &partition;
+                hit.cam_id = selections[i].cam_id;
+                hit.row = row;
+                PushHeap(heap, k, hit);
+            }
+        }
+    }
+
+    std::sort_heap(heap.begin(), heap.end());
+
+    return heap;
+}
+
+vector<PersonIndex::Hit>
+PersonIndex::rerank(const vector<Hit> &shortlist, const size_t k) const
+{
+    const size_t kNeighbors = 20;
+    const float kLambda = 0.3;
+
+    // pool: the queries as one probe (node 0), then the shortlist
+    const int n = (int)shortlist.size() + 1;
+    if (n <= 2)
+        return shortlist;
+
+    Mat x((int)shortlist.size(), dimension_, CV_32FC1);
+    for (size_t i = 0; i < shortlist.size(); ++i) {
+        const float *src =
+                &shortlist[i].partition->vectors[shortlist[i].row * dimension_];
+        std::copy(src, src + dimension_, x.ptr<float>((int)i));
+    }
+
+    // pairwise distances of the pool, the probe keeps its min distance
+    Mat m_x = metric_.empty() ? x : Mat(x * metric_);
+    Mat gram = m_x * x.t();
+    Mat dist(n, n, CV_32FC1, Scalar(0));
+    for (int i = 1; i < n; ++i) {
+        dist.at<float>(0, i) = dist.at<float>(i, 0) = shortlist[i - 1].distance;
+        for (int j = 1; j < n; ++j) {
+            dist.at<float>(i, j) = gram.at<float>(i - 1, i - 1) +
+                    gram.at<float>(j - 1, j - 1) - 2 * gram.at<float>(i - 1, j - 1);
+        }
+    }
+
+    // k nearest nodes of every node
+    const size_t kn = std::min(kNeighbors, (size_t)n - 1);
+    vector<vector<bool> > near(n, vector<bool>(n, false));
+    vector<int> order(n);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) order[j] = j;
+        const float *d = dist.ptr<float>(i);
+        std::partial_sort(order.begin(), order.begin() + kn + 1, order.end(),
+                          [d](int a, int b) { return d[a] < d[b]; });
+        for (size_t j = 0; j <= kn; ++j)
+            near[i][order[j]] = true;
+    }
+
+    // Jaccard distance of k-reciprocal sets to the probe's
+    vector<Hit> reranked(shortlist);
+    float d_max = shortlist.back().distance;
+    if (d_max <= 0) d_max = 1;
+    for (int i = 1; i < n; ++i) {
+        size_t inter = 0, uni = 0;
+        for (int j = 0; j < n; ++j) {
+            bool in_probe = near[0][j] && near[j][0];
+            bool in_i = near[i][j] && near[j][i];
+            inter += in_probe && in_i;
+            uni += in_probe || in_i;
+        }
+        float jaccard = uni ? 1 - (float)inter / uni : 1;
+        reranked[i - 1].distance =
+                kLambda * shortlist[i - 1].distance / d_max +
+                (1 - kLambda) * jaccard;
+    }
+
+    std::sort(reranked.begin(), reranked.end());
+    if (reranked.size() > k)
+        reranked.resize(k);
+
+    return reranked;
+}
+
+vector<SearchResult> PersonIndex::search(const Mat &queries, const size_t k,
+                                         const SearchFilter &filter,
+                                         const Aggregation aggregation) const
+{
+    vector<SearchResult> results;
+
+    if (queries.rows != dimension_ || queries.cols == 0 || k == 0 ||
+            filter.time_start >= filter.time_end)
+        return results;
+
+    Mat q;
+    queries.convertTo(q, CV_32FC1);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    vector<Hit> hits;
+    if (aggregation == kAggregateReciprocal) {
+        // re-rank a wider min shortlist
+        const size_t kShortlist = std::max(k * 3, (size_t)50);
+        hits = rerank(batch_search(q, kShortlist, filter, kAggregateMin), k);
+    } else {
+        hits = batch_search(q, k, filter, aggregation);
+    }
+
+    for (size_t i = 0; i < hits.size(); ++i) {
+        SearchResult result;
+        result.id = hits[i].partition->ids[hits[i].row];
+        result.cam_id = *hits[i].cam_id;
+        result.timestamp = hits[i].partition->timestamps[hits[i].row];
+        result.distance = hits[i].distance;
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+PersonIndex &SharedPersonIndex()
+{
+    static PersonIndex *index = NULL;
+    static std::once_flag once;
+
+    std::call_once(once, []() {
+        // vectors are embeddings of the feature model, which has the
+        // metric folded in, so the index measures plain L2
+        index = new PersonIndex();
+    });
+
+    return *index;
+}
@@ -0,0 +1,172 @@
+#ifndef PERSONINDEX_H
+#define PERSONINDEX_H
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "gdatatype.h"
+
+using std::string;
+using std::vector;
+
+//
+// In-memory index of person vectors with predicate pushdown.
+//
+// Vectors are partitioned by (cam_id, time bucket). A query first prunes
+// partitions by the camera set and the time range, then scans only the
+// rows of the remaining partitions which pass the time predicate, so a
+// filtered query costs in proportion to the selected data.
+//
+// With a retention, whole partitions are dropped once they are older
+// than it, measured from the newest row inserted, so the index of a
+// long-running process stays bounded.
+//
+// Distance is (x - y)^T M (x - y) with the RBML metric M (identity by
+// default), expanded as x^T M x + y^T M y - 2 (M x)^T y so that a scan
+// only needs one dot product per row.
+//
+// @Zhiqiang He
+//
+
+// Predicate of a search. Empty cam_ids matches every camera,
+// time range is [time_start, time_end) in epoch ms.
+struct SearchFilter {
+    SearchFilter();
+
+    std::set<CameraId> cam_ids;
+    int64_t time_start, time_end;
+};
+
+// How distances of several queries of one person are combined.
+enum Aggregation {
+    kAggregateMin,          // nearest query
+    kAggregateMean,         // mean over queries
+    kAggregateReciprocal    // k-reciprocal re-ranking of the min shortlist
+};
+
+struct SearchResult {
+    PersonShotId id;
+    CameraId cam_id;
+    int64_t timestamp;  // epoch ms
+    float distance;
+
+    bool operator<(const SearchResult &other) const
+    { return distance < other.distance; }
+};
+
+class PersonIndex {
+public:
+    // dimension: length of the proper vector, default 100
+    // bucket_ms: time span of one partition, default 1 hour
+    // retention_ms: time kept behind the newest row, rounded up to
+    //  buckets, 0 keeps everything
+    PersonIndex(const int dimension = 100,
+                const int64_t bucket_ms = 3600000,
+                const int64_t retention_ms = 0);
+    ~PersonIndex() {}
+
+    // set the metric matrix M (dimension x dimension)
+    void set_metric(const cv::Mat &metric);
+
+    void insert(const PersonShot &person_shot);
+    // rows older than the retention are not inserted
+    void insert(const PersonShotId &id, const int64_t timestamp,
+                const cv::Mat &proper_vector);
+
+    // k nearest person shots of query (dimension x 1) which pass filter
+    vector<SearchResult> search(const cv::Mat &query, const size_t k,
+                                const SearchFilter &filter) const;
+
+    // k nearest person shots of several queries of the same person,
+    // one query per column (dimension x K). Distances of all queries
+    // to a block of rows are computed by one GEMM.
+    vector<SearchResult> search(const cv::Mat &queries, const size_t k,
+                                const SearchFilter &filter,
+                                const Aggregation aggregation) const;
+
+    // distance of two vectors under the metric
+    float distance(const cv::Mat &x, const cv::Mat &y) const;
+
+    int get_dimension() const { return dimension_; }
+    size_t size() const;
+
+private:
+    // rows of one camera inside one time bucket
+    struct Partition {
+        Partition() : sorted(true) {}
+
+        vector<float> vectors;      // rows x dimension, row major
+        vector<float> norms;        // x^T M x of each row
+        vector<int64_t> timestamps;
+        vector<PersonShotId> ids;
+        bool sorted;                // timestamps are appended in order
+    };
+    typedef std::pair<CameraId, int64_t> PartitionKey;     // cam_id, bucket
+
+    // partition which passes the camera and bucket pruning
+    struct Selection {
+        const Partition *partition;
+        const CameraId *cam_id;
+        bool whole;                 // every row passes the time range
+    };
+    // candidate row of the batch search
+    struct Hit {
+        float distance;
+        const Partition *partition;
+        const CameraId *cam_id;
+        size_t row;
+
+        bool operator<(const Hit &other) const
+        { return distance < other.distance; }
+    };
+
+    // x^T M x, x has dimension_ elements
+    float self_distance(const float *x) const;
+    // drop the partitions of buckets before bucket_first
+    void evict(const int64_t bucket_first);
+    // partitions which may hold rows passing filter
+    vector<Selection> select(const SearchFilter &filter) const;
+    // rows of partition which pass the time range
+    void select_rows(const Selection &selection, const SearchFilter &filter,
+                     vector<size_t> &rows) const;
+    // k nearest rows of the aggregated distance to queries
+    vector<Hit> batch_search(const cv::Mat &queries, const size_t k,
+                             const SearchFilter &filter,
+                             const Aggregation aggregation) const;
+    // re-rank hits of the min shortlist by k-reciprocal neighbours
+    vector<Hit> rerank(const vector<Hit> &shortlist, const size_t k) const;
+    // scan rows of partition which pass the time range
+    void scan(const Partition &partition, const CameraId &cam_id,
+              const vector<float> &m_query, const float query_norm,
+              const SearchFilter &filter, const size_t k,
+              vector<SearchResult> &heap) const;
+
+    int dimension_;
+    int64_t bucket_ms_;
+    int64_t retention_buckets_;     // 0 keeps everything
+    int64_t bucket_first_;          // oldest bucket kept
+    cv::Mat metric_;            // CV_32FC1, empty means identity
+
+    // ordered by cam_id then bucket, so a camera's time range is
+    // a contiguous run of the map
+    std::map<PartitionKey, Partition> partitions_;
+    std::set<CameraId> cam_ids_;
+    size_t size_;
+
+    mutable std::mutex mutex_;
+};
+
+// Index of the process, the measure of the Tracker. It has no metric,
+// the vectors GetFeature makes are embeddings in which the RBML metric is
+// plain L2, see FeatureModel. Shots are searched in the actor, which
+// fills an index of its own from redis, see PyPersonIndex.
+//
+PersonIndex &SharedPersonIndex();
+
+#endif // PERSONINDEX_H
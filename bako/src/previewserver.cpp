@@ -0,0 +1,542 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <opencv2/opencv.hpp>
+#include "previewserver.h"
+#include "framering.h"
+#include "sugar/sugar.h"
+
+using boost::asio::ip::tcp;
+using std::string;
+
+static const char *kBoundary = "geeframe";
+// reopen the ring after this many 500ms timeouts, the writer may have
+// been restarted
+static const int kReopenTimeouts = 10;
+
+// encoded once per frame, written to all viewers of a variant
+typedef std::shared_ptr<const string> PreviewPart;
+
+struct PreviewVariant {
+    PreviewVariant(const int width, const int quality)
+        : width(width), quality(quality) {}
+
+    int width;      // 0 for the frame's own
+    int quality;
+
+    bool operator<(const PreviewVariant &other) const
+    {
+        if (width != other.width)
+            return width < other.width;
+        return quality < other.quality;
+    }
+};
+
+typedef std::map<PreviewVariant, std::set<std::shared_ptr<PreviewSession> > >
+        PreviewViewers;
+
+struct PreviewChannel {
+    PreviewChannel(const CameraId &camera_id)
+        : camera_id(camera_id), stop(false), encodes(0), done(false) {}
+
+    CameraId camera_id;
+    std::mutex mutex;           // viewers and stop
+    std::condition_variable cond;
+    PreviewViewers viewers;
+    bool stop;
+    std::atomic<uint64_t> encodes;
+    std::thread thread;         // PreviewServer::pump
+    std::atomic<bool> done;     // the pump returned, join() won't block
+};
+
+// whether bako forwards the camera, so that made up ids cost nothing
+//
+static bool RingExists(const CameraId &camera_id)
+{
+    int fd = shm_open(FrameRingName(camera_id).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    close(fd);
+
+    return true;
+}
+
+// "name=value" of a query string, fallback if absent
+//
+static int QueryInt(const string &query, const string &name,
+                    const int fallback)
+{
+    size_t pos = ("&" + query).find("&" + name + "=");
+    if (pos == string::npos)
+        return fallback;
+
+    return atoi(query.c_str() + pos + name.size() + 1);
+}
+
+// "GET /preview/<camera id>?width=..&quality=.. HTTP/1.1"
+//
+static bool ParsePreviewRequest(const string &request_line,
+                                CameraId &camera_id, int &width,
+                                int &quality)
+{
+    const string kPrefix = "/preview/";
+
+    std::istringstream line(request_line);
+    string method, target;
+    line >> method >> target;
+    if (method != "GET" || target.compare(0, kPrefix.size(), kPrefix) != 0)
+        return false;
+
+    string path = target.substr(kPrefix.size());
+    string query;
+    size_t mark = path.find('?');
+    if (mark != string::npos) {
+        query = path.substr(mark + 1);
+        path.erase(mark);
+    }
+    if (!ParseId(path, camera_id))
+        return false;
+
+    width = std::max(0, QueryInt(query, "width", 0));
+    quality = std::min(95, std::max(10, QueryInt(query, "quality",
+                                                 kPreviewQuality)));
+    return true;
+}
+
+//
+// A viewer, its handlers run on the server's asio thread.
+//
+class PreviewSession : public std::enable_shared_from_this<PreviewSession> {
+public:
+    PreviewSession(PreviewServer &server)
+        : server_(server), socket_(server.io_service_), request_(8192),
+          writing_(false), closing_(false), closed_(false) {}
+
+    tcp::socket &socket() { return socket_; }
+
+    void start();
+    // newest part of the stream, older ones not written yet are dropped
+    void deliver(const PreviewPart &part);
+
+private:
+    void on_request(const boost::system::error_code &ec);
+    void write(const PreviewPart &part);
+    void on_written(const boost::system::error_code &ec);
+    void close();
+
+    PreviewServer &server_;
+    tcp::socket socket_;
+    boost::asio::streambuf request_;
+    PreviewPart current_, pending_;
+    bool writing_, closing_, closed_;
+};
+
+void PreviewSession::start()
+{
+    std::shared_ptr<PreviewSession> self(shared_from_this());
+    boost::asio::async_read_until(socket_, request_, "\r\n\r\n",
+            [self](const boost::system::error_code &ec, size_t) {
+                self->on_request(ec);
+            });
+}
+
+void PreviewSession::on_request(const boost::system::error_code &ec)
+{
+    if (ec) {
+        close();
+        return;
+    }
+
+    std::istream stream(&request_);
+    string request_line;
+    std::getline(stream, request_line);
+
+    CameraId camera_id;
+    int width, quality;
+    if (!ParsePreviewRequest(request_line, camera_id, width, quality) ||
+            !RingExists(camera_id)) {
+        closing_ = true;
+        write(std::make_shared<string>(
+                "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n"));
+        return;
+    }
+
+    if (!server_.join(shared_from_this(), camera_id, width, quality)) {
+        closing_ = true;
+        write(std::make_shared<string>(
+                "HTTP/1.0 503 Service Unavailable\r\n"
+                "Content-Length: 0\r\n\r\n"));
+        return;
+    }
+
+    // frames are delivered on this thread too, after the header
+    write(std::make_shared<string>(
+            string("HTTP/1.0 200 OK\r\n"
+                   "Cache-Control: no-cache\r\n"
+                   "Connection: close\r\n"
+                   "Content-Type: multipart/x-mixed-replace; boundary=") +
+            kBoundary + "\r\n\r\n"));
+}
+
+void PreviewSession::deliver(const PreviewPart &part)
+{
+    if (closed_ || closing_)
+        return;
+
+    if (writing_)
+        pending_ = part;
+    else
+        write(part);
+}
+
+void PreviewSession::write(const PreviewPart &part)
+{
+    writing_ = true;
+    current_ = part;
+
+    // the part is shared, it stays alive in current_ until written
+    std::shared_ptr<PreviewSession> self(shared_from_this());
+    boost::asio::async_write(socket_, boost::asio::buffer(*current_),
+            [self](const boost::system::error_code &ec, size_t) {
+                self->on_written(ec);
+            });
+}
+
+void PreviewSession::on_written(const boost::system::error_code &ec)
+{
+    writing_ = false;
+    current_.reset();
+
+    if (ec || (closing_ && !pending_)) {
+        close();
+    } else if (pending_) {
+        PreviewPart part;
+        part.swap(pending_);
+        write(part);
+    }
+}
+
+void PreviewSession::close()
+{
+    if (closed_)
+        return;
+    closed_ = true;
+
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+    server_.leave(shared_from_this());
+}
+
+PreviewServer::PreviewServer(const unsigned short port)
+      : acceptor_(io_service_)
+{
+    port_ = port;
+    encodes_ = 0;
+    stop_ = false;
+}
+
+PreviewServer::~PreviewServer()
+{
+    stop();
+}
+
+bool PreviewServer::start()
+{
+    boost::system::error_code ec;
+    tcp::endpoint endpoint(tcp::v4(), port_);
+    acceptor_.open(endpoint.protocol(), ec);
+    if (!ec)
+        acceptor_.set_option(tcp::acceptor::reuse_address(true), ec);
+    if (!ec)
+        acceptor_.bind(endpoint, ec);
+    if (!ec)
+        acceptor_.listen(boost::asio::socket_base::max_connections, ec);
+    if (ec) {
+        LogError("Fail to listen for preview.");
+        return false;
+    }
+
+    accept();
+    io_thread_ = std::thread([this]() { io_service_.run(); });
+    LogInfo("PreviewServer", ("listening on port " +
+                              NumberToString(port_)).c_str());
+
+    return true;
+}
+
+// wake the pump of channel to return
+//
+static void StopChannel(const std::shared_ptr<PreviewChannel> &channel)
+{
+    {
+        std::lock_guard<std::mutex> lock(channel->mutex);
+        channel->stop = true;
+    }
+    channel->cond.notify_all();
+}
+
+void PreviewServer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_)
+            return;
+        stop_ = true;
+
+        std::map<CameraId, std::shared_ptr<PreviewChannel> >::iterator it;
+        for (it = channels_.begin(); it != channels_.end(); ++it) {
+            StopChannel(it->second);
+            stopped_.push_back(it->second);
+        }
+        channels_.clear();
+    }
+    reap(true);
+
+    io_service_.stop();
+    if (io_thread_.joinable())
+        io_thread_.join();
+}
+
+void PreviewServer::reap(const bool wait)
+{
+    std::vector<std::shared_ptr<PreviewChannel> > joining;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::shared_ptr<PreviewChannel> >::iterator it;
+        for (it = stopped_.begin(); it != stopped_.end(); ) {
+            if (wait || (*it)->done) {
+                joining.push_back(*it);
+                it = stopped_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    uint64_t encodes = 0;
+    for (size_t i = 0; i < joining.size(); i++) {
+        joining[i]->thread.join();
+        encodes += joining[i]->encodes;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    encodes_ += encodes;
+}
+
+size_t PreviewServer::get_viewers()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t viewers = 0;
+    std::map<CameraId, std::shared_ptr<PreviewChannel> >::iterator it;
+    for (it = channels_.begin(); it != channels_.end(); ++it) {
+        std::lock_guard<std::mutex> channel_lock(it->second->mutex);
+        PreviewViewers::iterator v;
+        for (v = it->second->viewers.begin();
+                v != it->second->viewers.end(); ++v)
+            viewers += v->second.size();
+    }
+
+    return viewers;
+}
+
+uint64_t PreviewServer::get_encodes()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t encodes = encodes_;
+    std::map<CameraId, std::shared_ptr<PreviewChannel> >::iterator it;
+    for (it = channels_.begin(); it != channels_.end(); ++it)
+        encodes += it->second->encodes;
+    for (size_t i = 0; i < stopped_.size(); i++)
+        encodes += stopped_[i]->encodes;
+
+    return encodes;
+}
+
+void PreviewServer::accept()
+{
+    std::shared_ptr<PreviewSession> session(new PreviewSession(*this));
+    acceptor_.async_accept(session->socket(),
+            [this, session](const boost::system::error_code &ec) {
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
+                if (!ec)
+                    session->start();
+                accept();
+            });
+}
+
+bool PreviewServer::join(const std::shared_ptr<PreviewSession> &session,
+                         const CameraId &camera_id, const int width,
+                         const int quality)
+{
+    // pumps of the channels which stopped since
+    reap(false);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_)
+        return false;
+
+    std::shared_ptr<PreviewChannel> channel;
+    std::map<CameraId, std::shared_ptr<PreviewChannel> >::iterator it =
+            channels_.find(camera_id);
+    if (it != channels_.end()) {
+        channel = it->second;
+    } else {
+        if (channels_.size() >= kMaxPreviewChannels)
+            return false;
+        channel.reset(new PreviewChannel(camera_id));
+        channel->thread = std::thread([this, channel]() {
+            pump(channel);
+            channel->done = true;
+        });
+        channels_[camera_id] = channel;
+    }
+
+    std::lock_guard<std::mutex> channel_lock(channel->mutex);
+    PreviewVariant variant(width, quality);
+    if (channel->viewers.count(variant) == 0 &&
+            channel->viewers.size() >= kMaxPreviewVariants)
+        return false;
+    channel->viewers[variant].insert(session);
+    channel->cond.notify_one();
+
+    return true;
+}
+
+void PreviewServer::leave(const std::shared_ptr<PreviewSession> &session)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<CameraId, std::shared_ptr<PreviewChannel> >::iterator it;
+    for (it = channels_.begin(); it != channels_.end(); ) {
+        std::shared_ptr<PreviewChannel> channel = it->second;
+        std::unique_lock<std::mutex> channel_lock(channel->mutex);
+        PreviewViewers &viewers = channel->viewers;
+        for (PreviewViewers::iterator v = viewers.begin();
+                v != viewers.end(); ) {
+            v->second.erase(session);
+            if (v->second.empty())
+                viewers.erase(v++);
+            else
+                ++v;
+        }
+        if (!viewers.empty()) {
+            ++it;
+            continue;
+        }
+
+        // no pump without viewers, it is joined by a later join() or stop()
+        channel->stop = true;
+        channel_lock.unlock();
+        channel->cond.notify_all();
+        stopped_.push_back(channel);
+        channels_.erase(it++);
+    }
+}
+
+void PreviewServer::pump(const std::shared_ptr<PreviewChannel> &channel)
+{
+    FrameRingReader reader;
+    FrameRingInfo info;
+    cv::Mat frame, scaled;
+    std::vector<uchar> jpeg;
+    std::vector<int> params(2, cv::IMWRITE_JPEG_QUALITY);
+    int timeouts = 0;
+
+    while (1) {
+        // viewers of this frame, by variant
+        std::vector<std::pair<PreviewVariant,
+                std::vector<std::shared_ptr<PreviewSession> > > > targets;
+        {
+            std::unique_lock<std::mutex> lock(channel->mutex);
+            channel->cond.wait(lock, [&channel]() {
+                return channel->stop || !channel->viewers.empty();
+            });
+            if (channel->stop)
+                return;
+            PreviewViewers::iterator v;
+            for (v = channel->viewers.begin();
+                    v != channel->viewers.end(); ++v)
+                targets.push_back(std::make_pair(v->first,
+                        std::vector<std::shared_ptr<PreviewSession> >(
+                                v->second.begin(), v->second.end())));
+        }
+
+        if (!reader.is_open() &&
+                !reader.open(FrameRingName(channel->camera_id))) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            continue;
+        }
+        if (!reader.next(frame, info, 500)) {
+            if (++timeouts >= kReopenTimeouts) {
+                reader.close();
+                timeouts = 0;
+            }
+            continue;
+        }
+        timeouts = 0;
+
+        // widths from the frame's up are all the frame itself, encoded
+        // once for them
+        std::map<PreviewVariant, PreviewPart> parts;
+        for (size_t i = 0; i < targets.size(); i++) {
+            PreviewVariant variant = targets[i].first;
+            if (variant.width >= frame.cols)
+                variant.width = 0;
+
+            PreviewPart &shared_part = parts[variant];
+            if (!shared_part) {
+                const cv::Mat *image = &frame;
+                if (variant.width > 0) {
+                    int height = (int)((int64_t)frame.rows * variant.width /
+                                       frame.cols);
+                    cv::resize(frame, scaled,
+                               cv::Size(variant.width, height), 0, 0,
+                               cv::INTER_AREA);
+                    image = &scaled;
+                }
+                params[1] = variant.quality;
+                if (!cv::imencode(".jpeg", *image, jpeg, params))
+                    continue;
+                channel->encodes++;
+
+                std::shared_ptr<string> part(new string());
+                part->reserve(jpeg.size() + 128);
+                *part += string("--") + kBoundary + "\r\n"
+                         "Content-Type: image/jpeg\r\n"
+                         "Content-Length: " + NumberToString(jpeg.size()) +
+                         "\r\n\r\n";
+                part->append((const char *)&jpeg[0], jpeg.size());
+                *part += "\r\n";
+                shared_part = part;
+            }
+
+            std::vector<std::shared_ptr<PreviewSession> > &sessions =
+                    targets[i].second;
+            PreviewPart sent_part(shared_part);
+            io_service_.post([sessions, sent_part]() {
+                for (size_t j = 0; j < sessions.size(); j++)
+                    sessions[j]->deliver(sent_part);
+            });
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef PREVIEWSERVER_H
+#define PREVIEWSERVER_H
+
+//
+// PreviewServer: live MJPEG preview of the cameras over HTTP.
+//
+//  GET /preview/<camera id>[?width=640&quality=70]
+// answers a multipart/x-mixed-replace stream of JPEG frames taken from
+// the camera's FrameRing (see VideoForwarder), so any bako process of
+// the host can be previewed by one server.
+//
+// A camera has one pump thread, while it has viewers, which reads the
+// newest frame from the ring and encodes it once per variant (width,
+// quality) that has viewers; widths from the frame's up are the frame
+// itself. The encoded part is shared by all viewers of the variant and
+// written to each of them without copying, so many viewers cost about
+// the same as one. A viewer whose socket is still busy with an older
+// frame only keeps the newest one, it never slows the others down.
+//
+// Only cameras whose ring exists are served, up to kMaxPreviewChannels.
+// Sockets run on one asio thread, like the redisclient.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include "shotid.h"
+
+using std::string;
+
+static const int kPreviewQuality = 70;
+// variants of a camera, viewers of more are turned away
+static const size_t kMaxPreviewVariants = 4;
+// cameras previewed at once, each has a pump thread
+static const size_t kMaxPreviewChannels = 16;
+
+struct PreviewChannel;
+class PreviewSession;
+
+class PreviewServer {
+public:
+    PreviewServer(const unsigned short port);
+    // stops
+    ~PreviewServer();
+
+    // bind and serve in the background, false if the port is taken
+    bool start();
+    void stop();
+
+    size_t get_viewers();
+    // JPEG encodes of all cameras, once per frame and variant
+    uint64_t get_encodes();
+
+private:
+    PreviewServer(const PreviewServer &);
+    PreviewServer &operator=(const PreviewServer &);
+
+    friend class PreviewSession;
+
+    void accept();
+    // add a viewer, false if the camera has kMaxPreviewVariants already
+    // or there are kMaxPreviewChannels cameras
+    bool join(const std::shared_ptr<PreviewSession> &session,
+              const CameraId &camera_id, const int width, const int quality);
+    // the channel stops with its last viewer
+    void leave(const std::shared_ptr<PreviewSession> &session);
+    void pump(const std::shared_ptr<PreviewChannel> &channel);
+    // join the pumps of stopped channels, all of them if wait
+    void reap(const bool wait);
+
+    unsigned short port_;
+    boost::asio::io_service io_service_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    std::thread io_thread_;
+
+    std::mutex mutex_;
+    std::map<CameraId, std::shared_ptr<PreviewChannel> > channels_;
+    // stopped, their pumps not joined yet
+    std::vector<std::shared_ptr<PreviewChannel> > stopped_;
+    uint64_t encodes_;          // of the stopped channels
+    bool stop_;
+};
+
+#endif // PREVIEWSERVER_H
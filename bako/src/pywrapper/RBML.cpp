@@ -2,12 +2,53 @@
 
 #include <boost/python.hpp>
 #include "getfeature.h"
+#include "pyblobstore.h"
+#include "pyconvert.h"
+#include "pyframering.h"
+#include "pyframeserver.h"
+#include "pypersonindex.h"
+#include "pypersondetector.h"
 
 using namespace boost::python;
 
 BOOST_PYTHON_MODULE(RBML)
 {
+    if (!InitPyConvert())
+        throw_error_already_set();
+
     class_<GetFeature>("GetFeature", init<const std::string &>())
             .def(init<const std::string &>())
-            .def("get_feature", &GetFeature::get_feature);
+            .def("get_feature", &GetFeature::get_feature)
+            .def("get_features", &GetFeature::get_features)
+            .def("migrate", &GetFeature::migrate);
+
+    class_<PyPersonDetector, boost::noncopyable>("PersonDetector",
+            init<const std::string &, optional<int> >())
+            .def("detect", &PyPersonDetector::detect)
+            .def("detect_rects", &PyPersonDetector::detect_rects)
+            .def("detect_batch", &PyPersonDetector::detect_batch);
+
+    class_<PyPersonIndex, boost::noncopyable>("PersonIndex",
+            init<optional<int, int64_t> >())
+            .def("insert", &PyPersonIndex::insert)
+            .def("search", &PyPersonIndex::search)
+            .def("size", &PyPersonIndex::size);
+
+    class_<PyFrameServer, boost::noncopyable>("FrameServer",
+                                              init<optional<size_t, size_t> >())
+            .def("fetch", &PyFrameServer::fetch)
+            .def("prefetch", &PyFrameServer::prefetch)
+            .def("cached_gops", &PyFrameServer::get_cached_gops)
+            .def("cached_bytes", &PyFrameServer::get_cached_bytes);
+
+    class_<PyFrameRing, boost::noncopyable>("FrameRing",
+                                            init<const std::string &>())
+            .def("latest", &PyFrameRing::latest)
+            .def("valid", &PyFrameRing::valid);
+
+    class_<PyBlobStore, boost::noncopyable>("BlobStore",
+                                            init<const std::string &>())
+            .def("put", &PyBlobStore::put)
+            .def("get", &PyBlobStore::get)
+            .def("contains", &PyBlobStore::contains);
 }
@@ -1,350 +1,17 @@
-#include "getfeature.h"
-
-// the following code is copied from 2.4.9/modules/python/src2
-//
-#include <Python.h>
-
-#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
-#include "numpy/ndarrayobject.h"
-
-#include <opencv2/core/core.hpp>
-
-static PyObject* opencv_error = 0;
-
-static int failmsg(const char *fmt, ...)
-{
-    char str[1000];
-
-    va_list ap;
-    va_start(ap, fmt);
-    vsnprintf(str, sizeof(str), fmt, ap);
-    va_end(ap);
-
-    PyErr_SetString(PyExc_TypeError, str);
-    return 0;
-}
-
-struct ArgInfo
-{
-    const char *name;
-    bool outputarg;
-    // more fields may be added if necessary
-
-    ArgInfo(const char * name_, bool outputarg_)
-        : name(name_)
-        , outputarg(outputarg_) {}
-
-    // to match with older pyopencv_to function signature
-    operator const char *() const { return name; }
-};
-
-class PyAllowThreads
-{
-public:
-    PyAllowThreads() : _state(PyEval_SaveThread()) {}
-    ~PyAllowThreads()
-    {
-        PyEval_RestoreThread(_state);
-    }
-private:
-    PyThreadState* _state;
-};
-
-class PyEnsureGIL
-{
-public:
-    PyEnsureGIL() : _state(PyGILState_Ensure()) {}
-    ~PyEnsureGIL()
-    {
-        PyGILState_Release(_state);
-    }
-private:
-    PyGILState_STATE _state;
-};
-
-#define ERRWRAP2(expr) \
-try \
-{ \
-    PyAllowThreads allowThreads; \
-    expr; \
-} \
-catch (const cv::Exception &e) \
-{ \
-    PyErr_SetString(opencv_error, e.what()); \
-    return 0; \
-}
-
-using namespace cv;
-
-static PyObject* failmsgp(const char *fmt, ...)
-{
-  char str[1000];
-
-  va_list ap;
-  va_start(ap, fmt);
-  vsnprintf(str, sizeof(str), fmt, ap);
-  va_end(ap);
-
-  PyErr_SetString(PyExc_TypeError, str);
-  return 0;
-}
-static size_t REFCOUNT_OFFSET = (size_t)&(((PyObject*)0)->ob_refcnt) +
-    (0x12345678 != *(const size_t*)"\x78\x56\x34\x12\0\0\0\0\0")*sizeof(int);
-
-static inline PyObject* pyObjectFromRefcount(const int* refcount)
-{
-    return (PyObject*)((size_t)refcount - REFCOUNT_OFFSET);
-}
-
-static inline int* refcountFromPyObject(const PyObject* obj)
-{
-    return (int*)((size_t)obj + REFCOUNT_OFFSET);
-}
-
-class NumpyAllocator : public MatAllocator
-{
-public:
-    NumpyAllocator() {}
-    ~NumpyAllocator() {}
-
-    void allocate(int dims, const int* sizes, int type, int*& refcount,
-                  uchar*& datastart, uchar*& data, size_t* step)
-    {
-        PyEnsureGIL gil;
-
-        int depth = CV_MAT_DEPTH(type);
-        int cn = CV_MAT_CN(type);
-        const int f = (int)(sizeof(size_t)/8);
-        int typenum = depth == CV_8U ? NPY_UBYTE : depth == CV_8S ? NPY_BYTE :
-                      depth == CV_16U ? NPY_USHORT : depth == CV_16S ? NPY_SHORT :
-                      depth == CV_32S ? NPY_INT : depth == CV_32F ? NPY_FLOAT :
-                      depth == CV_64F ? NPY_DOUBLE : f*NPY_ULONGLONG + (f^1)*NPY_UINT;
-        int i;
-        npy_intp _sizes[CV_MAX_DIM+1];
-        for( i = 0; i < dims; i++ )
-            _sizes[i] = sizes[i];
-        if( cn > 1 )
-        {
-            /*if( _sizes[dims-1] == 1 )
-                _sizes[dims-1] = cn;
-            else*/
-                _sizes[dims++] = cn;
-        }
-        PyObject* o = PyArray_SimpleNew(dims, _sizes, typenum);
-        if(!o)
-            CV_Error_(CV_StsError, ("The numpy array of typenum=%d, ndims=%d can not be created", typenum, dims));
-        refcount = refcountFromPyObject(o);
-        npy_intp* _strides = PyArray_STRIDES((PyArrayObject*) o);
-        for( i = 0; i < dims - (cn > 1); i++ )
-            step[i] = (size_t)_strides[i];
-        datastart = data = (uchar*)PyArray_DATA((PyArrayObject*) o);
-    }
-
-    void deallocate(int* refcount, uchar*, uchar*)
-    {
-        PyEnsureGIL gil;
-        if( !refcount )
-            return;
-        PyObject* o = pyObjectFromRefcount(refcount);
-        Py_INCREF(o);
-        Py_DECREF(o);
-    }
-};
-
-NumpyAllocator g_numpyAllocator;
-
-enum { ARG_NONE = 0, ARG_MAT = 1, ARG_SCALAR = 2 };
-
-// special case, when the convertor needs full ArgInfo structure
-static int pyopencv_to(const PyObject* o, Mat& m, const ArgInfo info, bool allowND=true)
-{
-    if(!o || o == Py_None)
-    {
-        if( !m.data )
-            m.allocator = &g_numpyAllocator;
-        return true;
-    }
-
-    if( PyInt_Check(o) )
-    {
-        double v[] = {PyInt_AsLong((PyObject*)o), 0., 0., 0.};
-        m = Mat(4, 1, CV_64F, v).clone();
-        return true;
-    }
-    if( PyFloat_Check(o) )
-    {
-        double v[] = {PyFloat_AsDouble((PyObject*)o), 0., 0., 0.};
-        m = Mat(4, 1, CV_64F, v).clone();
-        return true;
-    }
-    if( PyTuple_Check(o) )
-    {
-        int i, sz = (int)PyTuple_Size((PyObject*)o);
-        m = Mat(sz, 1, CV_64F);
-        for( i = 0; i < sz; i++ )
-        {
-            PyObject* oi = PyTuple_GET_ITEM(o, i);
-            if( PyInt_Check(oi) )
-                m.at<double>(i) = (double)PyInt_AsLong(oi);
-            else if( PyFloat_Check(oi) )
-                m.at<double>(i) = (double)PyFloat_AsDouble(oi);
-            else
-            {
-                failmsg("%s is not a numerical tuple", info.name);
-                m.release();
-                return false;
-            }
-        }
-        return true;
-    }
-
-    if( !PyArray_Check(o) )
-    {
-        failmsg("%s is not a numpy array, neither a scalar", info.name);
-        return false;
-    }
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
-    PyArrayObject* oarr = (PyArrayObject*) o;
-
-    bool needcopy = false, needcast = false;
-    int typenum = PyArray_TYPE(oarr), new_typenum = typenum;
-    int type = typenum == NPY_UBYTE ? CV_8U :
-               typenum == NPY_BYTE ? CV_8S :
-               typenum == NPY_USHORT ? CV_16U :
-               typenum == NPY_SHORT ? CV_16S :
-               typenum == NPY_INT ? CV_32S :
-               typenum == NPY_INT32 ? CV_32S :
-               typenum == NPY_FLOAT ? CV_32F :
-               typenum == NPY_DOUBLE ? CV_64F : -1;
-
-    if( type < 0 )
-    {
-        if( typenum == NPY_INT64 || typenum == NPY_UINT64 || type == NPY_LONG )
-        {
-            needcopy = needcast = true;
-            new_typenum = NPY_INT;
-            type = CV_32S;
-        }
-        else
-        {
-            failmsg("%s data type = %d is not supported", info.name, typenum);
-            return false;
-        }
-    }
-
-    int ndims = PyArray_NDIM(oarr);
-    if(ndims >= CV_MAX_DIM)
-    {
-        failmsg("%s dimensionality (=%d) is too high", info.name, ndims);
-        return false;
-    }
-
-    int size[CV_MAX_DIM+1];
-    size_t step[CV_MAX_DIM+1], elemsize = CV_ELEM_SIZE1(type);
-    const npy_intp* _sizes = PyArray_DIMS(oarr);
-    const npy_intp* _strides = PyArray_STRIDES(oarr);
-    bool ismultichannel = ndims == 3 && _sizes[2] <= CV_CN_MAX;
-
-    for( int i = ndims-1; i >= 0 && !needcopy; i-- )
-    {
-        // these checks handle cases of
-        //  a) multi-dimensional (ndims > 2) arrays, as well as simpler 1- and 2-dimensional cases
-        //  b) transposed arrays, where _strides[] elements go in non-descending order
-        //  c) flipped arrays, where some of _strides[] elements are negative
-        if( (i == ndims-1 && (size_t)_strides[i] != elemsize) ||
-            (i < ndims-1 && _strides[i] < _strides[i+1]) )
-            needcopy = true;
-    }
-
-    if( ismultichannel && _strides[1] != (npy_intp)elemsize*_sizes[2] )
-        needcopy = true;
-
-    if (needcopy)
-    {
-        if (info.outputarg)
-        {
-            failmsg("Layout of the output array %s is incompatible with cv::Mat (step[ndims-1] != elemsize or step[1] != elemsize*nchannels)", info.name);
-            return false;
-        }
-
-        if( needcast ) {
-            o = PyArray_Cast(oarr, new_typenum);
-            oarr = (PyArrayObject*) o;
-        }
-        else {
-            oarr = PyArray_GETCONTIGUOUS(oarr);
-            o = (PyObject*) oarr;
-        }
-
-        _strides = PyArray_STRIDES(oarr);
-    }
-
-    for(int i = 0; i < ndims; i++)
-    {
-        size[i] = (int)_sizes[i];
-        step[i] = (size_t)_strides[i];
-    }
-
-    // handle degenerate case
-    if( ndims == 0) {
-        size[ndims] = 1;
-        step[ndims] = elemsize;
-        ndims++;
-    }
-
-    if( ismultichannel )
-    {
-        ndims--;
-        type |= CV_MAKETYPE(0, size[2]);
-    }
-
-    if( ndims > 2 && !allowND )
-    {
-        failmsg("%s has more than 2 dimensions", info.name);
-        return false;
-    }
-
-    m = Mat(ndims, size, type, PyArray_DATA(oarr), step);
-
-    if( m.data )
-    {
-        m.refcount = refcountFromPyObject(o);
-        if (!needcopy)
-        {
-            m.addref(); // protect the original numpy array from deallocation
-                        // (since Mat destructor will decrement the reference counter)
-        }
-    };
-    m.allocator = &g_numpyAllocator;
-
-    return true;
-}
-
-static PyObject* pyopencv_from(const Mat& m)
-{
-    if( !m.data )
-        Py_RETURN_NONE;
-    Mat temp, *p = (Mat*)&m;
-    if(!p->refcount || p->allocator != &g_numpyAllocator)
-    {
-        temp.allocator = &g_numpyAllocator;
-        ERRWRAP2(m.copyTo(temp));
-        p = &temp;
-    }
-    p->addref();
-    return pyObjectFromRefcount(p->refcount);
-}
+#include "getfeature.h"
+#include "pyconvert.h"
 
 // Class GetFeature
 //
 GetFeature::GetFeature(const std::string &pca_file_path) {
-	//初始化pca
-    FileStorage fs_pca(pca_file_path,
-                       FileStorage::READ);
-	fs_pca["mean"] >> pca.mean;
-	fs_pca["eigenvalues"] >> pca.eigenvalues;
-	fs_pca["eigenvectors"] >> pca.eigenvectors;
-	fs_pca.release();
+	//初始化pca, shared with every other instance of the path
+    model = SharedFeatureModel(pca_file_path);
+    if (!model->is_open())
+        throw std::invalid_argument("bad feature model");
 }
 
 /************************************************************************
@@ -550,7 +217,8 @@ void GetFeature::cpyMat(Mat src, Mat dst, int& num)const {
 *返回：PCA降维后结果
 **************************************************************************/
 Mat GetFeature::doPCA(Mat feature)const {
-	return pca.project(feature);
+	// PCA and the metric fused, see FeatureModel
+	return model->embed(feature);
 }
 
 /************************************************************************
@@ -599,14 +267,85 @@ Mat GetFeature::getFeature(Mat img) const
 	return pcaFeature;
 }
 
+// Features of imgs[begin, end) into rows of features.
+//
+class FeatureBody : public cv::ParallelLoopBody {
+public:
+    FeatureBody(const GetFeature &get_feature,
+                const std::vector<std::unique_ptr<PyBufferMat> > &imgs,
+                Mat &features)
+        : get_feature_(get_feature), imgs_(imgs), features_(features) {}
+
+    void operator()(const cv::Range &range) const
+    {
+        for (int i = range.start; i < range.end; i++) {
+            Mat feature = get_feature_.getFeature(imgs_[i]->get_mat());
+            feature.reshape(1, 1).convertTo(features_.row(i), CV_32F);
+        }
+    }
+
+private:
+    const GetFeature &get_feature_;
+    const std::vector<std::unique_ptr<PyBufferMat> > &imgs_;
+    Mat &features_;
+};
+
 // conveter
 //
 PyObject *GetFeature::get_feature(PyObject *img) const
 {
-    cv::Mat cv_image;
-    pyopencv_to(img, cv_image, ArgInfo("img", false));
+    PyBufferMat buffer;
+    if (!buffer.open(img, "img"))
+        return NULL;
+
+    Mat feature;
+    {
+        PyAllowThreads allow_threads;
+        feature = getFeature(buffer.get_mat());
+    }
+
+    return MatToPyObject(feature);
+}
+
+PyObject *GetFeature::migrate(PyObject *vector) const
+{
+    PyBufferMat buffer;
+    if (!buffer.open(vector, "vector"))
+        return NULL;
+    if ((int)buffer.get_mat().total() != model->get_pca().eigenvectors.rows) {
+        PyErr_SetString(PyExc_ValueError, "vector is not a PCA projection");
+        return NULL;
+    }
 
-    cv::Mat processed_image = getFeature(cv_image);
+    return MatToPyObject(model->migrate(buffer.get_mat()));
+}
+
+PyObject *GetFeature::get_features(PyObject *imgs) const
+{
+    PyObject *seq = PySequence_Fast(imgs, "imgs is not a sequence");
+    if (!seq)
+        return NULL;
+
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    std::vector<std::unique_ptr<PyBufferMat> > buffers;
+    for (Py_ssize_t i = 0; i < n; i++) {
+        buffers.push_back(std::unique_ptr<PyBufferMat>(new PyBufferMat));
+        if (!buffers.back()->open(PySequence_Fast_GET_ITEM(seq, i), "img")) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+
+    Mat features((int)n, kFeatureDims, CV_32F);
+    {
+        PyAllowThreads allow_threads;
+        // images spread over the cores
+        cv::parallel_for_(cv::Range(0, (int)n),
+                          FeatureBody(*this, buffers, features));
+    }
+    // buffers are released with the GIL, before the sequence holding them
+    buffers.clear();
+    Py_DECREF(seq);
 
-    return pyopencv_from(processed_image);
+    return RowsToPyObject(features, kFeatureDims, CV_32F);
 }
@@ -15,15 +15,21 @@
 #ifndef GETFEATURE_H
 #define GETFEATURE_H
 
+#include <memory>
 #include <string>
 #include <Python.h>
 #include <opencv2/opencv.hpp>
+#include "../RBML/featuremodel.h"
 
 using namespace cv;
 
+// dimensions of a feature after PCA
+static const int kFeatureDims = 100;
+
 class GetFeature {
 private:
-    PCA pca;	// use to PCA
+    // use to PCA and the metric
+    std::shared_ptr<const FeatureModel> model;
 
 private:
 	// create mask to divided the person image into six horizontal stripes.
@@ -38,16 +44,24 @@ private:
     // copy src to dst
 	void cpyMat(Mat src, Mat dst, int& num)const;
 
-    // do PCA
+    // do PCA, to the embedding of the model
 	Mat doPCA(Mat feature)const;
 
 public:
+    // a model file or PCA.xml, see FeatureModel
     GetFeature(const std::string &pca_file_path);
     ~GetFeature() {}
 
     // extract feature vector of person image
     Mat getFeature(Mat img) const;
+    // feature of an image array, without the GIL
     PyObject *get_feature(PyObject *img) const;
+    // embedding of a vector saved before the PCA and the metric were
+    // fused, an array of 100 x 1, see FeatureModel::migrate()
+    PyObject *migrate(PyObject *vector) const;
+    // features of a sequence of image arrays as rows of an N x 100
+    // float32 array, the images spread over the cores without the GIL
+    PyObject *get_features(PyObject *imgs) const;
 };
 
 #endif // GETFEATURE_H
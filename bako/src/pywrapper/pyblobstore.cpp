@@ -0,0 +1,37 @@
+#include <memory>
+#include <string>
+
+#include "pyblobstore.h"
+#include "pyconvert.h"
+
+PyBlobStore::PyBlobStore(const std::string &root)
+      : store_(new BlobStore(root))
+{
+}
+
+bool PyBlobStore::put(const std::string &key, const std::string &data)
+{
+    PyAllowThreads allow_threads;
+    return store_->put(key, data);
+}
+
+PyObject *PyBlobStore::get(const std::string &key)
+{
+    std::string data;
+    bool ok;
+    {
+        PyAllowThreads allow_threads;
+        ok = store_->get(key, data);
+    }
+
+    if (!ok)
+        Py_RETURN_NONE;
+
+    return PyBytes_FromStringAndSize(data.data(), data.size());
+}
+
+bool PyBlobStore::contains(const std::string &key)
+{
+    PyAllowThreads allow_threads;
+    return store_->contains(key);
+}
@@ -0,0 +1,27 @@
+//
+// Python wrapper of BlobStore, blobs go in and come back as str.
+//
+#ifndef PYBLOBSTORE_H
+#define PYBLOBSTORE_H
+
+#include <memory>
+#include <string>
+
+#include <Python.h>
+#include "../blobstore.h"
+
+class PyBlobStore {
+public:
+    PyBlobStore(const std::string &root);
+    ~PyBlobStore() {}
+
+    bool put(const std::string &key, const std::string &data);
+    // str of the blob, None if not found
+    PyObject *get(const std::string &key);
+    bool contains(const std::string &key);
+
+private:
+    std::unique_ptr<BlobStore> store_;
+};
+
+#endif // PYBLOBSTORE_H
@@ -0,0 +1,195 @@
+#include <cstring>
+#include <memory>
+
+#include <Python.h>
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include "numpy/ndarrayobject.h"
+
+#include <opencv2/opencv.hpp>
+#include "pyconvert.h"
+
+// depth of a buffer format, -1 if a Mat can not hold it
+static int FormatDepth(const char *format, const Py_ssize_t itemsize)
+{
+    if (format == NULL)
+        return itemsize == 1 ? CV_8U : -1;
+    // native or little endian only
+    if (*format == '@' || *format == '=' || *format == '<')
+        format++;
+    if (format[0] == '\0' || format[1] != '\0')
+        return -1;
+
+    int depth;
+    switch (*format) {
+    case 'B': depth = CV_8U; break;
+    case 'b': depth = CV_8S; break;
+    case 'H': depth = CV_16U; break;
+    case 'h': depth = CV_16S; break;
+    case 'i': case 'l': depth = CV_32S; break;
+    case 'f': depth = CV_32F; break;
+    case 'd': depth = CV_64F; break;
+    default: return -1;
+    }
+
+    // 'l' is 64 bits on LP64
+    return CV_ELEM_SIZE1(depth) == itemsize ? depth : -1;
+}
+
+PyBufferMat::PyBufferMat()
+{
+    held_ = false;
+}
+
+PyBufferMat::~PyBufferMat()
+{
+    release();
+}
+
+bool PyBufferMat::open(PyObject *o, const char *name)
+{
+    release();
+
+    if (o == NULL || PyObject_GetBuffer(o, &view_,
+                                        PyBUF_STRIDES | PyBUF_FORMAT) != 0) {
+        PyErr_Format(PyExc_TypeError, "%s is not an array", name);
+        return false;
+    }
+    held_ = true;
+
+    int depth = FormatDepth(view_.format, view_.itemsize);
+    if (depth < 0) {
+        PyErr_Format(PyExc_TypeError, "%s has an unsupported type %s", name,
+                     view_.format ? view_.format : "B");
+        release();
+        return false;
+    }
+    if (view_.ndim != 2 && view_.ndim != 3) {
+        PyErr_Format(PyExc_ValueError, "%s is not 2 or 3 dimensional", name);
+        release();
+        return false;
+    }
+
+    int rows = (int)view_.shape[0], cols = (int)view_.shape[1];
+    int channels = view_.ndim == 3 ? (int)view_.shape[2] : 1;
+    // elements of a row are contiguous, rows may be apart
+    bool layout = channels <= CV_CN_MAX &&
+                  view_.strides[1] == view_.itemsize * channels &&
+                  (view_.ndim == 2 || view_.strides[2] == view_.itemsize) &&
+                  view_.strides[0] >= view_.strides[1] * cols;
+    if (!layout) {
+        PyErr_Format(PyExc_ValueError,
+                     "%s rows are not contiguous, see numpy.ascontiguousarray",
+                     name);
+        release();
+        return false;
+    }
+
+    mat_ = cv::Mat(rows, cols, CV_MAKETYPE(depth, channels), view_.buf,
+                   (size_t)view_.strides[0]);
+
+    return true;
+}
+
+void PyBufferMat::release()
+{
+    mat_.release();
+    if (held_) {
+        PyBuffer_Release(&view_);
+        held_ = false;
+    }
+}
+
+bool InitPyConvert()
+{
+    // native calls release the GIL, threads are always on since 3.7
+#if PY_VERSION_HEX < 0x03070000
+    PyEval_InitThreads();
+#endif
+
+    return _import_array() >= 0;
+}
+
+static int NumpyType(const int depth)
+{
+    return depth == CV_8U ? NPY_UBYTE : depth == CV_8S ? NPY_BYTE :
+           depth == CV_16U ? NPY_USHORT : depth == CV_16S ? NPY_SHORT :
+           depth == CV_32S ? NPY_INT : depth == CV_32F ? NPY_FLOAT :
+           NPY_DOUBLE;
+}
+
+static void ReleaseOwner(PyObject *capsule)
+{
+    delete (std::shared_ptr<const void> *)PyCapsule_GetPointer(capsule, NULL);
+}
+
+// numpy array over rows x cols of type at data, rows step bytes apart,
+// which holds owner through its base
+static PyObject *WrapToPyObject(const void *data, const int rows,
+                                const int cols, const int type,
+                                const size_t step,
+                                const std::shared_ptr<const void> &owner,
+                                const bool readonly)
+{
+    int channels = CV_MAT_CN(type);
+    npy_intp dims[] = {rows, cols, channels};
+    npy_intp strides[] = {(npy_intp)step, CV_ELEM_SIZE(type),
+                          CV_ELEM_SIZE1(type)};
+    int flags = NPY_ARRAY_ALIGNED | (readonly ? 0 : NPY_ARRAY_WRITEABLE);
+
+    PyObject *o = PyArray_New(&PyArray_Type, channels > 1 ? 3 : 2, dims,
+                              NumpyType(CV_MAT_DEPTH(type)), strides,
+                              (void *)data, 0, flags, NULL);
+    if (!o)
+        return NULL;
+
+    // the array holds the owner through its base, which takes the capsule
+    // even if it fails
+    std::shared_ptr<const void> *held = new std::shared_ptr<const void>(owner);
+    PyObject *capsule = PyCapsule_New(held, NULL, ReleaseOwner);
+    if (!capsule) {
+        delete held;
+        Py_DECREF(o);
+        return NULL;
+    }
+    if (PyArray_SetBaseObject((PyArrayObject *)o, capsule) < 0) {
+        Py_DECREF(o);
+        return NULL;
+    }
+
+    return o;
+}
+
+PyObject *MatToPyObject(const cv::Mat &m, const bool readonly)
+{
+    if (m.empty())
+        Py_RETURN_NONE;
+    if (m.dims != 2) {
+        PyErr_SetString(PyExc_ValueError, "Mat is not 2 dimensional");
+        return NULL;
+    }
+
+    // a header of m shares its buffer and keeps it alive
+    std::shared_ptr<const void> owner(new cv::Mat(m));
+
+    return WrapToPyObject(m.data, m.rows, m.cols, m.type(), m.step[0], owner,
+                          readonly);
+}
+
+PyObject *RowsToPyObject(const cv::Mat &m, const int cols, const int type)
+{
+    if (!m.empty())
+        return MatToPyObject(m);
+
+    npy_intp dims[] = {0, cols};
+
+    return PyArray_ZEROS(2, dims, NumpyType(CV_MAT_DEPTH(type)), 0);
+}
+
+PyObject *SharedToPyObject(const void *data, const int rows, const int cols,
+                           const int type,
+                           const std::shared_ptr<const void> &owner)
+{
+    return WrapToPyObject(data, rows, cols, type,
+                          (size_t)cols * CV_ELEM_SIZE(type), owner, true);
+}
@@ -0,0 +1,74 @@
+//
+// Conversions between python objects and cv::Mat shared by the wrappers.
+//
+// Inputs are read through the buffer protocol, so numpy arrays (or any
+// object exporting a strided buffer) are seen as a Mat without copying.
+// Outputs are numpy arrays over the Mat's own buffer, which the array
+// keeps alive through its base, so they are not copied either and no
+// numpy allocator is involved.
+//
+// Native calls run with the GIL released for their whole length.
+//
+#ifndef PYCONVERT_H
+#define PYCONVERT_H
+
+#include <memory>
+
+#include <Python.h>
+#include <opencv2/opencv.hpp>
+
+class PyAllowThreads
+{
+public:
+    PyAllowThreads() : _state(PyEval_SaveThread()) {}
+    ~PyAllowThreads()
+    {
+        PyEval_RestoreThread(_state);
+    }
+private:
+    PyThreadState* _state;
+};
+
+// A python buffer seen as a Mat, valid as long as this holds it. The
+// buffer may be read without the GIL, it is released with it.
+//
+class PyBufferMat {
+public:
+    PyBufferMat();
+    ~PyBufferMat();
+
+    // false with a python error set unless o exports a buffer of uint8,
+    // int8, (u)int16, int32, float32 or float64, as rows x cols or
+    // rows x cols x channels, whose rows hold contiguous elements
+    bool open(PyObject *o, const char *name);
+    void release();
+
+    const cv::Mat &get_mat() const { return mat_; }
+
+private:
+    PyBufferMat(const PyBufferMat &);
+    PyBufferMat &operator=(const PyBufferMat &);
+
+    Py_buffer view_;
+    bool held_;
+    cv::Mat mat_;
+};
+
+// import numpy, once at module init
+bool InitPyConvert();
+
+// numpy array over the buffer of m, None if m is empty. Read-only arrays
+// can not be written from python.
+PyObject *MatToPyObject(const cv::Mat &m, const bool readonly = false);
+
+// as MatToPyObject() for rows x cols of type, but an array of 0 rows when
+// m is empty
+PyObject *RowsToPyObject(const cv::Mat &m, const int cols, const int type);
+
+// read-only numpy array over rows x cols of type at data, without
+// copying, owner keeps data alive as long as the array
+PyObject *SharedToPyObject(const void *data, const int rows, const int cols,
+                           const int type,
+                           const std::shared_ptr<const void> &owner);
+
+#endif // PYCONVERT_H
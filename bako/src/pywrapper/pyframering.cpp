@@ -0,0 +1,64 @@
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "pyframering.h"
+#include "pyconvert.h"
+#include "../sugar/timestamp.h"
+
+PyFrameRing::PyFrameRing(const std::string &camera_id)
+{
+    CameraId id;
+    if (!ParseId(camera_id, id))
+        throw std::invalid_argument("bad camera id");
+
+    name_ = FrameRingName(id);
+}
+
+PyObject *PyFrameRing::latest(const int timeout_ms)
+{
+    FrameRingView view;
+    std::shared_ptr<const void> mapping;
+    bool ok;
+    {
+        PyAllowThreads allow_threads;
+        std::lock_guard<std::mutex> lock(mutex_);
+        ok = (reader_.is_open() || reader_.open(name_)) &&
+             reader_.peek(view, timeout_ms);
+        // Nothing new: frames come slower than the polls, or the writer
+        // was restarted into a new segment. The newest frame of the
+        // segment as it is now.
+        if (!ok)
+            ok = reader_.open(name_) && reader_.peek_newest(view);
+        // the views keep the segment mapped, whatever the reader does next
+        if (ok)
+            mapping = reader_.get_mapping();
+    }
+
+    if (!ok)
+        Py_RETURN_NONE;
+
+    PyObject *frame = SharedToPyObject(view.data, view.rows, view.cols,
+                                       view.type, mapping);
+    PyObject *rects = SharedToPyObject(view.rect, view.rects, 4, CV_32S,
+                                       mapping);
+    if (!frame || !rects) {
+        Py_XDECREF(frame);
+        Py_XDECREF(rects);
+        return NULL;
+    }
+
+    return Py_BuildValue("(NNKsk)", frame, rects,
+                         (unsigned long long)view.frame,
+                         IdToString(view.video_id).c_str(),
+                         (unsigned long)view.frame_pos);
+}
+
+bool PyFrameRing::valid(const uint64_t frame)
+{
+    PyAllowThreads allow_threads;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return reader_.valid(frame);
+}
@@ -0,0 +1,35 @@
+//
+// Python wrapper of FrameRingReader, the live frames and persons bako
+// forwards, mapped as read-only numpy arrays without copying.
+//
+#ifndef PYFRAMERING_H
+#define PYFRAMERING_H
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+
+#include <Python.h>
+#include "../framering.h"
+
+class PyFrameRing {
+public:
+    // camera id as in shotid.h, e.g. "c0a87193"
+    PyFrameRing(const std::string &camera_id);
+    ~PyFrameRing() {}
+
+    // (frame, rects, frame, video_id, frame_pos) of the newest frame, one
+    // not read before if it comes within timeout_ms, else the newest one
+    // again. None while bako publishes nothing. frame and rects are views
+    // of the ring, check valid(frame) once done with them.
+    PyObject *latest(const int timeout_ms);
+    bool valid(const uint64_t frame);
+
+private:
+    std::string name_;
+    // the reader is shared by python threads which release the GIL
+    std::mutex mutex_;
+    FrameRingReader reader_;
+};
+
+#endif // PYFRAMERING_H
@@ -0,0 +1,52 @@
+#include <memory>
+#include <string>
+
+#include "pyframeserver.h"
+#include "pyconvert.h"
+
+PyFrameServer::PyFrameServer(const size_t cache_bytes, const size_t workers)
+      : server_(new FrameServer(cache_bytes, workers))
+{
+}
+
+PyFrameServer::~PyFrameServer()
+{
+    // joining the workers may take a while
+    PyAllowThreads allow_threads;
+    server_.reset();
+}
+
+PyObject *PyFrameServer::fetch(const std::string &video_path,
+                               const size_t frame_pos)
+{
+    cv::Mat frame;
+    bool ok;
+    {
+        PyAllowThreads allow_threads;
+        ok = server_->fetch(video_path, frame_pos, frame);
+    }
+
+    if (!ok)
+        Py_RETURN_NONE;
+
+    return MatToPyObject(frame, true);
+}
+
+void PyFrameServer::prefetch(const std::string &video_path,
+                             const size_t frame_pos)
+{
+    PyAllowThreads allow_threads;
+    server_->prefetch(video_path, frame_pos);
+}
+
+size_t PyFrameServer::get_cached_gops()
+{
+    PyAllowThreads allow_threads;
+    return server_->get_cached_gops();
+}
+
+size_t PyFrameServer::get_cached_bytes()
+{
+    PyAllowThreads allow_threads;
+    return server_->get_cached_bytes();
+}
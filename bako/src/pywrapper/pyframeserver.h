@@ -0,0 +1,31 @@
+//
+// Python wrapper of FrameServer, frames come back as read-only numpy
+// arrays sharing the server's cached buffers.
+//
+#ifndef PYFRAMESERVER_H
+#define PYFRAMESERVER_H
+
+#include <memory>
+#include <string>
+
+#include <Python.h>
+#include "../frameserver.h"
+
+class PyFrameServer {
+public:
+    // cache_bytes bounds the decoded frames, see FrameServer
+    PyFrameServer(const size_t cache_bytes = kFrameCacheBytes,
+                  const size_t workers = 4);
+    ~PyFrameServer();
+
+    // numpy array of the frame, None if not found
+    PyObject *fetch(const std::string &video_path, const size_t frame_pos);
+    void prefetch(const std::string &video_path, const size_t frame_pos);
+    size_t get_cached_gops();
+    size_t get_cached_bytes();
+
+private:
+    std::unique_ptr<FrameServer> server_;
+};
+
+#endif // PYFRAMESERVER_H
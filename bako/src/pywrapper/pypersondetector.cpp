@@ -0,0 +1,143 @@
+#include <memory>
+#include <vector>
+
+#include "pypersondetector.h"
+#include "pyconvert.h"
+
+PyPersonDetector::PyPersonDetector(const std::string &pca_file_path,
+                                   const int proxy_width)
+    : get_feature_(pca_file_path), proxy_width_(proxy_width)
+{
+}
+
+bool PyPersonDetector::open(PyObject *img, PyBufferMat &buffer) const
+{
+    if (!buffer.open(img, "img"))
+        return false;
+    if (buffer.get_mat().type() != CV_8UC3) {
+        PyErr_SetString(PyExc_ValueError, "img is not a BGR image");
+        buffer.release();
+        return false;
+    }
+
+    return true;
+}
+
+void PyPersonDetector::run(const cv::Mat &frame, cv::Mat &rects,
+                           cv::Mat *features) const
+{
+    // as the extractor, found on the proxy and cropped from the frame
+    cv::Mat proxy;
+    MakeProxy(frame, proxy, proxy_width_);
+    std::vector<cv::Rect> found_rects;
+    std::vector<cv::Rect> proxy_rects(detector_.detect(proxy));
+    for (size_t i = 0; i < proxy_rects.size(); i++) {
+        cv::Rect r = ScaleRect(proxy_rects[i], proxy.size(), frame.size());
+        if (r.area() > 0)
+            found_rects.push_back(r);
+    }
+
+    rects.create(found_rects.size(), 4, CV_32S);
+    for (size_t i = 0; i < found_rects.size(); i++) {
+        rects.at<int>(i, 0) = found_rects[i].x;
+        rects.at<int>(i, 1) = found_rects[i].y;
+        rects.at<int>(i, 2) = found_rects[i].width;
+        rects.at<int>(i, 3) = found_rects[i].height;
+    }
+    if (features == NULL)
+        return;
+
+    features->create(found_rects.size(), kFeatureDims, CV_32F);
+    cv::Mat person;     // its buffer is reused for every person
+    for (size_t i = 0; i < found_rects.size(); i++) {
+        CropPerson(frame, found_rects[i], person);
+        cv::Mat feature = get_feature_.getFeature(person);
+        feature.reshape(1, 1).convertTo(features->row(i), CV_32F);
+    }
+}
+
+// (rects, features) as numpy arrays, NULL on error
+static PyObject *ResultToPyObject(const cv::Mat &rects,
+                                  const cv::Mat &features)
+{
+    PyObject *py_rects = RowsToPyObject(rects, 4, CV_32S);
+    PyObject *py_features = RowsToPyObject(features, kFeatureDims, CV_32F);
+    if (!py_rects || !py_features) {
+        Py_XDECREF(py_rects);
+        Py_XDECREF(py_features);
+        return NULL;
+    }
+
+    return Py_BuildValue("(NN)", py_rects, py_features);
+}
+
+PyObject *PyPersonDetector::detect(PyObject *img) const
+{
+    PyBufferMat buffer;
+    if (!open(img, buffer))
+        return NULL;
+
+    cv::Mat rects, features;
+    {
+        PyAllowThreads allow_threads;
+        run(buffer.get_mat(), rects, &features);
+    }
+
+    return ResultToPyObject(rects, features);
+}
+
+PyObject *PyPersonDetector::detect_rects(PyObject *img) const
+{
+    PyBufferMat buffer;
+    if (!open(img, buffer))
+        return NULL;
+
+    cv::Mat rects;
+    {
+        PyAllowThreads allow_threads;
+        run(buffer.get_mat(), rects, NULL);
+    }
+
+    return RowsToPyObject(rects, 4, CV_32S);
+}
+
+PyObject *PyPersonDetector::detect_batch(PyObject *imgs) const
+{
+    PyObject *seq = PySequence_Fast(imgs, "imgs is not a sequence");
+    if (!seq)
+        return NULL;
+
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    std::vector<std::unique_ptr<PyBufferMat> > buffers;
+    for (Py_ssize_t i = 0; i < n; i++) {
+        buffers.push_back(std::unique_ptr<PyBufferMat>(new PyBufferMat));
+        if (!open(PySequence_Fast_GET_ITEM(seq, i), *buffers.back())) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+
+    std::vector<cv::Mat> rects(n), features(n);
+    {
+        PyAllowThreads allow_threads;
+        // HOG spreads a frame over the cores already
+        for (Py_ssize_t i = 0; i < n; i++)
+            run(buffers[i]->get_mat(), rects[i], &features[i]);
+    }
+    buffers.clear();
+    Py_DECREF(seq);
+
+    PyObject *results = PyList_New(n);
+    if (!results)
+        return NULL;
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject *result = ResultToPyObject(rects[i], features[i]);
+        if (!result) {
+            Py_DECREF(results);
+            return NULL;
+        }
+        PyList_SET_ITEM(results, i, result);
+    }
+
+    return results;
+}
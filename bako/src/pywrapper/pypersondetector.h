@@ -0,0 +1,45 @@
+//
+// Python wrapper of the person pipeline of the extractor: detection on a
+// proxy_width wide proxy, crops of the frame and their features in one
+// call, without the GIL, so the actor finds and describes persons as
+// bako does.
+//
+#ifndef PYPERSONDETECTOR_H
+#define PYPERSONDETECTOR_H
+
+#include <string>
+
+#include <Python.h>
+#include "getfeature.h"
+#include "pyconvert.h"
+#include "../persondetector.h"
+
+class PyPersonDetector {
+public:
+    // PCA of the features, e.g. bako/src/RBML/PCA.xml, proxy_width 0
+    // detects on the full frame
+    PyPersonDetector(const std::string &pca_file_path,
+                     const int proxy_width = kProxyWidth);
+    ~PyPersonDetector() {}
+
+    // (rects, features) of the persons in a BGR image, rects an N x 4
+    // int32 array of x, y, width, height and features N x 100 float32
+    PyObject *detect(PyObject *img) const;
+    // rects only, without the features
+    PyObject *detect_rects(PyObject *img) const;
+    // [(rects, features), ...] of a sequence of images, in one call
+    // without the GIL
+    PyObject *detect_batch(PyObject *imgs) const;
+
+private:
+    // false with a python error set unless img is a BGR image
+    bool open(PyObject *img, PyBufferMat &buffer) const;
+    // features too unless NULL
+    void run(const cv::Mat &frame, cv::Mat &rects, cv::Mat *features) const;
+
+    PersonDetector detector_;
+    GetFeature get_feature_;
+    int proxy_width_;
+};
+
+#endif // PYPERSONDETECTOR_H
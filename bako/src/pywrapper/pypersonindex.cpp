@@ -0,0 +1,82 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "pypersonindex.h"
+#include "pyconvert.h"
+
+using namespace boost::python;
+
+// partitions of an hour, as PersonIndex's default
+static const int64_t kBucketMs = 3600000;
+
+PyPersonIndex::PyPersonIndex(const int dimension, const int64_t retention_ms)
+    : index_(dimension, kBucketMs, retention_ms)
+{
+}
+
+bool PyPersonIndex::insert(const std::string &shot_id,
+                           const int64_t timestamp, PyObject *vector)
+{
+    PersonShotId id;
+    if (!ParseId(shot_id, id))
+        return false;
+
+    PyBufferMat buffer;
+    if (!buffer.open(vector, "vector"))
+        throw_error_already_set();
+
+    {
+        PyAllowThreads allow_threads;
+        index_.insert(id, timestamp, buffer.get_mat());
+    }
+
+    return true;
+}
+
+PyObject *PyPersonIndex::search(PyObject *query, const size_t k,
+                                const object &cam_ids,
+                                const int64_t time_start,
+                                const int64_t time_end) const
+{
+    SearchFilter filter;
+    filter.time_start = time_start;
+    filter.time_end = time_end;
+    for (Py_ssize_t i = 0; i < len(cam_ids); ++i) {
+        CameraId cam_id;
+        if (!ParseId(extract<std::string>(cam_ids[i])(), cam_id)) {
+            PyErr_SetString(PyExc_ValueError, "bad camera id");
+            throw_error_already_set();
+        }
+        filter.cam_ids.insert(cam_id);
+    }
+
+    PyBufferMat buffer;
+    if (!buffer.open(query, "query"))
+        throw_error_already_set();
+
+    std::vector<SearchResult> results;
+    {
+        PyAllowThreads allow_threads;
+        results = index_.search(buffer.get_mat(), k, filter);
+    }
+    buffer.release();
+
+    PyObject *list = PyList_New(results.size());
+    if (!list)
+        throw_error_already_set();
+    for (size_t i = 0; i < results.size(); ++i) {
+        PyObject *item = Py_BuildValue("(ssLd)",
+                results[i].id.to_string().c_str(),
+                results[i].cam_id.to_string().c_str(),
+                (long long)results[i].timestamp,
+                (double)results[i].distance);
+        if (!item) {
+            Py_DECREF(list);
+            throw_error_already_set();
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+
+    return list;
+}
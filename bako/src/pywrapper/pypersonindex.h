@@ -0,0 +1,42 @@
+//
+// Python wrapper of PersonIndex, for the actor to rank its searches.
+//
+// The actor fills it with the shots bako saved in redis and queries it
+// with a camera set and a time range, the filters are pushed down into
+// the index. Calls run without the GIL, a bad vector or camera id
+// raises TypeError or ValueError.
+//
+#ifndef PYPERSONINDEX_H
+#define PYPERSONINDEX_H
+
+#include <stdint.h>
+#include <string>
+
+#include <Python.h>
+#include <boost/python.hpp>
+#include "../personindex.h"
+
+class PyPersonIndex {
+public:
+    // retention_ms as PersonIndex's, 0 keeps everything
+    PyPersonIndex(const int dimension = 100,
+                  const int64_t retention_ms = 0);
+    ~PyPersonIndex() {}
+
+    // shot id as in shotid.h, timestamp in epoch ms, vector of dimension
+    // floats, false if the id is malformed
+    bool insert(const std::string &shot_id, const int64_t timestamp,
+                PyObject *vector);
+    // [(shot id, cam id, timestamp, distance), ...] of the k nearest
+    // shots of query, nearest first. cam_ids is a sequence of camera ids,
+    // empty for every camera, time range is [time_start, time_end).
+    PyObject *search(PyObject *query, const size_t k,
+                     const boost::python::object &cam_ids,
+                     const int64_t time_start, const int64_t time_end) const;
+    size_t size() const { return index_.size(); }
+
+private:
+    PersonIndex index_;
+};
+
+#endif // PYPERSONINDEX_H
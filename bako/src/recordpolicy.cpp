@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <limits>
+#include <string>
+
+#include "recordpolicy.h"
+
+using std::string;
+
+static const int64_t kNever = std::numeric_limits<int64_t>::min();
+
+bool ParseGateMode(const string &name, GateMode &mode)
+{
+    if (name == "continuous")
+        mode = kGateContinuous;
+    else if (name == "motion")
+        mode = kGateMotion;
+    else if (name == "person")
+        mode = kGatePerson;
+    else if (name == "timelapse")
+        mode = kGateTimelapse;
+    else
+        return false;
+
+    return true;
+}
+
+RecordPolicy::RecordPolicy(const GateMode mode, const int hold,
+                           const int timelapse_interval)
+{
+    mode_ = mode;
+    hold_ms_ = (int64_t)hold * 1000;
+    timelapse_ms_ = (int64_t)timelapse_interval * 1000;
+    // record until the first signal says otherwise
+    recording_ = true;
+    active_until_ = kNever;
+    last_timelapse_ = kNever;
+}
+
+bool RecordPolicy::admit(const bool is_key, const int64_t time_ms)
+{
+    if (mode_ == kGateContinuous)
+        return true;
+
+    // stop on the first GOP after the hold time
+    if (recording_ && is_key && time_ms > active_until_)
+        recording_ = false;
+    if (recording_)
+        return true;
+
+    // idle, keep a keyframe per interval
+    if (mode_ == kGateTimelapse && is_key &&
+            (last_timelapse_ == kNever ||
+             time_ms - last_timelapse_ >= timelapse_ms_)) {
+        last_timelapse_ = time_ms;
+        return true;
+    }
+
+    return false;
+}
+
+bool RecordPolicy::notify(const ExtractorSignal &signal, const int64_t time_ms)
+{
+    bool active = false;
+    switch (mode_) {
+    case kGateContinuous:
+        return false;
+    case kGateMotion:
+    case kGateTimelapse:
+        active = signal.keyframe;
+        break;
+    case kGatePerson:
+        active = signal.persons > 0;
+        break;
+    }
+
+    if (!active)
+        return false;
+
+    active_until_ = time_ms + hold_ms_;
+    if (recording_)
+        return false;
+
+    recording_ = true;
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef RECORDPOLICY_H
+#define RECORDPOLICY_H
+
+//
+// RecordPolicy: decide which packets of a stream are recorded.
+//
+// Modes:
+//  continuous: every packet.
+//  motion: while the extractor finds new keyframes (scene changes).
+//  person: while persons are detected.
+//  timelapse: as motion, and one keyframe per interval while idle.
+//
+// Recording goes on for `hold` seconds after the last activity and stops
+// on the next keyframe after that, so a recorded part always starts and
+// ends on GOP boundaries. Activity found in the middle of an idle GOP
+// resumes recording from the GOP's keyframe, which the caller replays
+// from its PacketRing.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <string>
+
+#include "extractor.h"
+
+using std::string;
+
+enum GateMode {
+    kGateContinuous,
+    kGateMotion,
+    kGatePerson,
+    kGateTimelapse
+};
+
+// "continuous", "motion", "person" or "timelapse", false if unknown
+//
+bool ParseGateMode(const string &name, GateMode &mode);
+
+class RecordPolicy {
+public:
+    RecordPolicy(const GateMode mode = kGateContinuous,
+                 const int hold = 10, const int timelapse_interval = 5);
+    ~RecordPolicy() {}
+
+    // whether the packet at time_ms is recorded, called for every packet
+    bool admit(const bool is_key, const int64_t time_ms);
+    // signal of the frame at time_ms, true if recording resumes and the
+    // current GOP has to be replayed
+    bool notify(const ExtractorSignal &signal, const int64_t time_ms);
+
+    GateMode get_mode() const { return mode_; }
+    bool is_recording() const { return recording_; }
+
+private:
+    GateMode mode_;
+    int64_t hold_ms_;
+    int64_t timelapse_ms_;
+    bool recording_;
+    int64_t active_until_;      // ms
+    int64_t last_timelapse_;    // ms
+};
+
+#endif // RECORDPOLICY_H
@@ -0,0 +1,127 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+#include "segmentfinalizer.h"
+#include "frameindex.h"
+#include "memcache.h"
+#include "sugar/sugar.h"
+
+using std::string;
+
+SegmentFinalizer::SegmentFinalizer()
+{
+    stop_ = false;
+    thread_ = std::thread(&SegmentFinalizer::run, this);
+}
+
+SegmentFinalizer::~SegmentFinalizer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void SegmentFinalizer::submit(std::unique_ptr<SegmentJob> job)
+{
+    job->submitted = GetEpochMsNow();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(job.release());
+        metrics_.submitted++;
+        metrics_.pending++;
+    }
+    cond_.notify_one();
+}
+
+FinalizerMetrics SegmentFinalizer::get_metrics()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return metrics_;
+}
+
+void SegmentFinalizer::run()
+{
+    // redis connection of this thread
+    MemCache memcache;
+
+    while (1) {
+        std::unique_ptr<SegmentJob> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+            if (jobs_.empty())
+                return;
+            job.reset(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        bool ok = finalize(*job) && memcache.save(job->video_shot);
+        int64_t elapsed = GetEpochMsNow() - job->submitted;
+        LogInfo("SegmentFinalizer",
+                (job->video_shot.get_filename() + (ok ? " finalized in " :
+                 " failed after ") + NumberToString(elapsed) + "ms").c_str());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        metrics_.pending--;
+        if (ok)
+            metrics_.finalized++;
+        else
+            metrics_.failed++;
+        metrics_.last_ms = elapsed;
+        metrics_.max_ms = std::max(metrics_.max_ms, elapsed);
+        metrics_.total_ms += elapsed;
+    }
+}
+
+bool SegmentFinalizer::finalize(SegmentJob &job)
+{
+    string video_path = job.video_shot.get_path() +
+                        job.video_shot.get_filename();
+
+    if (job.writer)
+        job.writer->release();
+
+    bool ok = true;
+    if (job.remuxer) {
+        job.remuxer->close();
+        // sidecar for seeking, see FrameSeeker
+        string index_path = FrameIndexPath(video_path);
+        ok = job.remuxer->get_index().save(index_path) && SyncFile(index_path);
+    }
+
+    if (!SyncFile(video_path)) {
+        LogError("Fail to sync video piece.");
+        ok = false;
+    }
+
+    return ok;
+}
+
+bool SyncFile(const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+
+    // the directory entry of a new file
+    string dir = path.substr(0, path.find_last_of('/') + 1);
+    fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    ok = fsync(fd) == 0 && ok;
+    close(fd);
+
+    return ok;
+}
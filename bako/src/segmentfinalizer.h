@@ -0,0 +1,79 @@
+#ifndef SEGMENTFINALIZER_H
+#define SEGMENTFINALIZER_H
+
+//
+// SegmentFinalizer: finish video pieces off the capture thread.
+//
+// VideoCacher hands over the writer of a piece when the next one starts
+// and opens a new writer at once. A background thread then closes the
+// container, writes the frame index sidecar, fsyncs the files and saves
+// the VideoShot into redis, so the piece shows up only once it is
+// complete on disk. The thread has its own MemCache.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <opencv2/opencv.hpp>
+#include "avstream.h"
+#include "gdatatype.h"
+
+using std::string;
+
+// a piece to finish, one of writer or remuxer is set
+struct SegmentJob {
+    SegmentJob(const VideoShot &video_shot) : video_shot(video_shot) {}
+
+    VideoShot video_shot;
+    std::unique_ptr<cv::VideoWriter> writer;
+    std::unique_ptr<AVRemuxer> remuxer;
+    int64_t submitted;          // epoch ms
+};
+
+struct FinalizerMetrics {
+    FinalizerMetrics()
+          : submitted(0), finalized(0), failed(0), pending(0),
+            last_ms(0), max_ms(0), total_ms(0) {}
+
+    size_t submitted, finalized, failed, pending;
+    // from submit to saved in redis
+    int64_t last_ms, max_ms, total_ms;
+};
+
+class SegmentFinalizer {
+public:
+    SegmentFinalizer();
+    // finishes the pieces still queued
+    ~SegmentFinalizer();
+
+    void submit(std::unique_ptr<SegmentJob> job);
+
+    FinalizerMetrics get_metrics();
+
+private:
+    SegmentFinalizer(const SegmentFinalizer &);
+    SegmentFinalizer &operator=(const SegmentFinalizer &);
+
+    void run();
+    bool finalize(SegmentJob &job);
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<SegmentJob *> jobs_;
+    bool stop_;
+    FinalizerMetrics metrics_;
+    std::thread thread_;
+};
+
+// flush a file and its directory entry to disk
+//
+bool SyncFile(const string &path);
+
+#endif // SEGMENTFINALIZER_H
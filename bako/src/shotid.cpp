@@ -0,0 +1,113 @@
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "shotid.h"
+#include "sugar/timestamp.h"
+
+using std::string;
+
+static const size_t kFramePosDigits = 5;
+static const size_t kSequenceDigits = 2;
+
+static bool IsHex(const string &str, const size_t pos, const size_t n)
+{
+    return str.find_first_not_of("0123456789abcdefABCDEF", pos) >= pos + n;
+}
+
+static bool IsDigits(const string &str, const size_t pos, const size_t n)
+{
+    return str.find_first_not_of("0123456789", pos) >= pos + n;
+}
+
+string CameraId::to_string() const
+{
+    char buffer[9];
+    snprintf(buffer, sizeof(buffer), "%08x", ip);
+
+    return string(buffer, kCameraIdChars);
+}
+
+string VideoId::to_string() const
+{
+    return camera.to_string() + IdToString(video);
+}
+
+string FrameId::to_string() const
+{
+    // wider than 5 digits rather than fail
+    char buffer[16];
+    int n = snprintf(buffer, sizeof(buffer), "%05u", frame_pos);
+
+    return get_video_id().to_string() + string(buffer, n);
+}
+
+string PersonShotId::to_string() const
+{
+    char buffer[16];
+    int n = snprintf(buffer, sizeof(buffer), "%02u", sequence);
+
+    return get_frame_id().to_string() + string(buffer, n);
+}
+
+CameraId CameraIdFromIP(const string &ip)
+{
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    sscanf(ip.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d);
+
+    return CameraId((a & 0xff) << 24 | (b & 0xff) << 16 |
+                    (c & 0xff) << 8 | (d & 0xff));
+}
+
+bool ParseId(const string &str, CameraId &id)
+{
+    if (str.size() != kCameraIdChars || !IsHex(str, 0, kCameraIdChars))
+        return false;
+
+    id.ip = (uint32_t)strtoul(str.c_str(), NULL, 16);
+    return true;
+}
+
+bool ParseId(const string &str, VideoId &id)
+{
+    if (str.size() != kVideoIdChars)
+        return false;
+
+    return ParseId(str.substr(0, kCameraIdChars), id.camera) &&
+           IdFromString(str.substr(kCameraIdChars), id.video);
+}
+
+bool ParseId(const string &str, FrameId &id)
+{
+    // frame_pos may be wider than 5 digits, up to uint32
+    size_t digits = str.size() - kVideoIdChars;
+    if (str.size() < kVideoIdChars + kFramePosDigits || digits > 10 ||
+            !IsDigits(str, kVideoIdChars, digits))
+        return false;
+
+    unsigned long long frame_pos = strtoull(str.c_str() + kVideoIdChars,
+                                            NULL, 10);
+    VideoId video_id;
+    if (frame_pos > UINT32_MAX ||
+            !ParseId(str.substr(0, kVideoIdChars), video_id))
+        return false;
+
+    id = FrameId(video_id, (size_t)frame_pos);
+    return true;
+}
+
+bool ParseId(const string &str, PersonShotId &id)
+{
+    if (str.size() < kVideoIdChars + kFramePosDigits + kSequenceDigits)
+        return false;
+
+    size_t frame_chars = str.size() - kSequenceDigits;
+    FrameId frame_id;
+    if (!IsDigits(str, frame_chars, kSequenceDigits) ||
+            !ParseId(str.substr(0, frame_chars), frame_id))
+        return false;
+
+    id = PersonShotId(frame_id, (size_t)atoi(str.c_str() + frame_chars));
+    return true;
+}
@@ -0,0 +1,189 @@
+#ifndef SHOTID_H
+#define SHOTID_H
+
+//
+// Packed ids of cameras, video pieces, frames and person shots.
+//
+// They are plain structs of integers, so building one allocates nothing,
+// and they order, compare and hash as integers, which makes them cheap
+// keys for the in-memory indexes. String forms are made at the edges
+// (redis keys, filenames) and are the ids saved before:
+//  CameraId: hex(ip), 8 chars, e.g. c0a87101
+//  VideoId: camera + video id, 24 chars, see IdToString()
+//  FrameId: video + frame_pos, 5 digits or more
+//  PersonShotId: frame + sequence, 2 digits
+// Ids order as their strings do while frame_pos fits in 5 digits.
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+using std::string;
+
+// persons of a keyframe beyond this are not saved
+static const uint32_t kMaxShotSequence = 99;
+
+// chars of the string forms which have a fixed size
+static const size_t kCameraIdChars = 8;
+static const size_t kVideoIdChars = kCameraIdChars + 16;
+
+struct CameraId {
+    CameraId() : ip(0) {}
+    explicit CameraId(const uint32_t ip_) : ip(ip_) {}
+
+    uint32_t ip;    // IPv4 address, host order
+
+    string to_string() const;
+};
+
+struct VideoId {
+    VideoId() : video(0) {}
+    VideoId(const CameraId &camera_, const uint64_t video_)
+        : video(video_), camera(camera_) {}
+
+    uint64_t video;     // see IdGenerator
+    CameraId camera;
+
+    string to_string() const;
+};
+
+struct FrameId {
+    FrameId() : video(0), frame_pos(0) {}
+    FrameId(const VideoId &video_id, const size_t frame_pos_)
+        : video(video_id.video), camera(video_id.camera),
+          frame_pos((uint32_t)frame_pos_) {}
+
+    uint64_t video;
+    CameraId camera;
+    uint32_t frame_pos;
+
+    VideoId get_video_id() const { return VideoId(camera, video); }
+    string to_string() const;
+};
+
+struct PersonShotId {
+    PersonShotId() : video(0), frame_pos(0), sequence(0) {}
+    PersonShotId(const FrameId &frame_id, const size_t sequence_)
+        : video(frame_id.video), camera(frame_id.camera),
+          frame_pos(frame_id.frame_pos), sequence((uint32_t)sequence_) {}
+
+    uint64_t video;
+    CameraId camera;
+    uint32_t frame_pos;
+    uint32_t sequence;  // of the person in the keyframe
+
+    VideoId get_video_id() const { return VideoId(camera, video); }
+    FrameId get_frame_id() const
+    { return FrameId(get_video_id(), frame_pos); }
+    string to_string() const;
+};
+
+// from "192.168.113.1"
+//
+CameraId CameraIdFromIP(const string &ip);
+
+// parse the string forms, false if malformed
+//
+bool ParseId(const string &str, CameraId &id);
+bool ParseId(const string &str, VideoId &id);
+bool ParseId(const string &str, FrameId &id);
+bool ParseId(const string &str, PersonShotId &id);
+
+//
+// ordering and equality, camera first then time
+//
+inline bool operator==(const CameraId &a, const CameraId &b)
+{ return a.ip == b.ip; }
+inline bool operator!=(const CameraId &a, const CameraId &b)
+{ return !(a == b); }
+inline bool operator<(const CameraId &a, const CameraId &b)
+{ return a.ip < b.ip; }
+
+inline bool operator==(const VideoId &a, const VideoId &b)
+{ return a.camera == b.camera && a.video == b.video; }
+inline bool operator!=(const VideoId &a, const VideoId &b)
+{ return !(a == b); }
+inline bool operator<(const VideoId &a, const VideoId &b)
+{
+    if (a.camera != b.camera)
+        return a.camera < b.camera;
+    return a.video < b.video;
+}
+
+inline bool operator==(const FrameId &a, const FrameId &b)
+{
+    return a.camera == b.camera && a.video == b.video &&
+           a.frame_pos == b.frame_pos;
+}
+inline bool operator!=(const FrameId &a, const FrameId &b)
+{ return !(a == b); }
+inline bool operator<(const FrameId &a, const FrameId &b)
+{
+    if (a.camera != b.camera)
+        return a.camera < b.camera;
+    if (a.video != b.video)
+        return a.video < b.video;
+    return a.frame_pos < b.frame_pos;
+}
+
+inline bool operator==(const PersonShotId &a, const PersonShotId &b)
+{ return a.get_frame_id() == b.get_frame_id() && a.sequence == b.sequence; }
+inline bool operator!=(const PersonShotId &a, const PersonShotId &b)
+{ return !(a == b); }
+inline bool operator<(const PersonShotId &a, const PersonShotId &b)
+{
+    if (a.get_frame_id() != b.get_frame_id())
+        return a.get_frame_id() < b.get_frame_id();
+    return a.sequence < b.sequence;
+}
+
+// mix of 64-bit words for the hashes
+//
+inline size_t HashIdWords(uint64_t h, const uint64_t w)
+{
+    h ^= w + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    h *= 0x7fb5d329728ea185ULL;
+    h ^= h >> 27;
+
+    return (size_t)h;
+}
+
+namespace std {
+
+template <>
+struct hash<CameraId> {
+    size_t operator()(const CameraId &id) const
+    { return HashIdWords(0, id.ip); }
+};
+
+template <>
+struct hash<VideoId> {
+    size_t operator()(const VideoId &id) const
+    { return HashIdWords(id.video, id.camera.ip); }
+};
+
+template <>
+struct hash<FrameId> {
+    size_t operator()(const FrameId &id) const
+    {
+        return HashIdWords(id.video,
+                           (uint64_t)id.camera.ip << 32 | id.frame_pos);
+    }
+};
+
+template <>
+struct hash<PersonShotId> {
+    size_t operator()(const PersonShotId &id) const
+    {
+        return HashIdWords(hash<FrameId>()(id.get_frame_id()), id.sequence);
+    }
+};
+
+} // namespace std
+
+#endif // SHOTID_H
@@ -1,3 +1,5 @@
+#include <sys/stat.h>
+
 #include <vector>
 #include <string>
 #include <sstream>
@@ -51,15 +53,23 @@ string FormatUnsignedInt(const size_t n, const size_t bits)
 {
     string rv = to_string(n);
 
-    if (bits < rv.size()) {
-        LogError("Unsigned int format error!");
-        exit(1);
-    }
+    // wider than bits rather than fail
+    if (bits > rv.size())
+        rv.insert(0, bits - rv.size(), '0');
 
-    size_t delta = bits - rv.size();
-    for (size_t i = 0; i < delta; i++) {
-        rv = "0" + rv;
+    return rv;
+}
+
+bool MakeDirs(const string &path)
+{
+    // each prefix ending before a slash, then the whole path. Failures
+    // on the way, existing or not ours, show in the end.
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        mkdir(path.substr(0, pos).c_str(), 0755);
+        if (pos == string::npos)
+            break;
     }
 
-    return rv;
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
 }
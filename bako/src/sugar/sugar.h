@@ -1,10 +1,13 @@
 #ifndef SUGAR_H
 #define SUGAR_H
 
+#include <stdint.h>
 #include <cstdio>
 #include <sstream>
 #include <string>
 
+#include "timestamp.h"
+
 using std::ostringstream;
 using std::string;
 
@@ -18,7 +21,7 @@ string NumberToString(T Number)
 
 // get time now
 //
-string GetTimeNow(const string fmt="%Y-%m-%d %I:%M:%S");
+string GetTimeNow(const string fmt="%Y-%m-%d %H:%M:%S");
 
 // ip to hex string
 //
@@ -36,8 +39,13 @@ inline void LogError(const char *error)
     fprintf(stderr, "ERROR - %s\n", error);
 }
 
-// convert unsigned int to string with limited format
+// convert unsigned int to string, zero padded to bits digits at least
 //
 string FormatUnsignedInt(const size_t n, const size_t bits);
 
+// create the directory path and its parents, as mkdir -p, false if it
+// still does not exist
+//
+bool MakeDirs(const string &path);
+
 #endif // SUGAR_H
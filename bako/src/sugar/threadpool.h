@@ -0,0 +1,86 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+//
+// Fixed-size pool of worker threads, tasks run in FIFO order.
+//
+// submit() returns a future of the task's result. Tasks still queued
+// when the pool is destroyed are run before the workers exit.
+//
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(const size_t workers)
+    {
+        stop_ = false;
+        for (size_t i = 0; i < (workers ? workers : 1); ++i)
+            workers_.push_back(std::thread(&ThreadPool::run, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        for (size_t i = 0; i < workers_.size(); ++i)
+            workers_[i].join();
+    }
+
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> submit(F f)
+    {
+        typedef typename std::result_of<F()>::type R;
+
+        std::shared_ptr<std::packaged_task<R()> > task(
+                    new std::packaged_task<R()>(f));
+        std::future<R> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back([task]() { (*task)(); });
+        }
+        cond_.notify_one();
+
+        return future;
+    }
+
+    size_t size() const { return workers_.size(); }
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    void run()
+    {
+        while (1) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                    return;
+                task = tasks_.front();
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stop_;
+};
+
+#endif // THREADPOOL_H
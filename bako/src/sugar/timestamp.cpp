@@ -0,0 +1,102 @@
+#include <sys/time.h>
+#include <time.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "timestamp.h"
+
+using std::string;
+
+// wall clock at the first read, and the monotonic clock then
+//
+struct ClockAnchor {
+    ClockAnchor()
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        steady = std::chrono::steady_clock::now();
+        wall_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    }
+
+    int64_t wall_ms;
+    std::chrono::steady_clock::time_point steady;
+};
+
+int64_t GetEpochMsNow()
+{
+    static const ClockAnchor anchor;
+
+    return anchor.wall_ms + std::chrono::duration_cast<
+            std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - anchor.steady).count();
+}
+
+string FormatEpochMs(const int64_t ms, const char *fmt)
+{
+    time_t rawtime = (time_t)(ms / 1000);
+    struct tm timeinfo;
+    char buffer[80];
+
+    localtime_r(&rawtime, &timeinfo);
+    size_t n = strftime(buffer, sizeof(buffer), fmt, &timeinfo);
+
+    return string(buffer, n);
+}
+
+uint32_t CameraNumber(const string &ip)
+{
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    sscanf(ip.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d);
+
+    uint32_t addr = (a & 0xff) << 24 | (b & 0xff) << 16 |
+                    (c & 0xff) << 8 | (d & 0xff);
+    return addr & ((1u << kIdCameraBits) - 1);
+}
+
+IdGenerator::IdGenerator(const uint32_t camera)
+{
+    camera_ = camera & ((1u << kIdCameraBits) - 1);
+    last_ms_ = -1;
+    sequence_ = 0;
+}
+
+uint64_t IdGenerator::next()
+{
+    int64_t ms = GetEpochMsNow() - kIdEpochMs;
+    if (ms < 0)
+        ms = 0;
+
+    if (ms > last_ms_) {
+        sequence_ = 0;
+        last_ms_ = ms;
+    } else if (++sequence_ >> kIdSequenceBits) {
+        // the ms is used up, borrow the next one
+        sequence_ = 0;
+        ++last_ms_;
+    }
+
+    return (uint64_t)last_ms_ << (kIdCameraBits + kIdSequenceBits) |
+           (uint64_t)camera_ << kIdSequenceBits |
+           sequence_;
+}
+
+string IdToString(const uint64_t id)
+{
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)id);
+
+    return string(buffer, 16);
+}
+
+bool IdFromString(const string &str, uint64_t &id)
+{
+    if (str.size() != 16 ||
+            str.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+        return false;
+
+    id = (uint64_t)strtoull(str.c_str(), NULL, 16);
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+//
+// Timestamps and ids for the stream handlers.
+//
+// Time comes from a monotonic clock anchored to the wall clock once, so
+// it never goes backwards when the wall clock is stepped, and reading it
+// costs no localtime()/strftime(). Times stay epoch ms in the hot path,
+// strings are made at the edges only (filenames, redis), see
+// FormatEpochMs().
+//
+// Ids are 64-bit and sort by time:
+//  bits 63..22: ms since kIdEpochMs (about 139 years)
+//  bits 21..10: camera, see CameraNumber()
+//  bits  9..0:  sequence within the ms
+//
+// @Zhiqiang He
+//
+
+#include <stdint.h>
+#include <string>
+
+using std::string;
+
+// epoch ms of ids' time 0, 2015-01-01 00:00:00 UTC
+static const int64_t kIdEpochMs = 1420070400000LL;
+static const uint32_t kIdCameraBits = 12;
+static const uint32_t kIdSequenceBits = 10;
+
+// milliseconds since epoch, monotonic
+//
+int64_t GetEpochMsNow();
+
+// epoch ms as local time in strftime format, e.g. 20151007221022
+//
+string FormatEpochMs(const int64_t ms, const char *fmt = "%Y%m%d%H%M%S");
+
+// camera part of ids, the low bits of the IPv4 address
+//
+uint32_t CameraNumber(const string &ip);
+
+// ids of one camera, strictly increasing, not thread safe
+//
+class IdGenerator {
+public:
+    explicit IdGenerator(const uint32_t camera);
+    ~IdGenerator() {}
+
+    uint64_t next();
+
+private:
+    uint32_t camera_;
+    int64_t last_ms_;       // of the last id, since kIdEpochMs
+    uint32_t sequence_;     // of the last id
+};
+
+inline int64_t IdTimeMs(const uint64_t id)
+{
+    return (int64_t)(id >> (kIdCameraBits + kIdSequenceBits)) + kIdEpochMs;
+}
+
+inline uint32_t IdCamera(const uint64_t id)
+{
+    return (uint32_t)(id >> kIdSequenceBits) & ((1u << kIdCameraBits) - 1);
+}
+
+// 16 hex digits, strings sort as the ids do
+//
+string IdToString(const uint64_t id);
+bool IdFromString(const string &str, uint64_t &id);
+
+#endif // TIMESTAMP_H
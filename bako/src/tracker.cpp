@@ -0,0 +1,278 @@
+#include <stdint.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "tracker.h"
+#include "personindex.h"
+#include "gdatatype.h"
+#include "memcache.h"
+#include "RBML/featuremodel.h"
+
+using namespace cv;
+using std::string;
+using std::vector;
+
+// distances are squared L2, as PersonIndex ranks them, and fractions of
+// the scale of the feature model, the mean squared distance of two
+// random persons, see FeatureModel::get_scale()
+//
+// within a camera
+const int64_t kMaxKeyframeGapMs = 5000;     // track ends after the gap
+const float kMinIoU = 0.3;
+const float kMaxTrackDistance = 0.6;
+// across cameras
+const int64_t kLinkWindowMs = 120000;       // look back 2 mins
+const size_t kLinkCandidates = 5;
+const float kMaxLinkDistance = 0.3;
+// keyframe time between two evictions
+const int64_t kEvictIntervalMs = 10000;
+
+TrackerConfig::TrackerConfig(const double scale)
+{
+    max_keyframe_gap_ms = kMaxKeyframeGapMs;
+    min_iou = kMinIoU;
+    max_track_distance = (float)(kMaxTrackDistance * scale);
+    link_window_ms = kLinkWindowMs;
+    link_candidates = kLinkCandidates;
+    max_link_distance = (float)(kMaxLinkDistance * scale);
+}
+
+float RectIoU(const Rect &r1, const Rect &r2)
+{
+    float inter = (float)(r1 & r2).area();
+    float uni = (float)(r1.area() + r2.area()) - inter;
+
+    return uni > 0 ? inter / uni : 0;
+}
+
+static inline Rect ShotRect(const PersonShot &person_shot)
+{
+    // x1, y1, x2, y2
+    const vector<int> &rect = person_shot.get_rect();
+
+    return Rect(Point(rect[0], rect[1]), Point(rect[2], rect[3]));
+}
+
+Tracker::Tracker(PersonIndex &person_index, MemCache &memcache,
+                 const TrackerConfig &config)
+      : person_index_(person_index), memcache_(memcache), config_(config)
+{
+    next_key_ = 0;
+    newest_ = evicted_ = 0;
+}
+
+Tracker::~Tracker()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    while (!tracks_.empty())
+        finish(tracks_.begin()->first);
+    active_.clear();
+}
+
+void Tracker::append(Track &track, const PersonShot &person_shot)
+{
+    TrackPoint point;
+    point.shot_id = person_shot.get_id();
+    point.cam_id = person_shot.get_cam_id();
+    point.timestamp = person_shot.get_timestamp();
+    point.frame_pos = person_shot.get_frame_pos();
+    point.rect = ShotRect(person_shot);
+
+    if (track.points.empty())
+        track.head_feature = person_shot.get_proper_vector();
+    track.points.push_back(point);
+    track.feature = person_shot.get_proper_vector();
+}
+
+size_t Tracker::create(const PersonShot &person_shot)
+{
+    size_t key = next_key_++;
+    Track &track = tracks_[key];
+    track.id = -1;
+    track.cam_id = person_shot.get_cam_id();
+    track.prev = track.next = -1;
+    append(track, person_shot);
+
+    return key;
+}
+
+void Tracker::link(Track &track)
+{
+    // tracks of every camera which ended in the window
+    int64_t start = track.points.front().timestamp;
+    vector<TrackEnd> ends = memcache_.load_track_ends(
+            start - config_.link_window_ms, start);
+
+    // the own camera's are dropped before ranking, so they can not take
+    // the places of the other cameras'
+    struct Candidate {
+        float distance;
+        int64_t id;
+        bool operator<(const Candidate &other) const
+        { return distance < other.distance; }
+    };
+    vector<Candidate> candidates;
+    for (size_t i = 0; i < ends.size(); ++i) {
+        if (ends[i].cam_id == track.cam_id || ends[i].linked ||
+                ends[i].feature.total() != track.head_feature.total())
+            continue;
+        Candidate candidate;
+        candidate.distance = person_index_.distance(ends[i].feature,
+                                                    track.head_feature);
+        candidate.id = ends[i].id;
+        if (candidate.distance <= config_.max_link_distance)
+            candidates.push_back(candidate);
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    // another camera may claim a candidate first, then try the next
+    for (size_t i = 0; i < candidates.size() &&
+            i < config_.link_candidates; ++i) {
+        if (memcache_.link_tracks(candidates[i].id, track.id)) {
+            track.prev = candidates[i].id;
+            break;
+        }
+    }
+}
+
+void Tracker::finish(const size_t key)
+{
+    std::unordered_map<size_t, Track>::iterator it = tracks_.find(key);
+    if (it == tracks_.end())
+        return;
+
+    Track &track = it->second;
+    track.id = memcache_.next_track_id();
+    if (track.id >= 0) {
+        link(track);
+        memcache_.save(track);
+    }
+    tracks_.erase(it);
+}
+
+void Tracker::update(const CameraId &cam_id, const int64_t timestamp,
+                     const vector<PersonShot> &person_shots)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    newest_ = std::max(newest_, timestamp);
+    if (newest_ - evicted_ >= kEvictIntervalMs)
+        evict(newest_);
+
+    // tracks of the camera which may continue, the others are finished
+    vector<size_t> candidates;
+    vector<size_t> &active = active_[cam_id];
+    for (size_t i = 0; i < active.size(); ++i) {
+        std::unordered_map<size_t, Track>::const_iterator it =
+                tracks_.find(active[i]);
+        if (it == tracks_.end())
+            continue;
+        if (timestamp - it->second.points.back().timestamp <=
+                config_.max_keyframe_gap_ms)
+            candidates.push_back(active[i]);
+        else
+            finish(active[i]);
+    }
+
+    // greedy association, lowest cost first
+    struct Pair {
+        float cost;
+        size_t track, shot;
+        bool operator<(const Pair &other) const
+        { return cost < other.cost; }
+    };
+    vector<Pair> pairs;
+    for (size_t t = 0; t < candidates.size(); ++t) {
+        const Track &track = tracks_[candidates[t]];
+        for (size_t s = 0; s < person_shots.size(); ++s) {
+            float iou = RectIoU(track.points.back().rect,
+                                ShotRect(person_shots[s]));
+            if (iou < config_.min_iou) continue;
+            float dist = person_index_.distance(
+                        track.feature, person_shots[s].get_proper_vector());
+            if (dist > config_.max_track_distance) continue;
+
+            Pair pair;
+            pair.cost = (1 - iou) + dist / config_.max_track_distance;
+            pair.track = candidates[t];
+            pair.shot = s;
+            pairs.push_back(pair);
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    vector<bool> shot_done(person_shots.size(), false);
+    std::map<size_t, bool> track_done;
+    vector<size_t> next_active;
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (shot_done[pairs[i].shot] || track_done[pairs[i].track])
+            continue;
+        shot_done[pairs[i].shot] = track_done[pairs[i].track] = true;
+        append(tracks_[pairs[i].track], person_shots[pairs[i].shot]);
+        next_active.push_back(pairs[i].track);
+    }
+
+    // tracks not continued end here
+    for (size_t t = 0; t < candidates.size(); ++t) {
+        if (!track_done[candidates[t]])
+            finish(candidates[t]);
+    }
+
+    // the rest are new tracks
+    for (size_t s = 0; s < person_shots.size(); ++s) {
+        if (!shot_done[s])
+            next_active.push_back(create(person_shots[s]));
+    }
+
+    active.swap(next_active);
+}
+
+void Tracker::evict(const int64_t now)
+{
+    evicted_ = now;
+
+    // tracks of cameras which stopped sending keyframes
+    std::unordered_map<CameraId, vector<size_t> >::iterator a;
+    for (a = active_.begin(); a != active_.end(); ) {
+        vector<size_t> &keys = a->second;
+        for (size_t i = 0; i < keys.size(); ) {
+            std::unordered_map<size_t, Track>::const_iterator it =
+                    tracks_.find(keys[i]);
+            if (it != tracks_.end() && now - it->second.points.back().timestamp
+                    <= config_.max_keyframe_gap_ms) {
+                ++i;
+                continue;
+            }
+            finish(keys[i]);
+            keys[i] = keys.back();
+            keys.pop_back();
+        }
+        if (keys.empty())
+            active_.erase(a++);
+        else
+            ++a;
+    }
+}
+
+size_t Tracker::get_tracks() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return tracks_.size();
+}
+
+Tracker &SharedTracker()
+{
+    static MemCache memcache;
+    // distances of the embeddings of the model the extractors use
+    static Tracker tracker(SharedPersonIndex(), memcache,
+                           TrackerConfig(DefaultFeatureModel()->get_scale()));
+
+    return tracker;
+}
@@ -0,0 +1,135 @@
+#ifndef TRACKER_H
+#define TRACKER_H
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include "gdatatype.h"
+#include "personindex.h"
+
+class MemCache;
+
+using std::string;
+using std::vector;
+
+//
+// Link person shots into tracks, incrementally as keyframes come.
+//
+// Within a camera, detections of consecutive keyframes are associated
+// by IoU of PersonShot::rect plus feature distance. Only the tracks
+// alive at the last keyframe of each camera are held in memory.
+//
+// A track which is not continued is finished: it gets an id from redis,
+// is chained to the best match among the tracks which other cameras
+// finished shortly before it started, and is saved with its shots, see
+// MemCache::save(const Track &). Every bako process (one per camera)
+// saves there, so the candidates are those of all cameras, and the
+// candidates of the own camera are dropped before ranking, never
+// crowding out the others.
+//
+// A person's path is then one lookup in redis: the track of the shot,
+// then its chain, see track_path() of the actor.
+//
+// @Zhiqiang He
+//
+// one detection of a track
+struct TrackPoint {
+    PersonShotId shot_id;
+    CameraId cam_id;
+    int64_t timestamp;  // epoch ms
+    size_t frame_pos;
+    cv::Rect rect;
+};
+
+// distances are those of PersonIndex, squared L2
+struct TrackerConfig {
+    // the defaults, distances for embeddings whose two random persons are
+    // scale apart on average, in squared L2
+    TrackerConfig(const double scale = 1);
+
+    // within a camera
+    int64_t max_keyframe_gap_ms;    // track ends after the gap
+    float min_iou;
+    float max_track_distance;
+    // across cameras
+    int64_t link_window_ms;         // look back before the track starts
+    size_t link_candidates;         // nearest ones tried, see link()
+    float max_link_distance;
+};
+
+struct Track {
+    int64_t id;                 // in redis, -1 until finished
+    CameraId cam_id;
+    vector<TrackPoint> points;  // in timestamp order
+    cv::Mat head_feature;       // proper vector of the first detection
+    cv::Mat feature;            // of the last detection
+    int64_t prev, next;         // linked tracks on other cameras, -1 none
+};
+
+// a finished track, as a link candidate
+struct TrackEnd {
+    int64_t id;
+    CameraId cam_id;
+    int64_t time_end;           // epoch ms of its last detection
+    bool linked;                // has a successor already
+    cv::Mat feature;            // of its last detection
+};
+
+class Tracker {
+public:
+    // memcache is used under the tracker's lock only
+    Tracker(PersonIndex &person_index, MemCache &memcache,
+            const TrackerConfig &config = TrackerConfig());
+    // finishes the tracks still alive
+    ~Tracker();
+
+    // person shots detected in one keyframe of one camera,
+    // a keyframe with no person ends the tracks of the camera
+    void update(const CameraId &cam_id, const int64_t timestamp,
+                const vector<PersonShot> &person_shots);
+
+    const TrackerConfig &get_config() const { return config_; }
+    // tracks alive
+    size_t get_tracks() const;
+
+private:
+    Tracker(const Tracker &);
+    Tracker &operator=(const Tracker &);
+
+    size_t create(const PersonShot &person_shot);
+    void append(Track &track, const PersonShot &person_shot);
+    // chain the track to the other cameras and save it
+    void finish(const size_t key);
+    // pick the predecessor of track among the finished ones
+    void link(Track &track);
+    // finish the tracks which can not continue any more at now
+    void evict(const int64_t now);
+
+    PersonIndex &person_index_;
+    MemCache &memcache_;
+    TrackerConfig config_;
+
+    // alive, by a key of the process
+    std::unordered_map<size_t, Track> tracks_;
+    size_t next_key_;
+    int64_t newest_, evicted_;      // epoch ms of keyframes
+    // tracks alive at the last keyframe of each camera
+    std::unordered_map<CameraId, vector<size_t> > active_;
+
+    mutable std::mutex mutex_;
+};
+
+// IoU of two rectangles
+//
+float RectIoU(const cv::Rect &r1, const cv::Rect &r2);
+
+// Tracker over SharedPersonIndex(), saving into a redis connection of
+// its own.
+//
+Tracker &SharedTracker();
+
+#endif // TRACKER_H
@@ -1,9 +1,10 @@
+#include <memory>
 #include <string>
 
 #include <opencv2/opencv.hpp>
 #include "videocacher.h"
 #include "gdatatype.h"
-#include "memcache.h"
+#include "sugar/sugar.h"
 #include "sugar/gdebug.h"
 
 using namespace cv;
@@ -17,26 +18,50 @@ VideoCacher::VideoCacher()
     frames_counter_ = 0;
     codec_ = "h264";
     format_ = "mkv";
+    codecpar_ = NULL;
+    written_pos_ = -1;
+    gap_start_ = -1;
+    video_id_ = 0;
+    video_start_time_ = video_end_time_ = 0;
+}
+
+void VideoCacher::set_stream_copy(const AVInput &input)
+{
+    codecpar_ = input.get_codecpar();
+    time_base_ = input.get_time_base();
+    codec_ = input.get_codec_name();
 }
 
 void VideoCacher::init(IPCamera ip_camera,
-                       const string &video_id,
+                       const uint64_t video_id,
                        VideoTime video_time,
                        VideoStreamMeta video_stream_meta)
 {
     // init new video meta
-    cam_id_ = ip_camera.get_id();
+    camera_id_ = ip_camera.get_camera_id();
     video_id_ = video_id;
     video_stream_meta_ = video_stream_meta;
     video_start_time_ = video_time.time_start;
 
     // open a file to write video stream
-    filename_ = cam_id_ + video_id_ + "." + format_;
+    filename_ = VideoId(camera_id_, video_id_).to_string() + "." + format_;
+    if (is_stream_copy()) {
+        written_pos_ = -1;
+        remuxer_.reset(new AVRemuxer);
+        if (!remuxer_->open(path_ + filename_, codecpar_, time_base_)) {
+            LogError("Video stream remuxer init fail.");
+            exit(1);
+        }
+        is_init_ = true;
+        return;
+    }
+
     Size v_size(video_stream_meta_.solution[0],
                 video_stream_meta_.solution[1]);
-    writer_.open(path_ + filename_, CV_FOURCC('X', '2', '6', '4'),
-                video_stream_meta_.fps, v_size);
-    if (!writer_.isOpened()) {
+    writer_.reset(new VideoWriter);
+    writer_->open(path_ + filename_, CV_FOURCC('X', '2', '6', '4'),
+                  video_stream_meta_.fps, v_size);
+    if (!writer_->isOpened()) {
         LogError("Video stream writer init fail.");
         exit(1);
     }
@@ -53,7 +78,7 @@ void VideoCacher::update(size_t frames_counter,
 }
 
 void VideoCacher::handler(const IPCamera ip_camera,
-                          const string &video_id,
+                          const uint64_t video_id,
                           const VideoTime video_time,
                           const VideoStreamMeta video_stream_meta,
                           const size_t frames_counter,
@@ -79,29 +104,106 @@ void VideoCacher::handler(const IPCamera ip_camera,
         // create a new video piece
         init(ip_camera, video_id, video_time, video_stream_meta);
         update(frames_counter, video_time);
-        writer_ << frame;
+        *writer_ << frame;
     } else {
         // continue
-        writer_ << frame;
+        *writer_ << frame;
+    }
+}
+
+void VideoCacher::handler(const IPCamera ip_camera,
+                          const uint64_t video_id,
+                          const VideoTime video_time,
+                          const VideoStreamMeta video_stream_meta,
+                          const size_t frames_counter,
+                          const AVPacket *packet)
+{
+    // create the first video piece
+    if (!is_init()) {
+        init(ip_camera, video_id, video_time, video_stream_meta);
+    }
+
+    // new video piece come, the caller only changes video id on keyframes
+    if (video_id_ != video_id) {
+        release();
+        init(ip_camera, video_id, video_time, video_stream_meta);
     }
+
+    // replayed packets may have been written already
+    int64_t frame_pos = (int64_t)frames_counter - 1;
+    if (frame_pos <= written_pos_)
+        return;
+
+    close_gap();
+    update(frames_counter, video_time);
+    remuxer_->write(packet, frame_pos);
+    written_pos_ = frame_pos;
+}
+
+void VideoCacher::skip(const uint64_t video_id,
+                       const VideoTime video_time,
+                       const size_t frames_counter)
+{
+    // new video piece come, finish the last one
+    if (is_init() && video_id_ != video_id)
+        release();
+
+    if (gap_start_ < 0)
+        gap_start_ = GetEpochMsNow();
+    if (is_init())
+        update(frames_counter, video_time);
+}
+
+void VideoCacher::close_gap()
+{
+    if (gap_start_ < 0)
+        return;
+
+    VideoGap gap;
+    gap.time_start = gap_start_;
+    gap.time_end = GetEpochMsNow();
+    if (gap.time_end > gap.time_start)
+        gaps_.push_back(gap);
+    gap_start_ = -1;
 }
 
 void VideoCacher::release()
 {
     if (is_init_) {
-        // save video meta into redis
-        VideoShot video_shot(video_id_, cam_id_,
+        // video meta to save into redis
+        VideoShot video_shot(VideoId(camera_id_, video_id_),
                              video_stream_meta_.fps,
                              frames_counter_,
                              format_, codec_,
-                             video_start_time_,
-                             video_end_time_,
+                             FormatEpochMs(video_start_time_),
+                             FormatEpochMs(video_end_time_),
                              path_, filename_);
-        memcache_.save(video_shot);
+        // a gap goes on into the next piece
+        bool in_gap = gap_start_ >= 0;
+        close_gap();
+        video_shot.set_gaps(gaps_);
+        gaps_.clear();
+        if (in_gap)
+            gap_start_ = GetEpochMsNow();
+
+        // finish the piece in the background, the next writer is opened
+        // by init() right away
+        std::unique_ptr<SegmentJob> job(new SegmentJob(video_shot));
+        job->writer = std::move(writer_);
+        job->remuxer = std::move(remuxer_);
+        finalizer_.submit(std::move(job));
+
+        // pieces are minutes long, a line each is cheap
+        FinalizerMetrics metrics = get_finalizer_metrics();
+        LogInfo("VideoCacher", (camera_id_.to_string() + " pieces " +
+                NumberToString(metrics.finalized) + " finalized, " +
+                NumberToString(metrics.failed) + " failed, " +
+                NumberToString(metrics.pending) + " pending, last " +
+                NumberToString(metrics.last_ms) + "ms, max " +
+                NumberToString(metrics.max_ms) + "ms").c_str());
 
         // reset resouces
         filename_.clear();
-        writer_.release();
         frames_counter_ = 0;
         is_init_ = false;
     }
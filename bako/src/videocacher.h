@@ -1,11 +1,12 @@
 #ifndef VIDEOCACHER_H
 #define VIDEOCACHER_H
 
+#include <memory>
 #include <string>
 
 #include "gdatatype.h"
-#include "memcache.h"
-#include "gdatatype.h"
+#include "avstream.h"
+#include "segmentfinalizer.h"
 
 using std::string;
 
@@ -13,14 +14,42 @@ using std::string;
 //  Video is saved to disk and its meta is
 //  saved to redis.
 //
+// A finished piece is handed over to a SegmentFinalizer, which closes it
+// and saves its meta in the background while the next piece is written.
+//
+// Two ways to save video:
+//  re-encode: decoded frames are encoded again by VideoWriter.
+//  stream copy: packets of the source are remuxed as they are, see
+//      set_stream_copy(). The caller cuts segments on keyframes, and
+//      a frame index sidecar is written next to each piece.
+//
 class VideoCacher {
 public:
     VideoCacher();
     ~VideoCacher() {}
 
-    // entity
+    // write packets of input as they are instead of re-encoding
+    void set_stream_copy(const AVInput &input);
+    bool is_stream_copy() const { return codecpar_ != NULL; }
+
+    // entity, stream copy, the packet is frame frames_counter - 1 of
+    // the piece
+    void handler(const IPCamera ip_camera,
+                 const uint64_t video_id,
+                 const VideoTime video_time,
+                 const VideoStreamMeta video_stream_meta,
+                 const size_t frames_counter,
+                 const AVPacket *packet);
+
+    // a packet which is not recorded, see RecordPolicy, the time until
+    // the next recorded one is saved as a gap
+    void skip(const uint64_t video_id,
+              const VideoTime video_time,
+              const size_t frames_counter);
+
+    // entity, re-encode
     void handler(const IPCamera ip_camera,
-                 const string &video_id,
+                 const uint64_t video_id,
                  const VideoTime video_time,
                  const VideoStreamMeta video_stream_meta,
                  const size_t frames_counter,
@@ -29,11 +58,16 @@ public:
     // save video and reset the instance
     void release();
 
+    // of the pieces handed over so far, logged by release()
+    FinalizerMetrics get_finalizer_metrics()
+    { return finalizer_.get_metrics(); }
+
 private:
-    string cam_id_, video_id_;
+    CameraId camera_id_;
+    uint64_t video_id_;
     VideoTime video_time_;
-    string video_start_time_;
-    string video_end_time_;
+    int64_t video_start_time_;  // epoch ms
+    int64_t video_end_time_;
     VideoStreamMeta video_stream_meta_;
 
     // where to save video
@@ -42,19 +76,28 @@ private:
     string codec_;
 
 
-    // to do video shot memcache
-    MemCache memcache_;
+    // to finish pieces and save their meta into redis
+    SegmentFinalizer finalizer_;
 
     // tmp vars, they must be reset every release time
     bool is_init_;              // default false
     string filename_;           // filename of video record
     size_t frames_counter_;     // to counter frames
-    cv::VideoWriter writer_;    // VideoWriter instance
+    // writer of the current piece, either of them
+    std::unique_ptr<cv::VideoWriter> writer_;
+    std::unique_ptr<AVRemuxer> remuxer_;    // for stream copy
+    int64_t written_pos_;       // last frame_pos written, -1 if none
+    vector<VideoGap> gaps_;     // of the piece
+    int64_t gap_start_;         // epoch ms of the open gap, -1 if none
+
+    // source of stream copy, NULL to re-encode
+    const AVCodecParameters *codecpar_;
+    AVRational time_base_;
 
 
     // init a new video cache
     void init(const IPCamera ip_camera,
-              const string &video_id,
+              const uint64_t video_id,
               VideoTime video_time,
               VideoStreamMeta video_stream_meta);
     bool is_init() { return is_init_; }
@@ -62,6 +105,8 @@ private:
     // to update part data
     void update(size_t frames_counter,
                 VideoTime video_time);
+    // end the open gap at now
+    void close_gap();
 };
 
 #endif // VIDEOCACHER_H
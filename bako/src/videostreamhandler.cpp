@@ -1,9 +1,16 @@
 #include <string>
+#include <vector>
 
 #include <opencv2/opencv.hpp>
 #include "videostreamhandler.h"
 #include "extractor.h"
 #include "videocacher.h"
+#include "avstream.h"
+#include "cliprecorder.h"
+#include "framepool.h"
+#include "keyframewriter.h"
+#include "packetring.h"
+#include "recordpolicy.h"
 #include "sugar/sugar.h"
 #include "gdatatype.h"
 #include "sugar/gdebug.h"
@@ -12,10 +19,286 @@ using namespace cv;
 using std::string;
 using std::to_string;
 
-string GetVideoID();
-string GetSysTimeNow();
+static void RecordByStreamCopy(AVInput &input, const IPCamera ip_camera,
+                               const GateMode gate_mode,
+                               const AnalyticsConfig &analytics);
+static void RecordByReencode(const string &sdp_addr, const IPCamera ip_camera,
+                             const AnalyticsConfig &analytics);
 
-void VideoStreamHandler(const string &sdp_addr, const IPCamera ip_camera)
+void VideoStreamHandler(const string &sdp_addr,
+                        const IPCamera ip_camera,
+                        const RecordMode record_mode,
+                        const GateMode gate_mode,
+                        const AnalyticsConfig &analytics)
+{
+    if (record_mode == kRecordStreamCopy) {
+        AVInput input;
+        if (!input.open(sdp_addr)) {
+            LogError("Fail to open video stream.");
+            exit(1);
+        }
+
+        if (input.can_stream_copy()) {
+            RecordByStreamCopy(input, ip_camera, gate_mode, analytics);
+            return;
+        }
+        LogInfo("VideoStreamHandler",
+                "Codec can not be stream copied, re-encode instead.");
+    }
+
+    RecordByReencode(sdp_addr, ip_camera, analytics);
+}
+
+// whether a frame at time_ms is due for the analytics (or the forwarder
+// at its own fps), next_ms is when the next one is
+//
+static bool AnalyticsDue(const double fps, const int64_t time_ms,
+                         const int64_t next_ms)
+{
+    if (fps <= 0)
+        return true;
+
+    // timestamps going backwards (a restarted source) restart the pace
+    return time_ms >= next_ms || next_ms - time_ms > (int64_t)(1000 / fps);
+}
+
+static int64_t AnalyticsNext(const double fps, const int64_t time_ms)
+{
+    return fps > 0 ? time_ms + (int64_t)(1000 / fps) : time_ms;
+}
+
+// proxies held at once: the current one, the extractor's reference and
+// some for the forwarder
+static const size_t kPooledProxies = 4;
+// frames, those and the keyframes queued for the KeyframeWriter, so a
+// backlog of keyframes does not allocate
+static const size_t kPooledFrames = kPooledProxies + kKeyframeQueue;
+
+// height of the analytics proxy of a width x height stream, 0 when the
+// frame itself is the proxy
+//
+static int ProxyHeight(const int width, const int height,
+                       const int proxy_width)
+{
+    if (proxy_width <= 0 || width <= 0 || proxy_width >= width)
+        return 0;
+
+    return (int)((int64_t)height * proxy_width / width);
+}
+
+// decode into buffers of the pools
+//
+static bool DecodeFrame(AVInput &input, const AVPacket *packet,
+                        FramePool &frame_pool, FramePool &proxy_pool,
+                        const int proxy_width, Frame &frame, Frame &proxy)
+{
+    frame = frame_pool.acquire();
+    if (proxy_pool.get_capacity() == 0) {
+        // share the buffer only once it is written, mutable_view() of a
+        // shared frame would decode into a copy
+        bool ok = input.decode(packet, frame.mutable_view());
+        proxy = frame;
+        return ok;
+    }
+
+    proxy = proxy_pool.acquire();
+    return input.decode(packet, frame.mutable_view(), proxy.mutable_view(),
+                        proxy_width);
+}
+
+// write the packets of the current GOP up to frame_counter, when
+// recording resumes in the middle of it
+//
+static void ReplayGop(const PacketRing &gop_ring, const int64_t time_ms,
+                      VideoCacher &videocacher, const IPCamera ip_camera,
+                      const uint64_t video_id, const VideoTime video_time,
+                      const VideoStreamMeta video_stream_meta,
+                      const size_t frame_counter)
+{
+    std::vector<AVPacket *> packets;
+    gop_ring.snapshot(time_ms, packets);
+
+    for (size_t i = 0; i < packets.size(); ++i) {
+        // the last packet is the current one, skip those of the last piece
+        size_t back = packets.size() - 1 - i;
+        if (back < frame_counter)
+            videocacher.handler(ip_camera, video_id,
+                                video_time,
+                                video_stream_meta,
+                                frame_counter - back,
+                                packets[i]);
+        av_packet_free(&packets[i]);
+    }
+}
+
+// Packets are saved as they are, frames are decoded for analytics only.
+// A new piece starts on the first keyframe after 10mins so every piece
+// is decodable on its own.
+//
+static void RecordByStreamCopy(AVInput &input, const IPCamera ip_camera,
+                               const GateMode gate_mode,
+                               const AnalyticsConfig &analytics)
+{
+    // fill video stream meta
+    VideoStreamMeta video_stream_meta;
+    video_stream_meta.codec = input.get_codec_name();
+    video_stream_meta.fps = (size_t)input.get_fps();
+    video_stream_meta.solution[0] = input.get_width();
+    video_stream_meta.solution[1] = input.get_height();
+
+#ifndef NOGDEBUG
+    cout << "-------------VIDEO STREAM META-----------" << endl;
+    cout << "CODEC: " << video_stream_meta.codec << " (stream copy)" << endl
+         << "FPS: " << video_stream_meta.fps << endl
+         << "SOLUTION: " << video_stream_meta.solution[0] << " "
+         << video_stream_meta.solution[1] << endl
+         << "ANALYTICS: " << analytics.fps << " fps, decode skip "
+         << analytics.decode_skip << endl
+         << "FORWARD: " << analytics.forward_fps << " fps" << endl;
+    cout << "-----------------------------------------" << endl;
+#endif
+
+    // init counter and prepare some vars
+    size_t frame_counter = 0;
+    IdGenerator video_ids(ip_camera.get_num());
+    uint64_t video_id = 0;
+    VideoTime video_time;
+    // held by the stages which need them, see FramePool
+    FramePool frame_pool(kPooledFrames, input.get_height(), input.get_width());
+    int proxy_height = ProxyHeight(input.get_width(), input.get_height(),
+                                   analytics.proxy_width);
+    FramePool proxy_pool(proxy_height ? kPooledProxies : 0, proxy_height,
+                         analytics.proxy_width);
+    Frame curr_frame;
+    Frame curr_proxy;   // for the analytics
+    int64_t timestamp_before = 0;
+    int64_t analytics_next = 0, forward_next = 0;
+    bool started = false;
+
+    // the recording never needs decoding, only the analytics and the live
+    // view do
+    input.set_decode_skip(analytics.decode_skip);
+
+    // init handler
+    Extractor extractor;
+    VideoCacher videocacher;
+    videocacher.set_stream_copy(input);
+    FrameRing frame_ring(FrameRingName(ip_camera.get_camera_id()));
+    vector<Rect> persons;   // of the latest keyframe, forwarded
+    // clips of keyframes with persons, 10s pre-roll and post-roll
+    ClipRecorder clip_recorder;
+    clip_recorder.init(input, ip_camera.get_id());
+    // what to record, the current GOP to resume in the middle of it
+    RecordPolicy record_policy(gate_mode);
+    PacketRing gop_ring(0);
+
+    AVPacket *packet = av_packet_alloc();
+    while (1) {
+        if (!input.read(packet)) {
+            LogError("Unable to read next packet.");
+
+            // if interrupt, release videocacher
+            videocacher.release();
+            clip_recorder.release();
+            av_packet_free(&packet);
+
+            throw "unabe to read next packet";
+        }
+
+        int64_t timestamp_after = PacketTimeMs(packet, input.get_time_base());
+        bool is_key = IsKeyPacket(packet);
+
+        // a piece must start with a keyframe
+        if (!started) {
+            if (!is_key) {
+                av_packet_unref(packet);
+                continue;
+            }
+            started = true;
+            video_id = video_ids.next();
+            video_time.time_end = video_time.time_start = GetEpochMsNow();
+            timestamp_before = timestamp_after;
+        }
+
+        // cut per 10mins, 600000ms, on keyframes
+        if (is_key && timestamp_after - timestamp_before >= 600000) {
+            // get id and start time for the new video
+            video_id = video_ids.next();
+            video_time.time_start = GetEpochMsNow();
+
+            // update timestamp before
+            timestamp_before = timestamp_after;
+            // reset frame counter
+            frame_counter = 0;
+        }
+
+        // set frame counter and update end time of video
+        frame_counter++;
+        video_time.time_end = GetEpochMsNow();
+
+        // cache video stream as the policy says
+        gop_ring.push(packet, timestamp_after);
+        if (record_policy.admit(is_key, timestamp_after))
+            videocacher.handler(ip_camera, video_id,
+                                video_time,
+                                video_stream_meta,
+                                frame_counter,
+                                packet);
+        else
+            videocacher.skip(video_id, video_time, frame_counter);
+        clip_recorder.push(packet, timestamp_after);
+
+        // decode for the analytics and the live view, frames due for
+        // neither are decoded only when later ones refer to them, and are
+        // not converted; those only forwarded get no proxy
+        bool analyzed = false, forwarded = false;
+        if (input.needs_decode(packet)) {
+            bool analytics_due = AnalyticsDue(analytics.fps, timestamp_after,
+                                              analytics_next);
+            bool forward_due = AnalyticsDue(analytics.forward_fps,
+                                            timestamp_after, forward_next);
+            if (analytics_due) {
+                analyzed = DecodeFrame(input, packet, frame_pool, proxy_pool,
+                                       analytics.proxy_width,
+                                       curr_frame, curr_proxy);
+                forwarded = analyzed && forward_due;
+            } else if (forward_due) {
+                curr_frame = frame_pool.acquire();
+                forwarded = input.decode(packet, curr_frame.mutable_view());
+            } else {
+                input.decode(packet);
+            }
+        }
+        if (analyzed) {
+            analytics_next = AnalyticsNext(analytics.fps, timestamp_after);
+
+            ExtractorSignal signal = extractor.handler(ip_camera, video_id,
+                                                       frame_counter - 1,
+                                                       curr_frame,
+                                                       curr_proxy);
+            if (record_policy.notify(signal, timestamp_after))
+                ReplayGop(gop_ring, timestamp_after, videocacher, ip_camera,
+                          video_id, video_time, video_stream_meta,
+                          frame_counter);
+            if (signal.persons > 0)
+                clip_recorder.trigger(timestamp_after);
+            if (signal.keyframe)
+                persons = signal.rects;
+        }
+        if (forwarded) {
+            forward_next = AnalyticsNext(analytics.forward_fps,
+                                         timestamp_after);
+            VideoForwarder(frame_ring, video_id, frame_counter - 1,
+                           curr_frame, persons);
+        }
+        av_packet_unref(packet);
+
+        waitKey(1);
+    }
+}
+
+static void RecordByReencode(const string &sdp_addr, const IPCamera ip_camera,
+                             const AnalyticsConfig &analytics)
 {
     // create video stream capture
     VideoCapture cap(sdp_addr);
@@ -45,19 +328,32 @@ void VideoStreamHandler(const string &sdp_addr, const IPCamera ip_camera)
     // init timestamp
     double timestamp_before = cap.get(CV_CAP_PROP_POS_MSEC);
     double timestamp_after = cap.get(CV_CAP_PROP_POS_MSEC);
+    int64_t analytics_next = 0, forward_next = 0;
 
     // init counter and prepare some vars
     size_t frame_counter = 0;
-    string video_id;
+    IdGenerator video_ids(ip_camera.get_num());
+    uint64_t video_id = 0;
     VideoTime video_time;
-    Mat curr_frame;
+    FramePool frame_pool(kPooledFrames, video_stream_meta.solution[1],
+                         video_stream_meta.solution[0]);
+    int proxy_height = ProxyHeight(video_stream_meta.solution[0],
+                                   video_stream_meta.solution[1],
+                                   analytics.proxy_width);
+    FramePool proxy_pool(proxy_height ? kPooledProxies : 0, proxy_height,
+                         analytics.proxy_width);
+    Frame curr_frame;
+    Frame curr_proxy;   // for the analytics
 
     // init handler
     Extractor extractor;
     VideoCacher videocacher;
+    FrameRing frame_ring(FrameRingName(ip_camera.get_camera_id()));
+    vector<Rect> persons;   // of the latest keyframe, forwarded
 
     while (1) {
-        if (!cap.read(curr_frame)) {
+        curr_frame = frame_pool.acquire();
+        if (!cap.read(curr_frame.mutable_view())) {
             LogError("Unable to read next frame.");
 
             // if interrupt, release videocacher
@@ -68,21 +364,16 @@ void VideoStreamHandler(const string &sdp_addr, const IPCamera ip_camera)
 
         // init some vars for the first frame
         if (cap.get(CV_CAP_PROP_POS_FRAMES) <= 1) {
-            video_id = GetVideoID();
-            video_time.time_end = video_time.time_start =
-                    GetSysTimeNow();
+            video_id = video_ids.next();
+            video_time.time_end = video_time.time_start = GetEpochMsNow();
         }
 
-        // set frame counter and update end time of video
-        frame_counter++;
-        video_time.time_end = GetSysTimeNow();
-
         // cut per 10mins, 600000ms
         timestamp_after = cap.get(CV_CAP_PROP_POS_MSEC);
         if (timestamp_after - timestamp_before >= 600000) {
             // get id and start time for the new video
-            video_id = GetVideoID();
-            video_time.time_start = GetSysTimeNow();
+            video_id = video_ids.next();
+            video_time.time_start = GetEpochMsNow();
 
             // update timestamp before
             timestamp_before = cap.get(CV_CAP_PROP_POS_MSEC);
@@ -90,6 +381,10 @@ void VideoStreamHandler(const string &sdp_addr, const IPCamera ip_camera)
             frame_counter = 0;
         }
 
+        // set frame counter and update end time of video
+        frame_counter++;
+        video_time.time_end = GetEpochMsNow();
+
         // Here can create asynchronous threads to implement
         // concurrency handling ?
         //
@@ -98,40 +393,43 @@ void VideoStreamHandler(const string &sdp_addr, const IPCamera ip_camera)
                             video_time,
                             video_stream_meta,
                             frame_counter,
-                            curr_frame);
-        extractor.handler(ip_camera, video_id,
-                          frame_counter, curr_frame);
+                            curr_frame.view());
+        if (AnalyticsDue(analytics.fps, (int64_t)timestamp_after,
+                         analytics_next)) {
+            analytics_next = AnalyticsNext(analytics.fps,
+                                           (int64_t)timestamp_after);
+            if (proxy_pool.get_capacity() == 0) {
+                curr_proxy = curr_frame;
+            } else {
+                curr_proxy = proxy_pool.acquire();
+                MakeProxy(curr_frame.view(), curr_proxy.mutable_view(),
+                          analytics.proxy_width);
+            }
+            ExtractorSignal signal = extractor.handler(ip_camera, video_id,
+                                                       frame_counter - 1,
+                                                       curr_frame,
+                                                       curr_proxy);
+            if (signal.keyframe)
+                persons = signal.rects;
+        }
 
-        // TODO (@Zhiqiang He): find a solution
-        VideoForwarder(ip_camera,
-                       video_id,
-                       video_time,
-                       video_stream_meta,
-                       curr_frame);
+        if (AnalyticsDue(analytics.forward_fps, (int64_t)timestamp_after,
+                         forward_next)) {
+            forward_next = AnalyticsNext(analytics.forward_fps,
+                                         (int64_t)timestamp_after);
+            VideoForwarder(frame_ring, video_id, frame_counter - 1,
+                           curr_frame, persons);
+        }
 
         waitKey(1);
     }
 }
 
-string GetVideoID()
-{
-    string fmt = "%Y%m%d%I%M%S";    // e.g. 20151007221022
-
-    return GetTimeNow(fmt);
-}
-
-string GetSysTimeNow()
-{
-    string fmt = "%Y%m%d%I%M%S";    // e.g. 20151007221022
-
-    return GetTimeNow(fmt);
-}
-
-void VideoForwarder(const IPCamera ip_camera,
-                    const string &video_id,
-                    const VideoTime video_time,
-                    const VideoStreamMeta video_stream_meta,
-                    const Mat &frame)
+void VideoForwarder(FrameRing &frame_ring,
+                    const uint64_t video_id,
+                    const size_t frame_pos,
+                    const Frame &frame,
+                    const vector<Rect> &persons)
 {
-    // cout << "This is video forwarder" << endl;
+    frame_ring.publish(frame.view(), video_id, frame_pos, persons);
 }
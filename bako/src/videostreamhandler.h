@@ -11,23 +11,68 @@
 //
 
 #include <string>
+#include <vector>
 
 #include <opencv2/opencv.hpp>
 #include "gdatatype.h"
+#include "avstream.h"
+#include "framepool.h"
+#include "framering.h"
+#include "persondetector.h"
+#include "recordpolicy.h"
 
 using std::string;
 
+// how the video stream is saved
+//
+enum RecordMode {
+    kRecordReencode,        // decode and encode again with VideoWriter
+    kRecordStreamCopy       // remux the camera's packets untouched
+};
+
+// what the analytics of a camera get
+//
+// fps caps the analytics frame rate, 0 for every decoded frame. With
+// stream copy only the frames decode_skip keeps are decoded at all, and
+// of those the ones due for neither the analytics nor the live view are
+// not converted. Re-encoding decodes every frame anyway.
+//
+// forward_fps paces the live frames published to the FrameRing on its
+// own, 0 for every decoded frame, so a low analytics rate does not make
+// the live view choppy. Forwarded frames which are not analyzed get no
+// proxy; they carry the persons of the latest keyframe.
+//
+struct AnalyticsConfig {
+    int proxy_width;            // of the proxy, 0 for the full frame
+    DecodeSkip decode_skip;
+    double fps;
+    double forward_fps;
+
+    AnalyticsConfig()
+          : proxy_width(kProxyWidth), decode_skip(kDecodeAll), fps(0),
+            forward_fps(0) {}
+};
+
 // entity
 //
+// Stream copy falls back to re-encoding when the codec can not be muxed
+// into matroska. gate_mode applies to stream copy, re-encoding records
+// continuously.
+//
 void VideoStreamHandler(const string &sdp_addr,
-                        const IPCamera ip_camera);
+                        const IPCamera ip_camera,
+                        const RecordMode record_mode = kRecordStreamCopy,
+                        const GateMode gate_mode = kGateContinuous,
+                        const AnalyticsConfig &analytics = AnalyticsConfig());
 
-// forward video stream to front-end
+// forward video stream to local consumers (front-end) through the
+// camera's FrameRing, with the persons of the latest keyframe, never
+// waits for them
 //
-void VideoForwarder(const IPCamera ip_camera,
-                    const string &video_id,
-                    const VideoTime video_time,
-                    const VideoStreamMeta video_stream_meta,
-                    const cv::Mat &frame);
+void VideoForwarder(FrameRing &frame_ring,
+                    const uint64_t video_id,
+                    const size_t frame_pos,
+                    const Frame &frame,
+                    const std::vector<cv::Rect> &persons);
 
 #endif // VIDEOSTREAMHANDLER_H
@@ -0,0 +1,59 @@
+#! .pyenv/bin/python2
+"""Migrate the person vectors in redis to the fused feature model.
+
+Vectors saved before the PCA and the RBML metric were fused are PCA
+projections, those saved since are embeddings in which the metric is
+plain L2 (see bako/src/RBML/featuremodel.h). Each psm: list of a ps: hash
+without vector_space is replaced by its embedding, and the hash marked.
+Running it again does nothing.
+
+Usage: migrate_vectors.py [feature model]
+"""
+import sys
+
+import numpy as np
+import redis
+
+from RBML import GetFeature
+
+EMBEDDING_SPACE = "embedding"
+
+
+def migrate(conn, model):
+    migrated = 0
+    for key in conn.scan_iter("ps:*"):
+        if conn.hget(key, "vector_space") is not None:
+            continue
+        vector_key = conn.hget(key, "proper_vector_id")
+        if vector_key is None:
+            continue
+        values = conn.lrange(vector_key, 0, -1)
+        if not values:
+            continue
+
+        dimension = int(values[0])
+        projected = np.array(values[1:], dtype=np.float32).reshape(-1, 1)
+        if projected.shape[0] != dimension:
+            continue
+        embedding = model.migrate(projected).ravel()
+
+        # the list and its mark together
+        pipe = conn.pipeline()
+        pipe.delete(vector_key)
+        pipe.rpush(vector_key, dimension, *[repr(float(v)) for v in embedding])
+        pipe.hset(key, "vector_space", EMBEDDING_SPACE)
+        pipe.execute()
+        migrated += 1
+
+    return migrated
+
+
+def main():
+    model_file = sys.argv[1] if len(sys.argv) > 1 \
+        else "bako/src/RBML/feature.model"
+    conn = redis.StrictRedis(host="127.0.0.1", port=6379, db=0)
+    print("{} vectors migrated".format(migrate(conn, GetFeature(model_file))))
+
+
+if __name__ == "__main__":
+    main()
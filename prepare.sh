@@ -7,10 +7,14 @@ mkdir -p /tmp/actor/log
 
 mkdir -p example/videos
 
+# keyframes are packed under /tmp/gee/blobs, served by the actor through
+# RBML.BlobStore, see bako/src/blobstore.h
 mkdir -p /tmp/gee/video && \
-mkdir -p /tmp/gee/keyframes && \
-ln -s /tmp/gee/video actor/static/video && \
-ln -s /tmp/gee/keyframes actor/static/keyframes
+mkdir -p /tmp/gee/blobs && \
+mkdir -p /tmp/gee/clips && \
+ln -s /tmp/gee/video actor/static/video
+# a link of an older setup, keyframes are no longer files
+[ -L actor/static/keyframes ] && rm actor/static/keyframes
 
 mkdir -p actor/static/tmp/person-shots && \
 mkdir -p actor/static/tmp/query-frames